@@ -0,0 +1,118 @@
+/* arena.c */
+#include "arena.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ARENA_ALIGN 8 /* alignment of every allocation */
+#define ARENA_FIRST_BLOCK 4096
+#define ARENA_MAX_BLOCK (1024*1024) /* block sizes stop doubling here */
+
+extern const char* PROGRAM_NAME;
+
+/* arena_block - header of a block of arena memory; the data follows */
+struct arena_block {
+    arena_block* next;
+    size_t used;
+    size_t size;
+};
+
+/* data internal to this unit */
+static long heap_allocs = 0;
+static long heap_frees = 0;
+
+#define BLOCK_DATA(pblock) ((char*)(pblock) + sizeof(arena_block))
+
+void init_arena(arena* parena)
+{
+    parena->blocks = NULL;
+    parena->next_size = ARENA_FIRST_BLOCK;
+}
+
+void destroy_arena(arena* parena)
+{
+    arena_block* pblock;
+    while (parena->blocks != NULL) {
+        pblock = parena->blocks;
+        parena->blocks = pblock->next;
+        heap_free(pblock);
+    }
+    parena->next_size = ARENA_FIRST_BLOCK;
+}
+
+void* arena_alloc(arena* parena,size_t size)
+{
+    void* ptr;
+    arena_block* pblock;
+    size = (size + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+    pblock = parena->blocks;
+    if (pblock==NULL || pblock->size-pblock->used < size) {
+        size_t blocksize = parena->next_size;
+        if (blocksize < size)
+            blocksize = size;
+        pblock = heap_alloc(sizeof(arena_block) + blocksize);
+        pblock->next = parena->blocks;
+        pblock->used = 0;
+        pblock->size = blocksize;
+        parena->blocks = pblock;
+        if (parena->next_size < ARENA_MAX_BLOCK)
+            parena->next_size *= 2;
+    }
+    ptr = BLOCK_DATA(pblock) + pblock->used;
+    pblock->used += size;
+    return ptr;
+}
+
+void* arena_grow(arena* parena,void* ptr,size_t oldsize,size_t newsize)
+{
+    void* pnew;
+    arena_block* pblock = parena->blocks;
+    oldsize = (oldsize + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+    newsize = (newsize + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+    /* the most recent allocation can be extended if its block has room */
+    if (pblock!=NULL && (char*)ptr+oldsize == BLOCK_DATA(pblock)+pblock->used
+        && pblock->size-pblock->used >= newsize-oldsize) {
+        pblock->used += newsize-oldsize;
+        return ptr;
+    }
+    pnew = arena_alloc(parena,newsize);
+    memcpy(pnew,ptr,oldsize);
+    return pnew;
+}
+
+void* heap_alloc(size_t size)
+{
+    void* ptr;
+    ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == NULL) {
+        fprintf(stderr,"%s: fatal error: out of memory\n",PROGRAM_NAME);
+        exit(1);
+    }
+    ++heap_allocs;
+    return ptr;
+}
+
+void* heap_realloc(void* ptr,size_t size)
+{
+    ptr = realloc(ptr,size);
+    if (ptr == NULL) {
+        fprintf(stderr,"%s: fatal error: out of memory\n",PROGRAM_NAME);
+        exit(1);
+    }
+    ++heap_allocs;
+    return ptr;
+}
+
+void heap_free(void* ptr)
+{
+    if (ptr != NULL) {
+        free(ptr);
+        ++heap_frees;
+    }
+}
+
+void get_heap_counters(long* pallocs,long* pfrees)
+{
+    *pallocs = heap_allocs;
+    *pfrees = heap_frees;
+}
@@ -0,0 +1,26 @@
+/* arena.h */
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+/* arena - a bump allocator that owns every allocation made from it until
+   it is destroyed; blocks are allocated from the heap with geometrically
+   increasing sizes so that n allocations cost O(log n) heap operations */
+typedef struct arena_block arena_block;
+typedef struct {
+    arena_block* blocks; /* most recently allocated block first */
+    size_t next_size; /* size of the next block allocated from the heap */
+} arena;
+
+void init_arena(arena*);
+void destroy_arena(arena*); /* release all allocations at once */
+void* arena_alloc(arena*,size_t size);
+void* arena_grow(arena*,void* ptr,size_t oldsize,size_t newsize); /* extends in place if ptr was the last allocation */
+
+/* heap wrappers that keep allocation counters */
+void* heap_alloc(size_t size);
+void* heap_realloc(void* ptr,size_t size);
+void heap_free(void* ptr);
+void get_heap_counters(long* pallocs,long* pfrees); /* number of heap allocations (including reallocations) and frees */
+
+#endif
@@ -0,0 +1,188 @@
+/* batch.c */
+#include "batch.h"
+#include "stringbuf.h"
+#include "jobserver.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+extern const char* PROGRAM_NAME;
+
+/* functions internal to this unit */
+static int read_record(FILE* fp,stringbuf* record); /* returns -1 at end of input */
+static int split_record(char* record,const char*** pargv,int* palloc,int argc); /* returns the new number of arguments */
+static int check_record(const char* argv[],int first,int argc); /* returns 0 if the record may run */
+static void finish_record(int code,int* pfailed,int* pret);
+static int start_record(command_handler handler,int argc,const char* argv[]); /* system-specific implementation - returns 0 on success */
+static int wait_record(int block,int* pcode); /* system-specific implementation - returns 0 if a record finished, 1 if none has finished yet or -1 if none is running */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#include "batch_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#include "batch_windows.c"
+#endif
+
+/* platform-independent code */
+
+int run_batch(const char* fileName,int limit,int keepGoing,int argc,const char* argv[],command_handler handler)
+{
+    /* the record buffer and argument vector are reused for every record;
+       a started record has its own copy of them */
+    int n;
+    int code;
+    int alloc;
+    int eof;
+    int records, running, failed;
+    int ret;
+    FILE* fp;
+    const char** args;
+    stringbuf record;
+    if (strcmp(fileName,"-") == 0)
+        fp = stdin;
+    else if ((fp = fopen(fileName,"rb")) == NULL) {
+        fprintf(stderr,"%s: error: cannot open batch file '%s'\n",PROGRAM_NAME,fileName);
+        return 1;
+    }
+    init_stringbuf(&record);
+    alloc = argc + 16;
+    args = heap_alloc(alloc*sizeof(const char*));
+    memcpy(args,argv,argc*sizeof(const char*));
+    eof = 0;
+    records = running = failed = ret = 0;
+    while (1) {
+        /* collect records that have finished so that a failure stops the
+           batch as soon as possible */
+        while ((n = wait_record(eof || running >= limit || (failed > 0 && !keepGoing),&code)) == 0) {
+            --running;
+            finish_record(code,&failed,&ret);
+        }
+        if (n == -1 && (eof || (failed > 0 && !keepGoing)))
+            break;
+        if (eof || running >= limit || (failed > 0 && !keepGoing))
+            continue;
+        if (read_record(fp,&record) == -1) {
+            eof = 1;
+            continue;
+        }
+        n = split_record(record.buffer,&args,&alloc,argc);
+        if (n == argc)
+            continue;
+        ++records;
+        if (check_record(args,argc,n) != 0) {
+            if (ret == 0)
+                ret = 1;
+            ++failed;
+            continue;
+        }
+        /* under 'make -jN' each running record holds a token; wait for a
+           running record to return one if none is free */
+        while (acquire_job_token()!=0 && wait_record(1,&code)==0) {
+            --running;
+            finish_record(code,&failed,&ret);
+        }
+        if (start_record(handler,n,args) != 0) {
+            finish_record(1,&failed,&ret);
+            continue;
+        }
+        ++running;
+    }
+    if (failed > 0) {
+        fprintf(stderr,"%s: error: batch failed: %d of %d records failed\n",PROGRAM_NAME,failed,records);
+        if (!eof)
+            fprintf(stderr,"%s: note: the rest of the batch was not read; use --keep-going to run it anyway\n",PROGRAM_NAME);
+    }
+    if (fp != stdin)
+        fclose(fp);
+    heap_free((void*)args);
+    destroy_stringbuf(&record);
+    return ret;
+}
+
+/* definitions of internal functions */
+
+int read_record(FILE* fp,stringbuf* record)
+{
+    int c;
+    reset_stringbuf(record);
+    while ((c = getc(fp)) != EOF && c != '\n' && c != 0)
+        append_char_stringbuf(record,(char)c);
+    if (c==EOF && record->used==0)
+        return -1;
+    if (record->used>0 && record->buffer[record->used-1]=='\r')
+        truncate_stringbuf(record,record->used-1);
+    return 0;
+}
+
+int split_record(char* record,const char*** pargv,int* palloc,int argc)
+{
+    /* split the record in place; quotes and backslashes are removed as in
+       the shell and a record that begins with '#' is a comment */
+    char quote;
+    char* iter;
+    char* out;
+    iter = record;
+    while (isspace((unsigned char)*iter))
+        ++iter;
+    if (*iter == '#')
+        return argc;
+    while (*iter) {
+        if (argc+1 >= *palloc) {
+            *palloc *= 2;
+            *pargv = heap_realloc((void*)*pargv,*palloc*sizeof(const char*));
+        }
+        (*pargv)[argc++] = out = iter;
+        quote = 0;
+        while (*iter && (quote || !isspace((unsigned char)*iter))) {
+            if (quote == 0 && (*iter == '\'' || *iter == '"'))
+                quote = *iter++;
+            else if (*iter == quote) {
+                quote = 0;
+                ++iter;
+            }
+            else if (*iter=='\\' && quote!='\'' && iter[1]!=0) {
+                *out++ = iter[1];
+                iter += 2;
+            }
+            else
+                *out++ = *iter++;
+        }
+        if (*iter)
+            ++iter;
+        *out = 0;
+        while (isspace((unsigned char)*iter))
+            ++iter;
+    }
+    (*pargv)[argc] = NULL;
+    return argc;
+}
+
+void finish_record(int code,int* pfailed,int* pret)
+{
+    release_job_token();
+    if (code != 0) {
+        if (*pret == 0)
+            *pret = code;
+        ++*pfailed;
+    }
+}
+
+int check_record(const char* argv[],int first,int argc)
+{
+    /* options that keep a command running cannot be used in a record */
+    int i;
+    for (i = first;i < argc;++i) {
+        if (strcmp(argv[i],"--watch")==0 || strcmp(argv[i],"--server")==0 || strncmp(argv[i],"--worker",8)==0
+            || strcmp(argv[i],"--batch")==0 || strncmp(argv[i],"--batch=",8)==0) {
+            fprintf(stderr,"%s: error: option '%s' cannot be used in a batch record\n",PROGRAM_NAME,argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
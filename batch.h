@@ -0,0 +1,16 @@
+/* batch.h */
+#ifndef BATCH_H
+#define BATCH_H
+#include "server.h" /* command_handler */
+
+/* run_batch - run a command-line for each record read from 'fileName' ("-"
+   for standard input); a record is a line or a null-terminated string of
+   arguments separated by white space, which may be quoted as in the shell;
+   each record's arguments follow argv[0..argc), and at most 'limit' records
+   run at once; records are started as they are read, so the input may be a
+   pipe that is still being written; after a record fails no more are
+   started unless 'keepGoing' is non-zero; returns the first non-zero exit
+   code of a record or 0 */
+int run_batch(const char* fileName,int limit,int keepGoing,int argc,const char* argv[],command_handler handler);
+
+#endif
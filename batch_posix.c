@@ -0,0 +1,53 @@
+/* batch_posix.c */
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+int start_record(command_handler handler,int argc,const char* argv[])
+{
+    /* each record runs in its own process, like a server request, so that
+       an error that stops a command only stops its record; the settings
+       loaded by this process are shared with the child */
+    int fd;
+    pid_t pid;
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid == 0) {
+        int code;
+        /* the token taken for the record is this process's implicit token */
+        reset_job_tokens();
+        /* the records may be arriving on standard input */
+        fd = open("/dev/null",O_RDONLY);
+        if (fd != -1) {
+            dup2(fd,STDIN_FILENO);
+            close(fd);
+        }
+        code = handler(argc,argv);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(code);
+    }
+    if (pid == -1) {
+        fprintf(stderr,"%s: error: cannot start record process: %s\n",PROGRAM_NAME,strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int wait_record(int block,int* pcode)
+{
+    int status;
+    pid_t pid;
+    do {
+        pid = waitpid(-1,&status,block ? 0 : WNOHANG);
+    } while (pid == -1 && errno == EINTR);
+    if (pid == -1)
+        return -1;
+    if (pid == 0)
+        return 1;
+    *pcode = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    return 0;
+}
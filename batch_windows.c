@@ -0,0 +1,22 @@
+/* batch_windows.c */
+
+/* data internal to this file */
+static int record_code = -1; /* exit code of the record run by start_record(); -1 if none */
+
+int start_record(command_handler handler,int argc,const char* argv[])
+{
+	/* there is no fork(), so records run one at a time in this process; an
+	   error that stops a command therefore stops the batch */
+	reset_job_tokens();
+	record_code = handler(argc,argv);
+	return 0;
+}
+
+int wait_record(int block,int* pcode)
+{
+	if (record_code == -1)
+		return -1;
+	*pcode = record_code;
+	record_code = -1;
+	return 0;
+}
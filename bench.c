@@ -0,0 +1,168 @@
+/* bench.c - driver for the microbenchmarks run by 'make bench'; the
+   benchmarks call the internal functions of each unit directly with
+   synthetic inputs and report nanoseconds and heap allocations per
+   operation */
+#include "bench.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_STRING_OPS 1000000
+
+/* globals */
+const char* PROGRAM_NAME;
+
+/* data internal to this unit */
+static char bench_directory[FILENAME_MAX];
+
+/* functions internal to this unit */
+static long long read_clock(); /* monotonic nanoseconds */
+static void bench_stringbuf();
+static void remove_bench_directory();
+
+int main(int argc,const char* argv[])
+{
+    static const int RULE_COUNTS[] = { 10, 100, 1000, 10000 };
+    static const int ENTRY_COUNTS[] = { 10, 1000, 100000, 1000000 };
+    int entries_c;
+    const char* tmp;
+    PROGRAM_NAME = argv[0];
+    /* --quick skips the largest directories */
+    entries_c = sizeof(ENTRY_COUNTS)/sizeof(ENTRY_COUNTS[0]);
+    if (argc>1 && strcmp(argv[1],"--quick")==0)
+        entries_c -= 2;
+    tmp = getenv("TMPDIR");
+    sprintf(bench_directory,"%s/compile-bench-XXXXXX",tmp != NULL ? tmp : "/tmp");
+    if (mkdtemp(bench_directory) == NULL) {
+        fprintf(stderr,"%s: cannot create scratch directory\n",PROGRAM_NAME);
+        return 1;
+    }
+    printf("%-44s %10s %12s %10s\n","benchmark","ops","ns/op","allocs/op");
+    bench_stringbuf();
+    bench_settings(RULE_COUNTS,sizeof(RULE_COUNTS)/sizeof(RULE_COUNTS[0]));
+    bench_expand_options();
+    bench_lookup_ext(ENTRY_COUNTS,entries_c);
+    remove_bench_directory();
+    return 0;
+}
+
+void start_bench(bench_timer* ptimer)
+{
+    long frees;
+    get_heap_counters(&ptimer->allocs,&frees);
+    ptimer->start = read_clock();
+}
+
+void stop_bench(bench_timer* ptimer,const char* name,long long ops)
+{
+    long allocs, frees;
+    long long elapsed;
+    elapsed = get_bench_time(ptimer);
+    get_heap_counters(&allocs,&frees);
+    printf("%-44s %10lld %12.1f %10.2f\n",name,ops,(double)elapsed / ops,
+        (double)(allocs-ptimer->allocs) / ops);
+    fflush(stdout);
+}
+
+long long get_bench_time(const bench_timer* ptimer)
+{
+    return read_clock() - ptimer->start;
+}
+
+const char* get_bench_directory()
+{
+    return bench_directory;
+}
+
+void write_targets_file(const char* fileName,int rules)
+{
+    int i;
+    FILE* fp;
+    fp = fopen(fileName,"w");
+    if (fp == NULL) {
+        fprintf(stderr,"%s: cannot write '%s'\n",PROGRAM_NAME,fileName);
+        exit(1);
+    }
+    /* the first rule is the usual C rule so that targets resolve */
+    fprintf(fp,".c gcc -Wall -o$project\n");
+    for (i = 1;i < rules;++i)
+        fprintf(fp,".x%d compiler%d -O2 -g -Wall -Wextra -o$project >$project.log\n",i,i);
+    fclose(fp);
+}
+
+/* definitions of internal functions */
+
+long long read_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bench_stringbuf()
+{
+    int i;
+    stringbuf buf;
+    arena pool;
+    bench_timer timer;
+    static const char* const WORD = "option";
+
+    /* appends that grow a heap buffer from its initial size */
+    start_bench(&timer);
+    init_stringbuf(&buf);
+    for (i = 0;i < BENCH_STRING_OPS;++i)
+        concat_stringbuf(&buf,WORD);
+    destroy_stringbuf(&buf);
+    stop_bench(&timer,"concat_stringbuf heap",BENCH_STRING_OPS);
+
+    /* appends that grow an arena buffer in place */
+    start_bench(&timer);
+    init_arena(&pool);
+    init_stringbuf_arena(&buf,&pool);
+    for (i = 0;i < BENCH_STRING_OPS;++i)
+        concat_stringbuf(&buf,WORD);
+    destroy_arena(&pool);
+    stop_bench(&timer,"concat_stringbuf arena",BENCH_STRING_OPS);
+
+    /* argument lists as built by build_job() */
+    start_bench(&timer);
+    init_stringbuf(&buf);
+    for (i = 0;i < BENCH_STRING_OPS;++i) {
+        if (i % 64 == 0)
+            reset_stringbuf(&buf);
+        concat_stringbuf_ex(&buf,WORD,4);
+        append_terminator_stringbuf(&buf);
+    }
+    destroy_stringbuf(&buf);
+    stop_bench(&timer,"concat_stringbuf_ex+terminator",BENCH_STRING_OPS);
+
+    /* the same with explicit lengths and the separator copied along */
+    start_bench(&timer);
+    init_stringbuf(&buf);
+    for (i = 0;i < BENCH_STRING_OPS;++i) {
+        if (i % 64 == 0)
+            reset_stringbuf(&buf);
+        append_stringbuf(&buf,WORD,7);
+    }
+    destroy_stringbuf(&buf);
+    stop_bench(&timer,"append_stringbuf",BENCH_STRING_OPS);
+
+    /* short-lived buffers */
+    start_bench(&timer);
+    for (i = 0;i < BENCH_STRING_OPS;++i) {
+        init_stringbuf(&buf);
+        assign_stringbuf(&buf,"target.c");
+        destroy_stringbuf(&buf);
+    }
+    stop_bench(&timer,"init+assign+destroy_stringbuf",BENCH_STRING_OPS);
+}
+
+void remove_bench_directory()
+{
+    char command[FILENAME_MAX+16];
+    sprintf(command,"rm -rf '%s'",bench_directory);
+    if (system(command) != 0)
+        fprintf(stderr,"%s: cannot remove '%s'\n",PROGRAM_NAME,bench_directory);
+}
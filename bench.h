@@ -0,0 +1,27 @@
+/* bench.h - microbenchmarks of internal functions (see 'make bench') */
+#ifndef BENCH_H
+#define BENCH_H
+#include "stringbuf.h"
+
+/* bench_timer - measures the time and heap allocations of a run of
+   operations */
+typedef struct {
+    long long start; /* nanoseconds */
+    long allocs; /* heap allocation counter at start */
+} bench_timer;
+
+void start_bench(bench_timer*);
+void stop_bench(bench_timer*,const char* name,long long ops); /* print ns/op and allocations/op */
+long long get_bench_time(const bench_timer*); /* nanoseconds since start_bench() */
+const char* get_bench_directory(); /* scratch directory for synthetic inputs */
+void write_targets_file(const char* fileName,int rules); /* write 'rules' rules with distinct extensions */
+
+/* benchmarks of settings.c (bench_settings.c) */
+void bench_settings(const int* sizes,int count);
+void load_bench_rules(const char* fileName); /* replace the loaded settings with the rules in the file */
+
+/* benchmarks of compiler.c (bench_compiler.c) */
+void bench_lookup_ext(const int* sizes,int count);
+void bench_expand_options();
+
+#endif
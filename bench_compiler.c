@@ -0,0 +1,103 @@
+/* bench_compiler.c - benchmarks of target resolution and option expansion;
+   the unit is included so that its internal functions can be called */
+#include "compiler.c"
+#include "bench.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BENCH_LOOKUPS 20000 /* maximum lookups per benchmark */
+#define BENCH_LOOKUP_TIME 500000000 /* nanoseconds after which lookups stop early */
+#define BENCH_OPTIONS 1000000
+
+void bench_lookup_ext(const int* sizes,int count)
+{
+    /* each directory holds the target plus 'size'-1 other files; lookups are
+       made with a few rules (probing) and with many rules (scanning) */
+    static const int RULE_COUNTS[] = { 3, 1000 };
+    int i, j, k, n;
+    int fd;
+    char name[80];
+    const char* extensions[MAX_EXTENSIONS];
+    stringbuf path;
+    stringbuf target;
+    stringbuf rules;
+    bench_timer timer;
+    init_stringbuf(&path);
+    init_stringbuf(&target);
+    init_stringbuf(&rules);
+    for (i = 0;i < count;++i) {
+        sprintf(name,"/dir%d",sizes[i]);
+        assign_stringbuf(&target,get_bench_directory());
+        concat_stringbuf(&target,name);
+        mkdir(target.buffer,S_IRWXU);
+        for (n = 0;n < sizes[i];++n) {
+            assign_stringbuf(&path,target.buffer);
+            sprintf(name,n == 0 ? "/target.c" : "/file%d.o",n);
+            concat_stringbuf(&path,name);
+            fd = open(path.buffer,O_CREAT|O_WRONLY,S_IRUSR|S_IWUSR);
+            if (fd == -1) {
+                fprintf(stderr,"%s: cannot create '%s'\n",PROGRAM_NAME,path.buffer);
+                exit(1);
+            }
+            close(fd);
+        }
+        concat_stringbuf(&target,"/target");
+        for (j = 0;j < (int)(sizeof(RULE_COUNTS)/sizeof(RULE_COUNTS[0]));++j) {
+            assign_stringbuf(&rules,get_bench_directory());
+            concat_stringbuf(&rules,"/targets");
+            write_targets_file(rules.buffer,RULE_COUNTS[j]);
+            load_bench_rules(rules.buffer);
+            /* a lookup may scan the whole directory, so slow lookups are
+               stopped after a time limit */
+            start_bench(&timer);
+            for (k = 0;k<BENCH_LOOKUPS && (k<10 || get_bench_time(&timer)<BENCH_LOOKUP_TIME);++k)
+                if (lookup_ext(extensions,target.buffer) != 1) {
+                    fprintf(stderr,"%s: lookup of '%s' failed\n",PROGRAM_NAME,target.buffer);
+                    exit(1);
+                }
+            sprintf(name,"lookup_ext entries=%d rules=%d",sizes[i],RULE_COUNTS[j]);
+            stop_bench(&timer,name,k);
+        }
+    }
+    destroy_stringbuf(&rules);
+    destroy_stringbuf(&target);
+    destroy_stringbuf(&path);
+}
+
+void bench_expand_options()
+{
+    /* each option is compiled once, as load_compiler() does, and expanded
+       for a job whose values are assigned once */
+    static const char* const OPTIONS[] = { "-Wall", "-o$project", "-MF$depfile", "$dir/$stem.o" };
+    int i, k;
+    char name[64];
+    session ses;
+    job bj;
+    option_template tmpl;
+    stringbuf dest;
+    bench_timer timer;
+    init_session(&ses,1);
+    assign_stringbuf(ses.targets,"some/directory/project.c");
+    ses.targets_c = 1;
+    init_job(&bj,&ses.pool);
+    bj.target = ses.targets[0].buffer;
+    assign_stringbuf(&bj.project,"some/directory/project");
+    assign_stringbuf(&bj.depfile,"/home/user/.compile/deps/0123456789abcdef.d");
+    assign_values(&ses,&bj);
+    init_stringbuf(&dest);
+    for (k = 0;k < (int)(sizeof(OPTIONS)/sizeof(OPTIONS[0]));++k) {
+        compile_options(&tmpl,OPTIONS[k],1,NULL);
+        start_bench(&timer);
+        for (i = 0;i < BENCH_OPTIONS;++i) {
+            if (i % 64 == 0)
+                reset_stringbuf(&dest);
+            expand_options(&ses,&bj,&dest,&tmpl,OPTIONS[k],1);
+        }
+        sprintf(name,"expand_options '%s'",OPTIONS[k]);
+        stop_bench(&timer,name,BENCH_OPTIONS);
+        destroy_template(&tmpl);
+    }
+    destroy_stringbuf(&dest);
+    destroy_job(&bj);
+    destroy_session(&ses);
+}
@@ -0,0 +1,51 @@
+/* bench_settings.c - benchmarks of the targets file reader; the unit is
+   included so that its internal functions can be called */
+#include "settings.c"
+#include "bench.h"
+
+#define BENCH_SCANNED_RULES 200000 /* rules scanned by each benchmark */
+
+void bench_settings(const int* sizes,int count)
+{
+    int i, j, k;
+    int runs;
+    char name[64];
+    stringbuf fileName;
+    bench_timer timer;
+    init_stringbuf(&fileName);
+    for (i = 0;i < count;++i) {
+        assign_stringbuf(&fileName,get_bench_directory());
+        concat_stringbuf(&fileName,"/targets");
+        write_targets_file(fileName.buffer,sizes[i]);
+        runs = BENCH_SCANNED_RULES / sizes[i];
+        if (runs == 0)
+            runs = 1;
+        /* map, scan and index the file as load_settings_from_file() does */
+        start_bench(&timer);
+        for (j = 0;j < runs;++j) {
+            load_bench_rules(fileName.buffer);
+            unload_settings();
+        }
+        sprintf(name,"load_rules rules=%d",sizes[i]);
+        stop_bench(&timer,name,(long long)runs*sizes[i]);
+        /* parse every rule with load_compiler() as if each were used */
+        start_bench(&timer);
+        for (j = 0;j < runs;++j) {
+            load_bench_rules(fileName.buffer);
+            for (k = 0;k < loaded_compilers_c;++k)
+                parse_rule(k);
+            unload_settings();
+        }
+        sprintf(name,"load_rules+parse_rule rules=%d",sizes[i]);
+        stop_bench(&timer,name,(long long)runs*sizes[i]);
+    }
+    destroy_stringbuf(&fileName);
+}
+
+void load_bench_rules(const char* fileName)
+{
+    if (loaded_compilers_c > 0)
+        unload_settings();
+    init_arena(&settings_pool);
+    load_rules(fileName);
+}
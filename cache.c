@@ -0,0 +1,317 @@
+/* cache.c */
+#include "cache.h"
+#include "settings.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#define PACKAGE_NAME "compile"
+#define PACKAGE_STRING "compile (build unknown)"
+#endif
+
+#define DEFAULT_CACHE_MAX_SIZE (1024LL*1024*1024) /* 1 GiB */
+#define EVICT_TARGET_PERCENT 90 /* eviction shrinks the cache to this percentage of the maximum size */
+
+/* indices of counters in the stats file */
+#define STAT_HITS 0
+#define STAT_MISSES 1
+#define STAT_SIZE 2
+#define STAT_MAX_SIZE 3
+#define STAT_COUNT 4
+
+extern const char* PROGRAM_NAME;
+
+/* cache_entry - an artifact found in the cache directory */
+typedef struct {
+    char name[40]; /* path relative to the cache directory (e.g. ab/cdef...) */
+    long long size;
+    long long time; /* time of last use */
+} cache_entry;
+
+/* data internal to this unit */
+static long long stat_deltas[STAT_COUNT]; /* changes made by this process; applied by close_cache() */
+static int cache_used = 0;
+
+/* functions internal to this unit */
+static const char* get_cache_directory();
+static void entry_path(const cache_key* key,stringbuf* dest);
+static void read_stats(long long* stats);
+static void write_stats(const long long* stats);
+static void evict_entries(long long* stats);
+static int compare_entries(const void* left,const void* right);
+static int make_cache_directory(const char* dirName); /* system-specific implementation - returns 0 if the directory exists */
+static int copy_cache_file(const char* src,const char* dest,long long* psize); /* system-specific implementation - returns 0 on success */
+static void touch_cache_file(const char* fileName); /* system-specific implementation */
+static int rename_cache_file(const char* src,const char* dest); /* system-specific implementation - replaces dest; returns 0 on success */
+static int list_cache_entries(const char* dirName,cache_entry** pentries); /* system-specific implementation - returns number of entries */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#define PATH_SEPARATOR "/"
+#include "cache_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#define PATH_SEPARATOR "\\"
+#include "cache_windows.c"
+#endif
+
+/* platform-independent code */
+
+void init_cache_key(cache_key* pkey)
+{
+    pkey->hash[0] = 14695981039346656037ULL; /* FNV-1a offset basis */
+    pkey->hash[1] = 0x9e3779b97f4a7c15ULL;
+}
+
+void hash_cache_key(cache_key* pkey,const char* bytes,int n)
+{
+    /* first half is FNV-1a; the second half is a rotate-xor-multiply hash
+       so that the halves do not collide together */
+    int i;
+    unsigned long long a, b;
+    a = pkey->hash[0];
+    b = pkey->hash[1];
+    for (i = 0;i < n;++i) {
+        a ^= (unsigned char)bytes[i];
+        a *= 1099511628211ULL;
+        b = ((b << 5) | (b >> 59)) ^ (unsigned char)bytes[i];
+        b *= 0xff51afd7ed558ccdULL;
+    }
+    pkey->hash[0] = a;
+    pkey->hash[1] = b;
+}
+
+int hash_cache_key_file(cache_key* pkey,const char* fileName)
+{
+    size_t n;
+    FILE* fp;
+    char ibuf[65536];
+    fp = fopen(fileName,"rb");
+    if (fp == NULL)
+        return -1;
+    while ((n = fread(ibuf,1,sizeof(ibuf),fp)) > 0)
+        hash_cache_key(pkey,ibuf,(int)n);
+    n = ferror(fp);
+    fclose(fp);
+    return n ? -1 : 0;
+}
+
+int cache_restore(const cache_key* pkey,const char* output)
+{
+    int result;
+    long long size;
+    stringbuf path;
+    cache_used = 1;
+    init_stringbuf(&path);
+    entry_path(pkey,&path);
+    result = copy_cache_file(path.buffer,output,&size);
+    if (result == 0) {
+        /* mark the entry as recently used */
+        touch_cache_file(path.buffer);
+        ++stat_deltas[STAT_HITS];
+    }
+    else
+        ++stat_deltas[STAT_MISSES];
+    destroy_stringbuf(&path);
+    return result;
+}
+
+void cache_store(const cache_key* pkey,const char* output)
+{
+    int i;
+    long long size;
+    stringbuf path;
+    cache_used = 1;
+    init_stringbuf(&path);
+    entry_path(pkey,&path);
+    /* create the entry's subdirectory */
+    i = path.used;
+    while (i>0 && path.buffer[i-1]!=PATH_SEPARATOR[0])
+        --i;
+    path.buffer[i-1] = 0;
+    if (make_cache_directory(path.buffer) == 0) {
+        path.buffer[i-1] = PATH_SEPARATOR[0];
+        if (copy_cache_file(output,path.buffer,&size) == 0)
+            stat_deltas[STAT_SIZE] += size;
+        else
+            fprintf(stderr,"%s: warning: could not store '%s' in cache\n",PROGRAM_NAME,output);
+    }
+    else
+        fprintf(stderr,"%s: warning: cannot create cache directory '%s'\n",PROGRAM_NAME,path.buffer);
+    destroy_stringbuf(&path);
+}
+
+void close_cache()
+{
+    int i;
+    long long stats[STAT_COUNT];
+    if (!cache_used)
+        return;
+    /* apply this process's changes to the latest counters so that concurrent
+       runs lose as few updates as possible */
+    read_stats(stats);
+    for (i = 0;i < STAT_COUNT;++i)
+        stats[i] += stat_deltas[i];
+    if (stats[STAT_SIZE] > stats[STAT_MAX_SIZE])
+        evict_entries(stats);
+    write_stats(stats);
+    for (i = 0;i < STAT_COUNT;++i)
+        stat_deltas[i] = 0;
+    cache_used = 0;
+}
+
+void print_cache_stats()
+{
+    long long total;
+    long long stats[STAT_COUNT];
+    read_stats(stats);
+    total = stats[STAT_HITS] + stats[STAT_MISSES];
+    printf("cache directory: %s\n",get_cache_directory());
+    printf("hits: %lld\n",stats[STAT_HITS]);
+    printf("misses: %lld\n",stats[STAT_MISSES]);
+    printf("hit rate: %.1f%%\n",total == 0 ? 0.0 : 100.0 * stats[STAT_HITS] / total);
+    printf("size: %lld KiB\n",stats[STAT_SIZE] / 1024);
+    printf("max size: %lld KiB\n",stats[STAT_MAX_SIZE] / 1024);
+}
+
+int set_cache_max_size(const char* size)
+{
+    /* size is a number of bytes with an optional K, M or G suffix */
+    char* end;
+    long long n;
+    long long stats[STAT_COUNT];
+    n = strtoll(size,&end,10);
+    switch (toupper(*end)) {
+    case 'G':
+        n *= 1024;
+        /* fall through */
+    case 'M':
+        n *= 1024;
+        /* fall through */
+    case 'K':
+        n *= 1024;
+        ++end;
+        break;
+    }
+    if (*size==0 || *end!=0 || n<=0) {
+        fprintf(stderr,"%s: invalid cache size '%s'\n",PROGRAM_NAME,size);
+        return -1;
+    }
+    read_stats(stats);
+    stats[STAT_MAX_SIZE] = n;
+    if (stats[STAT_SIZE] > stats[STAT_MAX_SIZE])
+        evict_entries(stats);
+    write_stats(stats);
+    return 0;
+}
+
+/* definitions of internal functions */
+
+const char* get_cache_directory()
+{
+    static char dirName[FILENAME_MAX];
+    if (dirName[0] == 0) {
+        strcpy(dirName,get_settings_directory());
+        strcat(dirName,PATH_SEPARATOR "cache");
+        if (make_cache_directory(dirName) != 0)
+            fprintf(stderr,"%s: warning: cannot create cache directory '%s'\n",PROGRAM_NAME,dirName);
+    }
+    return dirName;
+}
+
+void entry_path(const cache_key* pkey,stringbuf* dest)
+{
+    /* entries are spread over subdirectories named by the first byte of the key */
+    char name[40];
+    sprintf(name,PATH_SEPARATOR "%02x" PATH_SEPARATOR "%014llx%016llx",(unsigned)(pkey->hash[0] >> 56),
+        pkey->hash[0] & 0xffffffffffffffULL,pkey->hash[1]);
+    assign_stringbuf(dest,get_cache_directory());
+    concat_stringbuf(dest,name);
+}
+
+void read_stats(long long* stats)
+{
+    FILE* fp;
+    stringbuf path;
+    stats[STAT_HITS] = stats[STAT_MISSES] = stats[STAT_SIZE] = 0;
+    stats[STAT_MAX_SIZE] = DEFAULT_CACHE_MAX_SIZE;
+    init_stringbuf(&path);
+    assign_stringbuf(&path,get_cache_directory());
+    concat_stringbuf(&path,PATH_SEPARATOR "stats");
+    fp = fopen(path.buffer,"r");
+    if (fp != NULL) {
+        if (fscanf(fp,"%lld %lld %lld %lld",stats+STAT_HITS,stats+STAT_MISSES,
+                stats+STAT_SIZE,stats+STAT_MAX_SIZE) != STAT_COUNT) {
+            stats[STAT_HITS] = stats[STAT_MISSES] = stats[STAT_SIZE] = 0;
+            stats[STAT_MAX_SIZE] = DEFAULT_CACHE_MAX_SIZE;
+        }
+        fclose(fp);
+    }
+    destroy_stringbuf(&path);
+}
+
+void write_stats(const long long* stats)
+{
+    /* write to a temporary file and rename it over the stats file so that
+       readers never see a partially written file */
+    FILE* fp;
+    stringbuf path;
+    stringbuf temp;
+    init_stringbuf(&path);
+    init_stringbuf(&temp);
+    assign_stringbuf(&path,get_cache_directory());
+    concat_stringbuf(&path,PATH_SEPARATOR "stats");
+    assign_stringbuf(&temp,path.buffer);
+    concat_stringbuf(&temp,".tmp");
+    fp = fopen(temp.buffer,"w");
+    if (fp != NULL) {
+        fprintf(fp,"%lld %lld %lld %lld\n",stats[STAT_HITS],stats[STAT_MISSES],
+            stats[STAT_SIZE],stats[STAT_MAX_SIZE]);
+        if (fclose(fp)!=0 || rename_cache_file(temp.buffer,path.buffer)!=0)
+            remove(temp.buffer);
+    }
+    destroy_stringbuf(&temp);
+    destroy_stringbuf(&path);
+}
+
+void evict_entries(long long* stats)
+{
+    /* remove least recently used entries until the cache is below the
+       target size; the size counter is recomputed from the directory */
+    int i;
+    int count;
+    long long size;
+    long long target;
+    stringbuf path;
+    cache_entry* entries;
+    count = list_cache_entries(get_cache_directory(),&entries);
+    size = 0;
+    for (i = 0;i < count;++i)
+        size += entries[i].size;
+    target = stats[STAT_MAX_SIZE] / 100 * EVICT_TARGET_PERCENT;
+    qsort(entries,count,sizeof(cache_entry),&compare_entries);
+    init_stringbuf(&path);
+    for (i = 0;i<count && size>target;++i) {
+        assign_stringbuf(&path,get_cache_directory());
+        concat_stringbuf(&path,PATH_SEPARATOR);
+        concat_stringbuf(&path,entries[i].name);
+        if (remove(path.buffer) == 0)
+            size -= entries[i].size;
+    }
+    destroy_stringbuf(&path);
+    free(entries);
+    stats[STAT_SIZE] = size;
+}
+
+int compare_entries(const void* left,const void* right)
+{
+    const cache_entry* a = left;
+    const cache_entry* b = right;
+    if (a->time < b->time)
+        return -1;
+    return a->time > b->time;
+}
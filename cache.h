@@ -0,0 +1,23 @@
+/* cache.h */
+#ifndef CACHE_H
+#define CACHE_H
+
+/* cache_key - a 128-bit hash that identifies a compiler invocation; the
+   two halves are computed by different hash functions over the same bytes */
+typedef struct {
+    unsigned long long hash[2];
+} cache_key;
+
+void init_cache_key(cache_key*);
+void hash_cache_key(cache_key*,const char* bytes,int n);
+int hash_cache_key_file(cache_key*,const char* fileName); /* hash file contents; returns 0 on success */
+
+/* artifact cache management; the cache lives in the 'cache' subdirectory
+   of the settings directory */
+int cache_restore(const cache_key*,const char* output); /* returns 0 if the output was restored from the cache */
+void cache_store(const cache_key*,const char* output);
+void close_cache(); /* flush counters and evict least recently used entries if the cache is too large */
+void print_cache_stats();
+int set_cache_max_size(const char* size); /* returns 0 on success */
+
+#endif
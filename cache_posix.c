@@ -0,0 +1,127 @@
+/* cache_posix.c */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#ifdef __linux__
+#include <linux/fs.h> /* FICLONE */
+#endif
+
+int make_cache_directory(const char* dirName)
+{
+    struct stat st;
+    if (mkdir(dirName,S_IRWXU) == 0)
+        return 0;
+    if (errno==EEXIST && stat(dirName,&st)==0 && S_ISDIR(st.st_mode))
+        return 0;
+    return -1;
+}
+
+int copy_cache_file(const char* src,const char* dest,long long* psize)
+{
+    /* copy into a temporary file next to 'dest' and rename it into place so
+       that a concurrent reader never sees a partial file; the copy shares
+       blocks with the source (reflink) if the file system supports it */
+    int infd, outfd;
+    int result;
+    struct stat st;
+    stringbuf temp;
+    infd = open(src,O_RDONLY);
+    if (infd == -1)
+        return -1;
+    if (fstat(infd,&st)==-1 || !S_ISREG(st.st_mode)) {
+        close(infd);
+        return -1;
+    }
+    init_stringbuf(&temp);
+    assign_stringbuf(&temp,dest);
+    concat_stringbuf(&temp,".compile-tmp");
+    outfd = open(temp.buffer,O_CREAT|O_WRONLY|O_TRUNC,st.st_mode & 0777);
+    result = -1;
+    if (outfd != -1) {
+#ifdef FICLONE
+        if (ioctl(outfd,FICLONE,infd) == 0)
+            result = 0;
+        else
+#endif
+        {
+            ssize_t n;
+            char ibuf[65536];
+            while ((n = read(infd,ibuf,sizeof(ibuf))) > 0)
+                if (write(outfd,ibuf,n) != n)
+                    break;
+            if (n == 0)
+                result = 0;
+        }
+        if (close(outfd)==-1 || (result==0 && rename(temp.buffer,dest)==-1))
+            result = -1;
+        if (result == -1)
+            unlink(temp.buffer);
+    }
+    close(infd);
+    destroy_stringbuf(&temp);
+    *psize = st.st_size;
+    return result;
+}
+
+void touch_cache_file(const char* fileName)
+{
+    utimensat(AT_FDCWD,fileName,NULL,0);
+}
+
+int rename_cache_file(const char* src,const char* dest)
+{
+    return rename(src,dest);
+}
+
+int list_cache_entries(const char* dirName,cache_entry** pentries)
+{
+    int top;
+    int alloc;
+    DIR* pdir;
+    DIR* psubdir;
+    struct stat st;
+    struct dirent* ent;
+    struct dirent* subent;
+    stringbuf path;
+    top = 0;
+    alloc = 64;
+    *pentries = malloc(alloc*sizeof(cache_entry));
+    pdir = opendir(dirName);
+    if (pdir == NULL)
+        return 0;
+    init_stringbuf(&path);
+    while ((ent = readdir(pdir)) != NULL) {
+        /* entry subdirectories are named by two hex digits */
+        if (strlen(ent->d_name)!=2 || !isxdigit(ent->d_name[0]) || !isxdigit(ent->d_name[1]))
+            continue;
+        assign_stringbuf(&path,dirName);
+        concat_stringbuf(&path,"/");
+        concat_stringbuf(&path,ent->d_name);
+        psubdir = opendir(path.buffer);
+        if (psubdir == NULL)
+            continue;
+        while ((subent = readdir(psubdir)) != NULL) {
+            cache_entry* entry;
+            if (strlen(subent->d_name) != 30)
+                continue;
+            if (fstatat(dirfd(psubdir),subent->d_name,&st,0)==-1 || !S_ISREG(st.st_mode))
+                continue;
+            if (top >= alloc) {
+                alloc *= 2;
+                *pentries = realloc(*pentries,alloc*sizeof(cache_entry));
+            }
+            entry = *pentries+top++;
+            sprintf(entry->name,"%s/%s",ent->d_name,subent->d_name);
+            entry->size = st.st_size;
+            entry->time = st.st_mtime;
+        }
+        closedir(psubdir);
+    }
+    closedir(pdir);
+    destroy_stringbuf(&path);
+    return top;
+}
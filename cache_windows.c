@@ -0,0 +1,102 @@
+/* cache_windows.c */
+#include <Windows.h>
+
+int make_cache_directory(const char* dirName)
+{
+	DWORD dwAttr;
+	if ( CreateDirectory(dirName,NULL) )
+		return 0;
+	dwAttr = GetFileAttributes(dirName);
+	if (dwAttr!=INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_DIRECTORY))
+		return 0;
+	return -1;
+}
+
+int copy_cache_file(const char* src,const char* dest,long long* psize)
+{
+	/* copy into a temporary file next to 'dest' and move it into place so
+	   that a concurrent reader never sees a partial file */
+	int result;
+	stringbuf temp;
+	WIN32_FILE_ATTRIBUTE_DATA attribs;
+	if ( !GetFileAttributesEx(src,GetFileExInfoStandard,&attribs) )
+		return -1;
+	init_stringbuf(&temp);
+	assign_stringbuf(&temp,dest);
+	concat_stringbuf(&temp,".compile-tmp");
+	result = -1;
+	if ( CopyFile(src,temp.buffer,FALSE) ) {
+		if ( MoveFileEx(temp.buffer,dest,MOVEFILE_REPLACE_EXISTING) )
+			result = 0;
+		else
+			DeleteFile(temp.buffer);
+	}
+	destroy_stringbuf(&temp);
+	*psize = ((long long)attribs.nFileSizeHigh << 32) | attribs.nFileSizeLow;
+	return result;
+}
+
+void touch_cache_file(const char* fileName)
+{
+	HANDLE hFile;
+	FILETIME now;
+	hFile = CreateFile(fileName,FILE_WRITE_ATTRIBUTES,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+	if (hFile != INVALID_HANDLE_VALUE) {
+		GetSystemTimeAsFileTime(&now);
+		SetFileTime(hFile,NULL,NULL,&now);
+		CloseHandle(hFile);
+	}
+}
+
+int rename_cache_file(const char* src,const char* dest)
+{
+	return MoveFileEx(src,dest,MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+}
+
+int list_cache_entries(const char* dirName,cache_entry** pentries)
+{
+	int top;
+	int alloc;
+	HANDLE hFind;
+	HANDLE hSubFind;
+	WIN32_FIND_DATA findData;
+	WIN32_FIND_DATA subData;
+	stringbuf pattern;
+	top = 0;
+	alloc = 64;
+	*pentries = malloc(alloc*sizeof(cache_entry));
+	init_stringbuf(&pattern);
+	assign_stringbuf(&pattern,dirName);
+	concat_stringbuf(&pattern,"\\??");
+	hFind = FindFirstFile(pattern.buffer,&findData);
+	if (hFind != INVALID_HANDLE_VALUE) {
+		do {
+			if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !isxdigit(findData.cFileName[0]))
+				continue;
+			assign_stringbuf(&pattern,dirName);
+			concat_stringbuf(&pattern,"\\");
+			concat_stringbuf(&pattern,findData.cFileName);
+			concat_stringbuf(&pattern,"\\*");
+			hSubFind = FindFirstFile(pattern.buffer,&subData);
+			if (hSubFind == INVALID_HANDLE_VALUE)
+				continue;
+			do {
+				cache_entry* entry;
+				if ((subData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || strlen(subData.cFileName)!=30)
+					continue;
+				if (top >= alloc) {
+					alloc *= 2;
+					*pentries = realloc(*pentries,alloc*sizeof(cache_entry));
+				}
+				entry = *pentries+top++;
+				sprintf(entry->name,"%s\\%s",findData.cFileName,subData.cFileName);
+				entry->size = ((long long)subData.nFileSizeHigh << 32) | subData.nFileSizeLow;
+				entry->time = ((long long)subData.ftLastWriteTime.dwHighDateTime << 32) | subData.ftLastWriteTime.dwLowDateTime;
+			} while (FindNextFile(hSubFind,&subData) != 0);
+			FindClose(hSubFind);
+		} while (FindNextFile(hFind,&findData) != 0);
+		FindClose(hFind);
+	}
+	destroy_stringbuf(&pattern);
+	return top;
+}
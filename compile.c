@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <string.h>
 #include "compiler.h" /* gets settings.h */
+#include "cache.h"
+#include "history.h"
+#include "watch.h"
+#include "server.h"
+#include "worker.h"
+#include "batch.h"
+#include "stats.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -11,26 +18,74 @@
 #define PACKAGE_STRING "compile (build unknown)"
 #endif
 
+#define STATS_OUTPUT_NONE 0
+#define STATS_OUTPUT_TEXT 1
+#define STATS_OUTPUT_JSON 2
+#define HISTORY_REPORT_COUNT 20 /* targets listed by --history by default */
+
 /* globals */
 const char* PROGRAM_NAME;
 
 static void option_help();
 static void option_version();
+static int option_jobs(const char* value);
+static int use_server(int argc,const char* argv[]); /* returns non-zero if the command may be sent to a server */
+static int run_command(int argc,const char* argv[]);
+static int run_batch_command(int argc,const char* argv[]);
+static int run_worker_command(int argc,const char* argv[]);
 
 int main(int argc,const char* argv[])
 {
-    int i;
-    int ret = 0;
-    int acnt; /* number of args passed to the compiler */
-    int fproceed; /* if non-zero then proceed with invokation */
-    char const** compilerArgs; /* arguments passed to the compiler */
+    int ret;
     PROGRAM_NAME = argv[0];
+    begin_phase(STATS_TOTAL);
+
+    /* A job offered to workers runs in a helper process that only needs the
+     * settings directory (see run_remote_job()).
+     */
+    if (argc>=2 && strcmp(argv[1],REMOTE_JOB_OPTION)==0) {
+        find_settings_directory();
+        return run_remote_job(argc,argv);
+    }
+
+    /* Send the command to a running server if there is one; the server has
+     * already loaded the settings.
+     */
+    if (use_server(argc,argv) && run_client(argc,argv,&ret) == 0)
+        return ret;
 
     /* Read and process settings file at startup. Do this before proceeding so
      * that we can create the default targets file on startup.
      */
+    begin_phase(STATS_SETTINGS);
     load_settings_from_file();
+    end_phase(STATS_SETTINGS);
 
+    if (argc==2 && strcmp(argv[1],"--server")==0)
+        ret = run_server(&run_command);
+    else if (argc>=2 && (strcmp(argv[1],"--worker")==0 || strncmp(argv[1],"--worker=",9)==0))
+        ret = run_worker_command(argc,argv);
+    else
+        ret = run_command(argc,argv);
+    unload_settings();
+    return ret;
+}
+
+int run_command(int argc,const char* argv[])
+{
+    /* process a command-line once the settings are loaded; this is also
+       called by the server for each request */
+    int i;
+    int ret = 0;
+    int acnt; /* number of args passed to the compiler */
+    int fproceed; /* if non-zero then proceed with invokation */
+    int jobs; /* number of concurrent jobs; zero if not running in job mode */
+    int flags; /* session flags */
+    int sync; /* SESSION_SYNC_* flag of --output-sync; -1 if not given */
+    int allocstats; /* if non-zero then report heap allocation counters on exit */
+    int stats; /* STATS_OUTPUT_* format of --stats report */
+    int watch; /* if non-zero then compile again whenever the targets change */
+    char const** compilerArgs; /* arguments passed to the compiler */
     if (--argc == 0) {
         fprintf(stderr,"%s: no input targets\n",PROGRAM_NAME);
         return 1;
@@ -42,6 +97,12 @@ int main(int argc,const char* argv[])
     */
     acnt = 0;
     fproceed = 1;
+    jobs = 0;
+    flags = 0;
+    sync = -1;
+    allocstats = 0;
+    stats = STATS_OUTPUT_NONE;
+    watch = 0;
     compilerArgs = malloc(sizeof(char*)*argc);
     for (i = 1;i<=argc;i++) {
         if (argv[i][0] == '-') {
@@ -57,14 +118,90 @@ int main(int argc,const char* argv[])
             else if (cnt == 2) {
                 /* these args refer to options to this program */
                 const char* option = argv[i]+2;
-                fproceed = 0;
-                if (strcmp(option,"help") == 0)
-                    option_help();
-                else if (strcmp(option,"version") == 0)
-                    option_version();
+                if (strcmp(option,"batch") == 0 || strncmp(option,"batch=",6) == 0) {
+                    /* the rest of the command-line applies to each record */
+                    free((void*)compilerArgs);
+                    return run_batch_command(argc+1,argv);
+                }
+                else if (strcmp(option,"jobs") == 0) {
+                    if (i == argc) {
+                        fprintf(stderr,"%s: option '--jobs' requires an argument\n",argv[0]);
+                        fproceed = 0;
+                        ret = 1;
+                    }
+                    else if ((jobs = option_jobs(argv[++i])) == 0) {
+                        fproceed = 0;
+                        ret = 1;
+                    }
+                }
+                else if (strncmp(option,"jobs=",5) == 0) {
+                    if ((jobs = option_jobs(option+5)) == 0) {
+                        fproceed = 0;
+                        ret = 1;
+                    }
+                }
+                else if (strcmp(option,"keep-going") == 0)
+                    flags |= SESSION_KEEP_GOING;
+                else if (strcmp(option,"incremental") == 0)
+                    flags |= SESSION_INCREMENTAL;
+                else if (strcmp(option,"cache") == 0)
+                    flags |= SESSION_CACHE;
+                else if (strcmp(option,"tee") == 0)
+                    flags |= SESSION_TEE;
+                else if (strcmp(option,"remote") == 0)
+                    flags |= SESSION_REMOTE;
+                else if (strcmp(option,"output-sync") == 0 || strcmp(option,"output-sync=job") == 0)
+                    sync = SESSION_SYNC_OUTPUT;
+                else if (strcmp(option,"output-sync=line") == 0)
+                    sync = SESSION_SYNC_LINES;
+                else if (strcmp(option,"output-sync=none") == 0)
+                    sync = 0;
+                else if (strcmp(option,"watch") == 0)
+                    watch = 1;
+                else if (strcmp(option,"alloc-stats") == 0)
+                    allocstats = 1;
+                else if (strcmp(option,"stats") == 0 || strcmp(option,"stats=text") == 0)
+                    stats = STATS_OUTPUT_TEXT;
+                else if (strcmp(option,"stats=json") == 0)
+                    stats = STATS_OUTPUT_JSON;
+                else if (strcmp(option,"no-server") == 0)
+                    ;
                 else {
-                    fprintf(stderr,"%s: unknown option '%s'\n",argv[0],option);
-                    ret = 1;
+                    fproceed = 0;
+                    if (strcmp(option,"help") == 0)
+                        option_help();
+                    else if (strcmp(option,"version") == 0)
+                        option_version();
+                    else if (strcmp(option,"server") == 0) {
+                        fprintf(stderr,"%s: option '--server' must be given on its own\n",argv[0]);
+                        ret = 1;
+                    }
+                    else if (strcmp(option,"worker") == 0 || strncmp(option,"worker=",7) == 0) {
+                        fprintf(stderr,"%s: option '--worker' must be the first option\n",argv[0]);
+                        ret = 1;
+                    }
+                    else if (strcmp(option,"cache-stats") == 0)
+                        print_cache_stats();
+                    else if (strncmp(option,"cache-size=",11) == 0) {
+                        if (set_cache_max_size(option+11) != 0)
+                            ret = 1;
+                    }
+                    else if (strcmp(option,"history") == 0)
+                        print_history(HISTORY_REPORT_COUNT);
+                    else if (strncmp(option,"history=",8) == 0) {
+                        char* end;
+                        long n = strtol(option+8,&end,10);
+                        if (option[8]==0 || *end!=0 || n<=0) {
+                            fprintf(stderr,"%s: invalid history count '%s'\n",argv[0],option+8);
+                            ret = 1;
+                        }
+                        else
+                            print_history((int)n);
+                    }
+                    else {
+                        fprintf(stderr,"%s: unknown option '%s'\n",argv[0],option);
+                        ret = 1;
+                    }
                 }
             }
         }
@@ -74,19 +211,141 @@ int main(int argc,const char* argv[])
     if (fproceed) {
         session ses;
         init_session(&ses,acnt);
+        ses.jobs = jobs;
+        ses.flags = flags;
         load_session(&ses,acnt,compilerArgs);
-        ret = compile_session(&ses);
+        /* the output of concurrent jobs is synchronized unless asked otherwise */
+        if (sync == -1)
+            sync = jobs>1 || (jobs==0 && ses.groups_c>1) ? SESSION_SYNC_OUTPUT : 0;
+        ses.flags |= sync;
+        ret = watch ? watch_session(&ses) : compile_session(&ses);
         destroy_session(&ses);
     }
-    unload_settings();
+    close_cache();
+    close_history();
     free((void*)compilerArgs);
+    if (stats != STATS_OUTPUT_NONE) {
+        end_phase(STATS_TOTAL);
+        print_stats(stats == STATS_OUTPUT_JSON);
+    }
+    if (allocstats) {
+        long allocs, frees;
+        get_heap_counters(&allocs,&frees);
+        fprintf(stderr,"%s: heap allocations: %ld, frees: %ld\n",PROGRAM_NAME,allocs,frees);
+    }
     return ret;
 }
 
+int run_batch_command(int argc,const char* argv[])
+{
+    /* the other arguments are given to every record, except that --jobs
+       sets the number of records that run at once; records that run at once
+       synchronize their output unless asked otherwise */
+    int i;
+    int ret;
+    int limit;
+    int sync;
+    int keepGoing;
+    int prefix_c;
+    const char* fileName;
+    const char** prefix;
+    fileName = "-";
+    limit = 1;
+    sync = 0;
+    keepGoing = 0;
+    prefix = malloc(sizeof(char*)*(argc+1));
+    prefix[0] = argv[0];
+    prefix_c = 1;
+    for (i = 1;i < argc;++i) {
+        if (strcmp(argv[i],"--batch") == 0) {
+            /* the batch file is optional; standard input is read by default */
+            if (i+1<argc && (strcmp(argv[i+1],"-")==0 || argv[i+1][0]!='-'))
+                fileName = argv[++i];
+        }
+        else if (strncmp(argv[i],"--batch=",8) == 0)
+            fileName = argv[i]+8;
+        else if (strcmp(argv[i],"--jobs") == 0 || strncmp(argv[i],"--jobs=",7) == 0) {
+            const char* value = argv[i][6] == '=' ? argv[i]+7 : (i+1<argc ? argv[++i] : "");
+            if ((limit = option_jobs(value)) == 0) {
+                free((void*)prefix);
+                return 1;
+            }
+        }
+        else if (argv[i][0] != '-') {
+            fprintf(stderr,"%s: targets cannot be given with '--batch'; put them in the batch records\n",PROGRAM_NAME);
+            free((void*)prefix);
+            return 1;
+        }
+        else {
+            if (strcmp(argv[i],"--keep-going") == 0)
+                keepGoing = 1;
+            else if (strncmp(argv[i],"--output-sync",13) == 0)
+                sync = 1;
+            prefix[prefix_c++] = argv[i];
+        }
+    }
+    if (limit>1 && !sync)
+        prefix[prefix_c++] = "--output-sync";
+    ret = run_batch(fileName,limit,keepGoing,prefix_c,prefix,&run_command);
+    free((void*)prefix);
+    return ret;
+}
+
+int run_worker_command(int argc,const char* argv[])
+{
+    /* --worker may only be followed by --jobs, which sets the number of
+       jobs that the worker takes at once (default: one per processor) */
+    int i;
+    int slots;
+    const char* address;
+    address = argv[1][8]=='=' && argv[1][9]!=0 ? argv[1]+9 : NULL;
+    slots = 0;
+    for (i = 2;i < argc;++i) {
+        if (strcmp(argv[i],"--jobs")==0 && i+1<argc)
+            slots = option_jobs(argv[++i]);
+        else if (strncmp(argv[i],"--jobs=",7) == 0)
+            slots = option_jobs(argv[i]+7);
+        else {
+            fprintf(stderr,"%s: option '--worker' cannot be used with '%s'\n",PROGRAM_NAME,argv[i]);
+            return 1;
+        }
+        if (slots == 0)
+            return 1;
+    }
+    return run_worker(address,slots);
+}
+
 void option_help()
 {
-    printf("usage: compile [target files [...]] [--help] [--version] [-compiler-option value ...]\
-[---compiler-long-option ...]\n\
+    printf("usage: compile [target files [...]] [--help] [--version] [--jobs N] [--keep-going]\
+ [--incremental] [--cache] [--tee] [--output-sync[=MODE]] [--remote] [--watch] [--batch [FILE]] [--stats[=json]] [--server] [--no-server] [--worker[=ADDRESS]] [--cache-stats] [--cache-size=SIZE] [--history[=N]] [-compiler-option value ...] [---compiler-long-option ...]\n\
+\n\
+  --jobs N      compile each target as its own job, running at most N at once\n\
+  --keep-going  in job mode, keep starting jobs after a job fails\n\
+  --incremental skip compiling when the output is newer than its dependencies\n\
+  --cache       restore outputs from the artifact cache in ~/.compile/cache\n\
+  --tee         show redirected compiler output while it is written to its file\n\
+  --output-sync[=MODE]  write each job's output as one block when it ends (job,\n\
+                the default with --jobs N), a line at a time (line) or as it\n\
+                is written (none)\n\
+  --remote      send jobs whose rule writes a $depfile to the workers in\n\
+                ~/.compile/workers; a job that no worker can take is\n\
+                compiled locally\n\
+  --watch       compile again whenever a target or its dependencies change\n\
+  --batch [FILE]  run each line of FILE (default: standard input) as a command;\n\
+                with --jobs N, run N of them at once\n\
+  --stats[=json]  report time spent in each phase and compiler resource usage\n\
+  --server      serve commands from other invocations over ~/.compile/server.sock\n\
+  --no-server   run the command in this process even if a server is running\n\
+  --worker[=ADDRESS]  run jobs sent by --remote clients on a socket path or\n\
+                host:port, which needs the secret of ~/.compile/workers\n\
+                (default: ~/.compile/worker.sock); --jobs N sets how many\n\
+                it takes at once\n\
+  --cache-stats print cache hit/miss counters and size\n\
+  --cache-size=SIZE  set the maximum cache size (e.g. 500M, 2G)\n\
+  --history[=N] list the N (default: 20) targets whose latest compile took\n\
+                longest, with their mean time, trend and peak memory\n\
+  --alloc-stats print heap allocation counters on exit\n\
 \n\
 Written by Roger Gee <rpg11a@acu.edu\n");
 }
@@ -95,3 +354,27 @@ void option_version()
 {
     printf("%s\n",PACKAGE_STRING);
 }
+
+int use_server(int argc,const char* argv[])
+{
+    /* a server cannot run a watch since it does not see the client stop */
+    int i;
+    for (i = 1;i < argc;++i)
+        if (strcmp(argv[i],"--server")==0 || strcmp(argv[i],"--no-server")==0 || strcmp(argv[i],"--watch")==0
+            || strncmp(argv[i],"--worker",8)==0)
+            return 0;
+    return argc > 1;
+}
+
+int option_jobs(const char* value)
+{
+    /* parse the job count; returns zero if the value is invalid */
+    char* end;
+    long n;
+    n = strtol(value,&end,10);
+    if (*value == 0 || *end != 0 || n <= 0 || n > 100000) {
+        fprintf(stderr,"%s: invalid job count '%s'\n",PROGRAM_NAME,value);
+        return 0;
+    }
+    return (int)n;
+}
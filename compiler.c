@@ -1,8 +1,14 @@
 /* compiler.c */
 #include "compiler.h"
+#include "cache.h"
+#include "stats.h"
+#include "jobserver.h"
+#include "worker.h"
+#include "history.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 
 #ifdef HAVE_CONFIG_H
@@ -17,18 +23,97 @@
 #define FILE_CHECK_ACCESS_DENIED 2
 #define FILE_CHECK_NOT_REGULAR_FILE 3
 
+#define OUTPUT_TEMP_SUFFIX ".compile-tmp" /* a job's output is written to this file next to it and renamed into place */
+
 #define MAX_EXTENSIONS 5 /* maximum number of extensions to potentially examine */
-#define MAX_ARGUMENT 500 /* maximum number of command line options to compiler process */
+#define PROGRAM_CACHE_LINES 256 /* the program path cache is started over when it has this many entries */
 
 extern const char* PROGRAM_NAME;
 
+/* system-specific types: process_handle refers to a running compiler
+   process; file_time is a file modification time in system units */
+#if defined(BUILD_COMPILE_POSIX)
+#include <sys/types.h>
+typedef pid_t process_handle;
+typedef long long file_time;
+#define MAX_RUNNING_JOBS 1024
+#define PATH_SEPARATOR "/"
+#define PATH_LIST_SEPARATOR ':'
+#define SEARCH_WORKING_DIRECTORY 0 /* programs are only searched for in PATH */
+#define IS_ABSOLUTE_PATH(p) ((p)[0]=='/')
+#elif defined(BUILD_COMPILE_WINDOWS)
+#include <Windows.h>
+typedef HANDLE process_handle;
+typedef long long file_time;
+#define MAX_RUNNING_JOBS MAXIMUM_WAIT_OBJECTS
+#define PATH_SEPARATOR "\\"
+#define PATH_LIST_SEPARATOR ';'
+#define SEARCH_WORKING_DIRECTORY 1 /* SearchPath() looks in the working directory before PATH */
+#define IS_ABSOLUTE_PATH(p) ((p)[0]=='\\' || (p)[0]=='/' || ((p)[0]!=0 && (p)[1]==':'))
+#endif
+
+/* job - a single compiler invocation built from a session */
+typedef struct {
+    stringbuf project; /* value of $project for this job */
+    stringbuf arguments; /* arguments separated by null characters; the first is the program name */
+    stringbuf redirect; /* redirect file name; empty if output is not redirected */
+    stringbuf depfile; /* dependency file recorded for incremental builds ($depfile) */
+    const char* target; /* first target compiled by this job (used in messages) */
+    target_group* group; /* group of the job's targets */
+    int first; /* index of first session target compiled by this job */
+    int count; /* number of session targets compiled by this job */
+    stringview values[OPTION_END]; /* values of the option variables by OPTION_* kind; $targets is expanded from the targets */
+    char jobs[16]; /* text of $jobs */
+} job;
+
+/* scheduled_job - a job's place in the order in which run_jobs() starts jobs */
+typedef struct {
+    int index; /* index of the job */
+    long long expected; /* expected wall time in microseconds; -1 if the job has no history */
+} scheduled_job;
+
 /* functions used in this unit */
 static void fatal_stop(const char* message); /* system-specific implementation */
-static void process_target(const char* source,stringbuf* dest,compiler** pinfo);
+static int process_target(const char* source,stringbuf* dest,compiler** pinfo); /* returns non-zero if source has an extension; 'pinfo' holds the previous target's rule */
+static void group_targets(session* psession,compiler** infos);
+static void report_target(const char* source,const char* dest,int found,int check_flag);
 static int lookup_ext(const char** ext,const char* source); /* system-specific implementation */
 static int check_file(const char* fileName); /* system-specific implementation - returns FILE_CHECK code */
-static void process_option(session* psession,stringbuf* dest,char* option);
-static int invoke_compiler(const char* compilerName,const char* arguments,const char* redirect); /* system specific implementation */
+static void check_files(const char** fileNames,int count,int* results); /* system-specific implementation - check_file() for many files at once */
+static void assign_values(session* psession,job* pjob);
+static int expanded_length(session* psession,job* pjob,const option_template* tmpl);
+static void expand_options(session* psession,job* pjob,stringbuf* dest,const option_template* tmpl,const char* text,int split); /* 'split' lets $targets become separate arguments */
+static void assign_project(stringbuf* dest,const stringbuf* target);
+static void init_job(job* pjob,arena* pool);
+static void destroy_job(job* pjob);
+static void build_job(session* psession,job* pjob,int first,int count); /* build arguments for targets [first,first+count) */
+static int count_jobs(session* psession);
+static void build_session_job(session* psession,job* pjob,int index); /* build the index'th job: a target in job mode, else a group */
+static int run_jobs(session* psession);
+static void schedule_jobs(session* psession,job* jobs,scheduled_job* order,int count);
+static int compare_scheduled(const void* left,const void* right);
+static void history_name(job* pjob,stringbuf* dest); /* full path of the job's first target */
+static void record_job(job* pjob,long long wall_nsec,const child_usage* pusage);
+static void assign_depfile(session* psession,job* pjob); /* leaves 'depfile' empty if the job does not need one */
+static int check_up_to_date(session* psession,job* pjob); /* returns non-zero if the job need not run */
+static void finish_depfile(session* psession,job* pjob,int code);
+static const char* read_dependencies(job* pjob,stringbuf* contents); /* returns NULL if the job has no dependency file */
+static const char* next_dependency(const char* iter,stringbuf* dest); /* returns NULL at end of rule */
+static const char* job_output(job* pjob);
+static int skip_job(session* psession,job* pjob); /* returns non-zero if the job need not run */
+static void finish_job(session* psession,job* pjob,int code);
+static int compute_cache_key(session* psession,job* pjob,cache_key* pkey); /* returns 0 on success */
+static const remote_job* remote_files(session* psession,job* pjob); /* returns NULL if the job runs locally */
+static int uses_depfile(const option_template* options);
+static int resolve_program(const char* program,stringbuf* dest); /* returns 0 if found */
+static int invoke_compiler(const char* program,const resource_class* res,const char* arguments,const remote_job* remote,const char* redirect,int flags,const char* label,child_usage* pusage);
+static int start_compiler(const char* program,const resource_class* res,const char* arguments,const remote_job* remote,const char* redirect,int flags,const char* label,process_handle* phandle); /* system-specific implementation - 'program' is a resolved path; the job is offered to a worker unless 'remote' is NULL; 'flags' are SESSION_* flags; 'label' names the job in synchronized output; returns 0 on success */
+static int wait_compiler(const process_handle* handles,int count,int* pcode,child_usage* pusage); /* system-specific implementation - 'pusage' receives the resources used by the finished process; returns index of finished process or -1 */
+static int get_file_time(const char* fileName,file_time* ptime); /* system-specific implementation - returns 0 on success */
+static void get_working_directory(stringbuf* dest); /* system-specific implementation */
+static int make_directory(const char* dirName); /* system-specific implementation - returns 0 if the directory exists */
+static int find_program(const char* program,stringbuf* dest,file_time* ptime); /* system-specific implementation - returns 0 if found */
+static int get_processor_count(); /* system-specific implementation */
 
 /* platform-dependent code */
 
@@ -43,38 +128,52 @@ static int invoke_compiler(const char* compilerName,const char* arguments,const
 void init_session(session* psession,int size)
 {
     int i;
-    psession->compiler_info = NULL; /* no compiler info by default */
-    init_stringbuf(&psession->project);
-    psession->targets = malloc(size*sizeof(stringbuf));
+    init_arena(&psession->pool);
+    psession->groups = arena_alloc(&psession->pool,size*sizeof(target_group));
+    psession->groups_c = 0;
+    psession->targets = arena_alloc(&psession->pool,size*sizeof(stringbuf));
     for (i = 0;i<size;i++)
-        init_stringbuf(psession->targets+i);
+        init_stringbuf_arena(psession->targets+i,&psession->pool);
     psession->targets_c = 0;
-    psession->options = malloc(size*sizeof(stringbuf));
+    psession->options = arena_alloc(&psession->pool,size*sizeof(stringbuf));
     for (i = 0;i<size;i++)
-        init_stringbuf(psession->options+i);
+        init_stringbuf_arena(psession->options+i,&psession->pool);
     psession->options_c = 0;
+    init_stringbuf_arena(&psession->options_text,&psession->pool);
+    init_stringbuf_arena(&psession->cwd,&psession->pool);
+    compile_options(&psession->options_template,"",0,&psession->pool);
     psession->alloc_size = size;
+    psession->jobs = 0;
+    psession->flags = 0;
 }
 
 void destroy_session(session* psession)
 {
-    int i;
-    psession->compiler_info = NULL;
-    destroy_stringbuf(&psession->project);
-    for (i = 0;i<psession->alloc_size;i++)
-        destroy_stringbuf(psession->targets+i);
+    /* the session's strings and lists are all released with its arena */
+    destroy_arena(&psession->pool);
+    psession->groups = NULL;
+    psession->groups_c = 0;
+    psession->targets = NULL;
     psession->targets_c = 0;
-    free(psession->targets);
-    for (i = 0;i<psession->alloc_size;i++)
-        destroy_stringbuf(psession->options+i);
+    psession->options = NULL;
     psession->options_c = 0;
-    free(psession->options);
     psession->alloc_size = 0;
 }
 
 void load_session(session* psession,int argc,const char** argv)
 {
     int i, ui, ti;
+    int* found; /* whether each target was given with its extension */
+    int* results; /* FILE_CHECK code of each target */
+    const char** sources; /* target as given on the command-line */
+    const char** names; /* target file names to check */
+    compiler** infos; /* rule of each target */
+    found = arena_alloc(&psession->pool,psession->alloc_size*sizeof(int));
+    infos = arena_alloc(&psession->pool,psession->alloc_size*sizeof(compiler*));
+    results = arena_alloc(&psession->pool,psession->alloc_size*sizeof(int));
+    sources = arena_alloc(&psession->pool,psession->alloc_size*sizeof(const char*));
+    names = arena_alloc(&psession->pool,psession->alloc_size*sizeof(const char*));
+    begin_phase(STATS_RESOLVE);
     for (i = 0,ui = 0,ti = 0;i<argc;i++) {
         if (argv[i][0] == '-') {
             assert(ui < psession->alloc_size);
@@ -82,51 +181,69 @@ void load_session(session* psession,int argc,const char** argv)
         }
         else {
             assert(ti < psession->alloc_size);
-            process_target(argv[i],psession->targets+ti,&psession->compiler_info);
-            /* check to see if session needs a project name */
-            if (psession->project.used == 0) {
-                /* find n characters leading up to extension */
-                int n = 0;
-                stringbuf* targ = psession->targets+ti;
-                while (n<targ->used && targ->buffer[n]!='.')
-                    ++n;
-                /* assign project name (first target minus extension) */
-                assign_stringbuf_ex(&psession->project,targ->buffer,n);
-            }
+            infos[ti] = ti > 0 ? infos[ti-1] : NULL;
+            found[ti] = process_target(argv[i],psession->targets+ti,infos+ti);
+            sources[ti] = argv[i];
+            names[ti] = psession->targets[ti].buffer;
             ++ti;
         }
     }
     psession->targets_c = ti;
     psession->options_c = ui;
+    /* the user's options are compiled once like a rule's */
+    for (i = 0;i < ui;++i)
+        append_stringbuf(&psession->options_text,psession->options[i].buffer,psession->options[i].used+1);
+    compile_options(&psession->options_template,psession->options_text.buffer,ui,&psession->pool);
+    /* check to make sure the targets exist; the checks are submitted
+       together so that their latencies overlap */
+    check_files(names,ti,results);
+    for (i = 0;i < ti;++i) {
+        if (results[i] != FILE_CHECK_SUCCESS) {
+            report_target(sources[i],names[i],found[i],results[i]);
+            fatal_stop("bad target");
+        }
+    }
+    group_targets(psession,infos);
+    end_phase(STATS_RESOLVE);
 }
 
 int compile_session(session* psession)
 {
     int i;
-    stringbuf redirfile;
-    stringbuf arguments;
-    init_stringbuf(&arguments);
-    init_stringbuf(&redirfile);
-    assign_stringbuf(&arguments,psession->compiler_info->program.buffer);
-    append_terminator_stringbuf(&arguments);
-    for (i = 0;i < psession->targets_c;++i) {
-        concat_stringbuf(&arguments,psession->targets[i].buffer);
-        append_terminator_stringbuf(&arguments);
-    }
-    i = 0;
-    while ( psession->compiler_info->options.buffer[i] ) {
-        process_option(psession,&arguments,psession->compiler_info->options.buffer+i);
-        while ( psession->compiler_info->options.buffer[i] )
-            ++i;
-        ++i;
+    long long start;
+    job single;
+    child_usage usage;
+    target_group* group;
+    /* each program is found once for all jobs so that a missing compiler is
+       reported here rather than as the failure of each job */
+    for (i = 0;i < psession->groups_c;++i) {
+        int code;
+        group = psession->groups+i;
+        begin_phase(STATS_SPAWN);
+        code = resolve_program(group->compiler_info->program.buffer,&group->program);
+        end_phase(STATS_SPAWN);
+        if (code != 0) {
+            fprintf(stderr,"%s: error: compiler '%s' not found\n",PROGRAM_NAME,group->compiler_info->program.buffer);
+            fatal_stop("compiler not found");
+        }
     }
-    for (i = 0;i < psession->options_c;++i)
-        process_option(psession,&arguments,(psession->options+i)->buffer);
-    if (psession->compiler_info->redirect.used > 0) {
-        process_option(psession,&redirfile,psession->compiler_info->redirect.buffer);
+    /* the groups of different rules are compiled by concurrent jobs */
+    if (psession->jobs>0 || psession->groups_c>1)
+        return run_jobs(psession);
+    /* compile all targets with a single compiler process */
+    init_job(&single,&psession->pool);
+    build_session_job(psession,&single,0);
+    if ( skip_job(psession,&single) ) {
+        destroy_job(&single);
+        return 0;
     }
-    i = invoke_compiler(psession->compiler_info->program.buffer,arguments.buffer,
-            redirfile.used == 0 ? NULL : redirfile.buffer);
+    group = single.group;
+    start = get_monotonic_time();
+    i = invoke_compiler(group->program.buffer,&group->compiler_info->resources,single.arguments.buffer,remote_files(psession,&single),
+            single.redirect.used == 0 ? NULL : single.redirect.buffer,psession->flags,single.target,&usage);
+    finish_job(psession,&single,i);
+    if (i == 0)
+        record_job(&single,get_monotonic_time()-start,&usage);
     if (i == -1) {
         fprintf(stderr,"%s: error: could not properly start compiler process\n",PROGRAM_NAME);
         fatal_stop("compile failure");
@@ -135,21 +252,71 @@ int compile_session(session* psession)
         fprintf(stderr,"%s: compiler process returned code %d\n",PROGRAM_NAME,i);
         fprintf(stderr,"%s: error: compilation failed\n",PROGRAM_NAME);
     }
-    destroy_stringbuf(&redirfile);
-    destroy_stringbuf(&arguments);
+    destroy_job(&single);
     /* return exit code (assume 0 for success) */
     return i;
 }
 
+void list_dependencies(session* psession,stringbuf* dest)
+{
+    /* the jobs are built the same way that compile_session() builds them
+       so that they find the same dependency files */
+    int i;
+    int count;
+    job dj;
+    arena pool;
+    stringbuf contents;
+    stringbuf name;
+    const char* iter;
+    init_arena(&pool);
+    init_stringbuf_arena(&contents,&pool);
+    init_stringbuf_arena(&name,&pool);
+    count = count_jobs(psession);
+    for (i = 0;i < count;++i) {
+        init_job(&dj,&pool);
+        build_session_job(psession,&dj,i);
+        reset_stringbuf(&contents);
+        iter = read_dependencies(&dj,&contents);
+        while (iter != NULL && (iter = next_dependency(iter,&name)) != NULL) {
+            append_stringbuf(dest,name.buffer,name.used+1);
+        }
+        destroy_job(&dj);
+    }
+    destroy_arena(&pool);
+}
+
+void remove_partial_outputs(session* psession)
+{
+    /* redirect files and outputs restored from the cache are renamed into
+       place once complete, so a build that was stopped may have left their
+       temporary files */
+    int i;
+    int count;
+    job dj;
+    arena pool;
+    stringbuf temp;
+    init_arena(&pool);
+    init_stringbuf_arena(&temp,&pool);
+    count = count_jobs(psession);
+    for (i = 0;i < count;++i) {
+        init_job(&dj,&pool);
+        build_session_job(psession,&dj,i);
+        assign_stringbuf(&temp,job_output(&dj));
+        concat_stringbuf(&temp,OUTPUT_TEMP_SUFFIX);
+        remove(temp.buffer);
+        destroy_job(&dj);
+    }
+    destroy_arena(&pool);
+}
+
 /* definitions of internal functions in this unit */
 
-void process_target(const char* source,stringbuf* dest,compiler** pinfo)
+int process_target(const char* source,stringbuf* dest,compiler** pinfo)
 {
     /* assume the source is a target file; attempt to determine compiler */
     int i;
     int len;
     short found;
-    int check_flag;
     const char* extensions[MAX_EXTENSIONS];
     const char** pext = extensions; /* point to first extension string */
     /* if the source has a final .ext, get a pointer to it;
@@ -166,6 +333,9 @@ void process_target(const char* source,stringbuf* dest,compiler** pinfo)
         *pext = NULL;
     else
         found = 1;
+    if (*pext!=NULL && (*pinfo==NULL || strcmp((*pinfo)->extension.buffer,*pext)!=0))
+        /* the target's own extension selects its rule */
+        *pinfo = NULL;
     if (*pinfo == NULL) {
         /* compiler info has not yet been determined; use
            the file extension of the source to lookup compiler
@@ -196,77 +366,825 @@ void process_target(const char* source,stringbuf* dest,compiler** pinfo)
     }
     /* copy source name to destination buffer; include extension if need be */
     if (!found) { /* extension wasn't found initially; append looked-up extension to source file name */
-        /* assume all input files use the same extension */
+        /* assume the target has the extension of the previous target */
         assign_stringbuf(dest,source);
-        concat_stringbuf(dest,(*pinfo)->extension.buffer);
+        append_view_stringbuf(dest,view_stringbuf(&(*pinfo)->extension));
     }
-    else {
-        /* check to see if extension is correct */
-        if (strcmp((*pinfo)->extension.buffer,*pext) != 0) {
-            fprintf(stderr,"%s: error: target '%s' does not have '%s' extension\n",PROGRAM_NAME,source,(*pinfo)->extension.buffer);
-            fatal_stop("bad target");
-        }
+    else
         /* simply assign filename to destination */
         assign_stringbuf(dest,source);
+    return found;
+}
+
+void group_targets(session* psession,compiler** infos)
+{
+    /* the targets are reordered so that each group's targets are adjacent;
+       the targets of a group keep their command-line order */
+    int i, g;
+    int* groupof; /* group of each target */
+    int* next; /* next position in each group */
+    stringbuf* grouped;
+    target_group* group;
+    groupof = arena_alloc(&psession->pool,psession->targets_c*sizeof(int));
+    psession->groups_c = 0;
+    for (i = 0;i < psession->targets_c;++i) {
+        for (g = 0;g < psession->groups_c;++g)
+            if (psession->groups[g].compiler_info == infos[i])
+                break;
+        group = psession->groups+g;
+        if (g == psession->groups_c) {
+            group->compiler_info = infos[i];
+            init_stringbuf_arena(&group->program,&psession->pool);
+            init_stringbuf_arena(&group->project,&psession->pool);
+            assign_project(&group->project,psession->targets+i);
+            group->count = 0;
+            ++psession->groups_c;
+        }
+        ++group->count;
+        groupof[i] = g;
+    }
+    if (psession->groups_c == 1) {
+        psession->groups[0].first = 0;
+        return;
+    }
+    next = arena_alloc(&psession->pool,psession->groups_c*sizeof(int));
+    for (g = 0,i = 0;g < psession->groups_c;++g) {
+        psession->groups[g].first = next[g] = i;
+        i += psession->groups[g].count;
+    }
+    /* targets are moved rather than copied since short ones are stored in
+       their stringbuf */
+    grouped = arena_alloc(&psession->pool,psession->targets_c*sizeof(stringbuf));
+    for (i = 0;i < psession->targets_c;++i)
+        move_stringbuf(grouped+next[groupof[i]]++,psession->targets+i);
+    for (i = 0;i < psession->targets_c;++i)
+        move_stringbuf(psession->targets+i,grouped+i);
+}
+
+void report_target(const char* source,const char* dest,int found,int check_flag)
+{
+    if (check_flag == FILE_CHECK_DOES_NOT_EXIST) {
+        if (found)
+            fprintf(stderr,"%s: error: target '%s' does not exist\n",PROGRAM_NAME,source);
+        else
+            fprintf(stderr,"%s: error: target '%s' mapped to '%s' which does not exist\n",PROGRAM_NAME,source,dest);
+    }
+    else if (check_flag == FILE_CHECK_ACCESS_DENIED)
+        fprintf(stderr,"%s: error: permission denied: cannot access target '%s'\n",PROGRAM_NAME,source);
+    else if (check_flag == FILE_CHECK_NOT_REGULAR_FILE)
+        fprintf(stderr,"%s: error: target '%s' is not a regular file\n",PROGRAM_NAME,source);
+}
+
+void assign_values(session* psession,job* pjob)
+{
+    /* $dir and $stem are parts of the first target; $dir is '.' for a
+       target in the working directory */
+    int n;
+    int dir, ext;
+    static char ncpu[16];
+    const char* target;
+    target = pjob->target;
+    n = strlen(target);
+    for (dir = n;dir>0 && target[dir-1]!='/' && target[dir-1]!=PATH_SEPARATOR[0];--dir)
+        ;
+    for (ext = n;ext>dir && target[ext]!='.';--ext)
+        ;
+    if (ext == dir)
+        ext = n;
+    if (ncpu[0] == 0)
+        sprintf(ncpu,"%d",get_processor_count());
+    sprintf(pjob->jobs,"%d",psession->jobs > 0 ? psession->jobs : 1);
+    pjob->values[OPTION_LITERAL] = make_stringview("");
+    pjob->values[OPTION_PROJECT] = view_stringbuf(&pjob->project);
+    pjob->values[OPTION_DEPFILE] = view_stringbuf(&pjob->depfile);
+    pjob->values[OPTION_TARGET].data = target;
+    pjob->values[OPTION_TARGET].length = n;
+    pjob->values[OPTION_TARGETS] = make_stringview("");
+    if (dir == 0)
+        pjob->values[OPTION_DIR] = make_stringview(".");
+    else {
+        pjob->values[OPTION_DIR].data = target;
+        pjob->values[OPTION_DIR].length = dir > 1 ? dir-1 : 1;
+    }
+    pjob->values[OPTION_STEM].data = target+dir;
+    pjob->values[OPTION_STEM].length = ext-dir;
+    pjob->values[OPTION_JOBS] = make_stringview(pjob->jobs);
+    pjob->values[OPTION_NCPU] = make_stringview(ncpu);
+}
+
+int expanded_length(session* psession,job* pjob,const option_template* tmpl)
+{
+    int i, k;
+    int n;
+    n = tmpl->size;
+    for (i = 0;i < tmpl->count;++i) {
+        if (tmpl->tokens[i].kind == OPTION_TARGETS)
+            for (k = pjob->first;k < pjob->first+pjob->count;++k)
+                n += psession->targets[k].used + 1;
+        else
+            n += pjob->values[tmpl->tokens[i].kind].length;
+    }
+    return n;
+}
+
+void expand_options(session* psession,job* pjob,stringbuf* dest,const option_template* tmpl,const char* text,int split)
+{
+    /* $targets names each target as a separate argument if it makes up a
+       whole option and otherwise joins the targets with spaces */
+    int i, k;
+    int whole;
+    const option_token* token;
+    for (i = 0;i < tmpl->count;++i) {
+        token = tmpl->tokens+i;
+        switch (token->kind) {
+        case OPTION_LITERAL:
+            append_stringbuf(dest,text+token->offset,token->length);
+            break;
+        case OPTION_END:
+            append_terminator_stringbuf(dest);
+            break;
+        case OPTION_TARGETS:
+            whole = split && (i==0 || token[-1].kind==OPTION_END) && token[1].kind==OPTION_END;
+            for (k = pjob->first;k < pjob->first+pjob->count;++k) {
+                if (k == pjob->first)
+                    ;
+                else if (whole)
+                    append_terminator_stringbuf(dest);
+                else
+                    append_char_stringbuf(dest,' ');
+                append_stringbuf(dest,psession->targets[k].buffer,psession->targets[k].used);
+            }
+            break;
+        default:
+            append_view_stringbuf(dest,pjob->values[token->kind]);
+            break;
+        }
     }
-    /* check to make sure target exists */
-    check_flag = check_file(dest->buffer);
-    if (check_flag != FILE_CHECK_SUCCESS) {
-        if (check_flag == FILE_CHECK_DOES_NOT_EXIST) {
-            if (found)
-                fprintf(stderr,"%s: error: target '%s' does not exist\n",PROGRAM_NAME,source);
+}
+
+void assign_project(stringbuf* dest,const stringbuf* target)
+{
+    /* find n characters leading up to extension */
+    int n = 0;
+    while (n<target->used && target->buffer[n]!='.')
+        ++n;
+    /* assign project name (target minus extension) */
+    assign_stringbuf_ex(dest,target->buffer,n);
+}
+
+void init_job(job* pjob,arena* pool)
+{
+    init_stringbuf_arena(&pjob->project,pool);
+    init_stringbuf_arena(&pjob->arguments,pool);
+    init_stringbuf_arena(&pjob->redirect,pool);
+    init_stringbuf_arena(&pjob->depfile,pool);
+    pjob->target = NULL;
+    pjob->group = NULL;
+    pjob->first = 0;
+    pjob->count = 0;
+}
+
+void destroy_job(job* pjob)
+{
+    destroy_stringbuf(&pjob->project);
+    destroy_stringbuf(&pjob->arguments);
+    destroy_stringbuf(&pjob->redirect);
+    destroy_stringbuf(&pjob->depfile);
+    pjob->target = NULL;
+}
+
+void build_job(session* psession,job* pjob,int first,int count)
+{
+    int i;
+    int n;
+    compiler* info;
+    begin_phase(STATS_ASSEMBLE);
+    /* the targets of a job are always in one group */
+    for (i = 0;first >= psession->groups[i].first+psession->groups[i].count;++i)
+        ;
+    pjob->group = psession->groups+i;
+    info = pjob->group->compiler_info;
+    pjob->target = psession->targets[first].buffer;
+    pjob->first = first;
+    pjob->count = count;
+    assign_depfile(psession,pjob);
+    assign_values(psession,pjob);
+    /* size the argument block up front from the compiled options; the
+       program name, targets and option spans are copied with their known
+       lengths and null separators */
+    n = info->program.used + 1 + expanded_length(psession,pjob,&info->options_template)
+        + expanded_length(psession,pjob,&psession->options_template);
+    for (i = first;i < first+count;++i)
+        n += psession->targets[i].used + 1;
+    reset_stringbuf(&pjob->arguments);
+    reserve_stringbuf(&pjob->arguments,n);
+    append_stringbuf(&pjob->arguments,info->program.buffer,info->program.used+1);
+    for (i = first;i < first+count;++i)
+        append_stringbuf(&pjob->arguments,psession->targets[i].buffer,psession->targets[i].used+1);
+    expand_options(psession,pjob,&pjob->arguments,&info->options_template,info->options.buffer,1);
+    expand_options(psession,pjob,&pjob->arguments,&psession->options_template,psession->options_text.buffer,1);
+    /* the redirect file name has no terminator of its own */
+    reset_stringbuf(&pjob->redirect);
+    if (info->redirect_template.count > 0) {
+        reserve_stringbuf(&pjob->redirect,expanded_length(psession,pjob,&info->redirect_template));
+        expand_options(psession,pjob,&pjob->redirect,&info->redirect_template,info->redirect.buffer,0);
+        truncate_stringbuf(&pjob->redirect,pjob->redirect.used-1);
+    }
+    end_phase(STATS_ASSEMBLE);
+}
+
+int count_jobs(session* psession)
+{
+    return psession->jobs > 0 ? psession->targets_c : psession->groups_c;
+}
+
+void build_session_job(session* psession,job* pjob,int index)
+{
+    if (psession->jobs > 0) {
+        assign_project(&pjob->project,psession->targets+index);
+        build_job(psession,pjob,index,1);
+    }
+    else {
+        copy_stringbuf(&pjob->project,&psession->groups[index].project);
+        build_job(psession,pjob,psession->groups[index].first,psession->groups[index].count);
+    }
+}
+
+int run_jobs(session* psession)
+{
+    /* run each target (or, without --jobs, each group) as its own job; at
+       most 'limit' jobs run at once and finished jobs are reaped in the
+       order in which they exit */
+    int i;
+    int code;
+    int count;
+    int limit;
+    int next, running, failed;
+    int ret;
+    job* jobs;
+    scheduled_job* order; /* jobs in the order in which they are started */
+    int* slots; /* index of the job running in each slot */
+    long long* started; /* when the job in each slot was started */
+    process_handle* handles; /* handle of the process running in each slot */
+    child_usage usage;
+    count = count_jobs(psession);
+    limit = psession->jobs > 0 ? psession->jobs : count;
+    if (limit > MAX_RUNNING_JOBS)
+        limit = MAX_RUNNING_JOBS;
+    jobs = arena_alloc(&psession->pool,count*sizeof(job));
+    for (i = 0;i < count;++i) {
+        init_job(jobs+i,&psession->pool);
+        build_session_job(psession,jobs+i,i);
+    }
+    order = arena_alloc(&psession->pool,count*sizeof(scheduled_job));
+    schedule_jobs(psession,jobs,order,count);
+    slots = arena_alloc(&psession->pool,limit*sizeof(int));
+    started = arena_alloc(&psession->pool,limit*sizeof(long long));
+    handles = arena_alloc(&psession->pool,limit*sizeof(process_handle));
+    next = running = failed = ret = 0;
+    while (1) {
+        /* start jobs until the limit is reached; after a failure, only keep
+           starting jobs if the user asked us to keep going */
+        while (next<count && running<limit
+            && (failed==0 || (psession->flags & SESSION_KEEP_GOING))) {
+            job* pjob = jobs+order[next].index;
+            /* every running job holds a token when run by 'make -jN'; if
+               none is free, wait for a running job to return its token */
+            if (acquire_job_token() != 0)
+                break;
+            if ( skip_job(psession,pjob) ) {
+                release_job_token();
+                ++next;
+                continue;
+            }
+            begin_phase(STATS_SPAWN);
+            started[running] = get_monotonic_time();
+            i = start_compiler(pjob->group->program.buffer,&pjob->group->compiler_info->resources,pjob->arguments.buffer,
+                remote_files(psession,pjob),pjob->redirect.used == 0 ? NULL : pjob->redirect.buffer,psession->flags,pjob->target,handles+running);
+            end_phase(STATS_SPAWN);
+            if (i == -1) {
+                fprintf(stderr,"%s: error: could not properly start compiler process for '%s'\n",
+                    PROGRAM_NAME,pjob->target);
+                release_job_token();
+                if (ret == 0)
+                    ret = 1;
+                ++failed;
+                ++next;
+                continue;
+            }
+            slots[running++] = order[next++].index;
+        }
+        if (running == 0)
+            break;
+        begin_phase(STATS_WAIT);
+        i = wait_compiler(handles,running,&code,&usage);
+        end_phase(STATS_WAIT);
+        if (i == -1)
+            fatal_stop("could not wait for compiler process");
+        release_job_token();
+        finish_job(psession,jobs+slots[i],code);
+        if (code == 0)
+            record_job(jobs+slots[i],get_monotonic_time()-started[i],&usage);
+        if (code != 0) {
+            if (code == -1)
+                fprintf(stderr,"%s: error: compiler process for '%s' terminated abnormally\n",
+                    PROGRAM_NAME,jobs[slots[i]].target);
             else
-                fprintf(stderr,"%s: error: target '%s' mapped to '%s' which does not exist\n",PROGRAM_NAME,source,dest->buffer);
+                fprintf(stderr,"%s: compiler process for '%s' returned code %d\n",
+                    PROGRAM_NAME,jobs[slots[i]].target,code);
+            if (ret == 0)
+                ret = code == -1 ? 1 : code;
+            ++failed;
         }
-        else if (check_flag == FILE_CHECK_ACCESS_DENIED)
-            fprintf(stderr,"%s: error: permission denied: cannot access target '%s'\n",PROGRAM_NAME,source);
-        fatal_stop("bad target");
+        /* move the last running job into the freed slot */
+        --running;
+        handles[i] = handles[running];
+        slots[i] = slots[running];
+        started[i] = started[running];
+    }
+    if (failed > 0) {
+        fprintf(stderr,"%s: error: compilation failed: %d of %d jobs failed\n",
+            PROGRAM_NAME,failed,count);
+        if (next < count)
+            fprintf(stderr,"%s: note: %d jobs were not started; use --keep-going to run them anyway\n",
+                PROGRAM_NAME,count-next);
     }
+    for (i = 0;i < count;++i)
+        destroy_job(jobs+i);
+    return ret;
 }
 
-void process_option(session* psession,stringbuf* dest,char* option)
+void schedule_jobs(session* psession,job* jobs,scheduled_job* order,int count)
 {
-    /* handle special option syntax */
+    /* when jobs must wait for one another, the jobs that took longest in
+       their recent runs are started first so that a long job started late
+       does not hold up the end of the build; jobs without history are
+       started before the others since they may be long too */
     int i;
-    int j;
-    char* p;
-    i = j = 0;
-    p = NULL;
-    while (option[i] && option[i]!='$')
-        ++i;
-
-    /* Copy portion of option leading up to '$'. */
-    concat_stringbuf_ex(dest,option,i);
-
-    /* Handle case for special option tokens. These tokens can only be
-     * alpha-numeric.
-     */
-    if (option[i] == '$') {
-        p = option+i+1;
-
-        /* Convert to lower case and seek to end of special token. */
-        while (p[j] && isalnum(p[j])) {
-            p[j] = tolower( p[j] );
-            ++j;
+    stringbuf name;
+    init_stringbuf(&name);
+    for (i = 0;i < count;++i) {
+        order[i].index = i;
+        order[i].expected = -1;
+        if (count>1 && psession->jobs!=1) {
+            history_name(jobs+i,&name);
+            order[i].expected = lookup_history(jobs[i].group->compiler_info->program.buffer,name.buffer);
         }
+    }
+    destroy_stringbuf(&name);
+    qsort(order,count,sizeof(scheduled_job),&compare_scheduled);
+}
+
+int compare_scheduled(const void* left,const void* right)
+{
+    /* jobs that are expected to take as long keep the order of their targets */
+    const scheduled_job* a = left;
+    const scheduled_job* b = right;
+    if (a->expected != b->expected) {
+        if (a->expected == -1)
+            return -1;
+        if (b->expected == -1)
+            return 1;
+        return a->expected > b->expected ? -1 : 1;
+    }
+    return a->index - b->index;
+}
+
+void history_name(job* pjob,stringbuf* dest)
+{
+    /* the history of a target is kept under its full path so that it is
+       the same when the target is built from another directory */
+    const char* target = pjob->target;
+    if ( IS_ABSOLUTE_PATH(target) ) {
+        assign_stringbuf(dest,target);
+        return;
+    }
+    while (target[0]=='.' && (target[1]=='/' || target[1]==PATH_SEPARATOR[0]))
+        target += 2;
+    get_working_directory(dest);
+    concat_stringbuf(dest,PATH_SEPARATOR);
+    concat_stringbuf(dest,target);
+}
+
+void record_job(job* pjob,long long wall_nsec,const child_usage* pusage)
+{
+    stringbuf name;
+    init_stringbuf(&name);
+    history_name(pjob,&name);
+    record_history(pjob->group->compiler_info->program.buffer,name.buffer,wall_nsec/1000,pusage->max_rss_kib);
+    destroy_stringbuf(&name);
+}
 
-        /* Replace '$project' with first target name. */
-        if (strncmp(p,"project",j) == 0) {
-            concat_stringbuf(dest,psession->project.buffer);
+int resolve_program(const char* program,stringbuf* dest)
+{
+    /* searching PATH costs a failed lookup in each directory before the one
+       that has the program, so the result is kept in the settings directory
+       keyed by the program, PATH and the modification time of each PATH
+       directory; adding or removing a program changes its directory's time */
+    int lines;
+    int relative;
+    file_time t;
+    cache_key key;
+    FILE* fp;
+    const char* path;
+    const char* end;
+    char prefix[40];
+    char line[FILENAME_MAX+40];
+    stringbuf dir;
+    stringbuf fileName;
+    if (strchr(program,'/')!=NULL || strchr(program,PATH_SEPARATOR[0])!=NULL)
+        return find_program(program,dest,&t);
+    path = getenv("PATH");
+    if (path == NULL)
+        path = "";
+    init_cache_key(&key);
+    hash_cache_key(&key,program,strlen(program)+1);
+    hash_cache_key(&key,path,strlen(path)+1);
+    init_stringbuf(&dir);
+    relative = SEARCH_WORKING_DIRECTORY;
+    while (1) {
+        end = strchr(path,PATH_LIST_SEPARATOR);
+        if (end == NULL)
+            end = path+strlen(path);
+        /* an empty entry is the working directory */
+        if (end == path)
+            assign_stringbuf(&dir,".");
+        else
+            assign_stringbuf_ex(&dir,path,end-path);
+        if (dir.buffer[0] == '.')
+            relative = 1;
+        if (get_file_time(dir.buffer,&t) != 0)
+            t = -1;
+        hash_cache_key(&key,(const char*)&t,sizeof(t));
+        if (*end == 0)
+            break;
+        path = end+1;
+    }
+    if (relative) {
+        get_working_directory(&dir);
+        hash_cache_key(&key,dir.buffer,dir.used+1);
+    }
+    destroy_stringbuf(&dir);
+    sprintf(prefix,"%016llx%016llx ",key.hash[0],key.hash[1]);
+
+    /* the last entry for the key is used since a later entry replaces it */
+    init_stringbuf(&fileName);
+    assign_stringbuf(&fileName,get_settings_directory());
+    concat_stringbuf(&fileName,PATH_SEPARATOR "programs");
+    lines = 0;
+    reset_stringbuf(dest);
+    fp = fopen(fileName.buffer,"r");
+    if (fp != NULL) {
+        while (fgets(line,sizeof(line),fp) != NULL) {
+            ++lines;
+            if (strncmp(line,prefix,33) == 0) {
+                line[strcspn(line,"\r\n")] = 0;
+                assign_stringbuf(dest,line+33);
+            }
         }
-        else {
-            fprintf(stderr,"%s: warning: the special option '%s' is not recognized\n",
-                PROGRAM_NAME,p);
+        fclose(fp);
+    }
+    if (dest->used>0 && get_file_time(dest->buffer,&t)==0) {
+        destroy_stringbuf(&fileName);
+        return 0;
+    }
+    if (find_program(program,dest,&t) != 0) {
+        destroy_stringbuf(&fileName);
+        return -1;
+    }
+    fp = fopen(fileName.buffer,lines >= PROGRAM_CACHE_LINES ? "w" : "a");
+    if (fp != NULL) {
+        fprintf(fp,"%s%s\n",prefix,dest->buffer);
+        fclose(fp);
+    }
+    destroy_stringbuf(&fileName);
+    return 0;
+}
+
+int invoke_compiler(const char* program,const resource_class* res,const char* arguments,const remote_job* remote,const char* redirect,int flags,const char* label,child_usage* pusage)
+{
+    /* a single compiler runs on the token that make gave this process */
+    int code;
+    int token;
+    process_handle handle;
+    token = acquire_job_token();
+    begin_phase(STATS_SPAWN);
+    code = start_compiler(program,res,arguments,remote,redirect,flags,label,&handle);
+    end_phase(STATS_SPAWN);
+    if (code != -1) {
+        begin_phase(STATS_WAIT);
+        if (wait_compiler(&handle,1,&code,pusage) == -1)
+            code = -1;
+        end_phase(STATS_WAIT);
+    }
+    if (token == 0)
+        release_job_token();
+    return code;
+}
+
+void assign_depfile(session* psession,job* pjob)
+{
+    /* the dependency file is named by a hash of everything that determines
+       the job's command-line; a changed command-line therefore never reuses
+       the dependencies recorded for another; only incremental, cached and
+       remote builds and rules that pass $depfile need one */
+    int i;
+    char name[32];
+    cache_key key;
+    compiler* info = pjob->group->compiler_info;
+    reset_stringbuf(&pjob->depfile);
+    if ((psession->flags & (SESSION_INCREMENTAL|SESSION_CACHE|SESSION_REMOTE)) == 0
+        && !uses_depfile(&info->options_template) && !uses_depfile(&info->redirect_template)
+        && !uses_depfile(&psession->options_template))
+        return;
+    assign_stringbuf(&pjob->depfile,get_settings_directory());
+    concat_stringbuf(&pjob->depfile,PATH_SEPARATOR "deps");
+    if (psession->cwd.used == 0) {
+        get_working_directory(&psession->cwd);
+        if (make_directory(pjob->depfile.buffer) != 0) {
+            fprintf(stderr,"%s: error: cannot create dependency directory '%s'\n",PROGRAM_NAME,pjob->depfile.buffer);
+            fatal_stop("dependency directory is unreachable");
+        }
+    }
+    init_cache_key(&key);
+    hash_cache_key(&key,psession->cwd.buffer,psession->cwd.used+1);
+    hash_cache_key(&key,pjob->project.buffer,pjob->project.used+1);
+    hash_cache_key(&key,info->program.buffer,info->program.used+1);
+    hash_cache_key(&key,info->options.buffer,info->options.used);
+    hash_cache_key(&key,info->redirect.buffer,info->redirect.used+1);
+    for (i = pjob->first;i < pjob->first+pjob->count;++i)
+        hash_cache_key(&key,psession->targets[i].buffer,psession->targets[i].used+1);
+    for (i = 0;i < psession->options_c;++i)
+        hash_cache_key(&key,psession->options[i].buffer,psession->options[i].used+1);
+    sprintf(name,PATH_SEPARATOR "%016llx.d",key.hash[0]);
+    concat_stringbuf(&pjob->depfile,name);
+}
+
+int check_up_to_date(session* psession,job* pjob)
+{
+    /* a job is up to date if its output exists and is no older than each of
+       its targets and each prerequisite listed in its dependency file; a
+       missing dependency file means the job has never completed successfully */
+    int i;
+    int result;
+    const char* iter;
+    stringbuf contents;
+    stringbuf dep;
+    file_time outtime, t;
+    if (get_file_time(job_output(pjob),&outtime) != 0)
+        return 0;
+    for (i = pjob->first;i < pjob->first+pjob->count;++i)
+        if (get_file_time(psession->targets[i].buffer,&t)!=0 || t>outtime)
+            return 0;
+    init_stringbuf(&contents);
+    iter = read_dependencies(pjob,&contents);
+    result = 0;
+    if (iter != NULL) {
+        result = 1;
+        init_stringbuf(&dep);
+        while ((iter = next_dependency(iter,&dep)) != NULL) {
+            if (get_file_time(dep.buffer,&t)!=0 || t>outtime) {
+                result = 0;
+                break;
+            }
+        }
+        destroy_stringbuf(&dep);
+    }
+    destroy_stringbuf(&contents);
+    return result;
+}
+
+void finish_depfile(session* psession,job* pjob,int code)
+{
+    int i;
+    FILE* fp;
+    file_time t;
+    if (pjob->depfile.used == 0)
+        return;
+    /* a failed job must be rebuilt next time, so forget its dependencies */
+    if (code != 0) {
+        remove(pjob->depfile.buffer);
+        return;
+    }
+    /* if the compiler did not write a dependency file, record the targets
+       themselves so that the next incremental run knows the job succeeded */
+    if ((psession->flags & SESSION_INCREMENTAL) && get_file_time(pjob->depfile.buffer,&t) != 0) {
+        fp = fopen(pjob->depfile.buffer,"wb");
+        if (fp == NULL) {
+            fprintf(stderr,"%s: warning: cannot write dependency file '%s'\n",PROGRAM_NAME,pjob->depfile.buffer);
+            return;
         }
+        fprintf(fp,"%s:",job_output(pjob));
+        for (i = pjob->first;i < pjob->first+pjob->count;++i) {
+            const char* p = psession->targets[i].buffer;
+            fputc(' ',fp);
+            while (*p) {
+                if (*p==' ' || *p=='#')
+                    fputc('\\',fp);
+                else if (*p == '$')
+                    fputc('$',fp);
+                fputc(*p++,fp);
+            }
+        }
+        fputc('\n',fp);
+        fclose(fp);
+    }
+}
+
+const char* read_dependencies(job* pjob,stringbuf* contents)
+{
+    /* read the job's dependency file and skip the rule's target up to the
+       first ':' that is not part of a path */
+    size_t n;
+    FILE* fp;
+    char ibuf[4096];
+    const char* iter;
+    if (pjob->depfile.used == 0)
+        return NULL;
+    fp = fopen(pjob->depfile.buffer,"rb");
+    if (fp == NULL)
+        return NULL;
+    while ((n = fread(ibuf,1,sizeof(ibuf),fp)) > 0)
+        append_stringbuf(contents,ibuf,(int)n);
+    fclose(fp);
+    iter = contents->buffer;
+    while (*iter && !(iter[0]==':' && (iter[1]==0 || isspace(iter[1]))))
+        ++iter;
+    return *iter == ':' ? iter+1 : NULL;
+}
 
-        i = j;
+const char* next_dependency(const char* iter,stringbuf* dest)
+{
+    /* read the next prerequisite of a make-style rule; escaped newlines
+       continue the rule and '\ ', '\#' and '$$' are unescaped */
+    reset_stringbuf(dest);
+    while (1) {
+        if (iter[0]=='\\' && iter[1]=='\n')
+            iter += 2;
+        else if (iter[0]=='\\' && iter[1]=='\r' && iter[2]=='\n')
+            iter += 3;
+        else if (*iter && *iter!='\n' && isspace(*iter))
+            ++iter;
+        else
+            break;
     }
+    if (*iter==0 || *iter=='\n')
+        return NULL;
+    while (*iter && !isspace(*iter)) {
+        if (iter[0]=='\\' && (iter[1]==' ' || iter[1]=='#'))
+            ++iter;
+        else if (iter[0]=='\\' && (iter[1]=='\n' || (iter[1]=='\r' && iter[2]=='\n')))
+            break;
+        else if (iter[0]=='$' && iter[1]=='$')
+            ++iter;
+        append_char_stringbuf(dest,*iter);
+        ++iter;
+    }
+    return iter;
+}
 
-    /* Append any remaining characters to the option. */
-    if (p != NULL) {
-        concat_stringbuf(dest,p+j);
+const char* job_output(job* pjob)
+{
+    /* the output of a job is its redirect file or otherwise the file named
+       by $project (e.g. 'gcc -o$project') */
+    return pjob->redirect.used > 0 ? pjob->redirect.buffer : pjob->project.buffer;
+}
+
+int skip_job(session* psession,job* pjob)
+{
+    cache_key key;
+    if ((psession->flags & SESSION_INCREMENTAL) && check_up_to_date(psession,pjob)) {
+        printf("%s: '%s' is up to date\n",PROGRAM_NAME,job_output(pjob));
+        return 1;
     }
+    if ((psession->flags & SESSION_CACHE) && compute_cache_key(psession,pjob,&key) == 0
+        && cache_restore(&key,job_output(pjob)) == 0) {
+        printf("%s: '%s' restored from cache\n",PROGRAM_NAME,job_output(pjob));
+        return 1;
+    }
+    return 0;
+}
 
-    /* separate options by null character */
-    append_terminator_stringbuf(dest);
+void finish_job(session* psession,job* pjob,int code)
+{
+    cache_key key;
+    finish_depfile(psession,pjob,code);
+    /* the key is computed again since the compiler may have rewritten the
+       dependency file */
+    if (code==0 && (psession->flags & SESSION_CACHE) && compute_cache_key(psession,pjob,&key) == 0)
+        cache_store(&key,job_output(pjob));
+}
+
+int compute_cache_key(session* psession,job* pjob,cache_key* pkey)
+{
+    /* the key covers the program, the expanded command-line, the contents
+       of each target and the contents of each dependency recorded for the
+       job by its last successful run */
+    int i;
+    int result;
+    const char* iter;
+    file_time t;
+    stringbuf contents;
+    stringbuf dep;
+    init_stringbuf(&contents);
+    init_cache_key(pkey);
+    /* identify the compiler by the modification time of its executable */
+    if (get_file_time(pjob->group->program.buffer,&t) == 0)
+        hash_cache_key(pkey,(const char*)&t,sizeof(t));
+    hash_cache_key(pkey,pjob->arguments.buffer,pjob->arguments.used);
+    hash_cache_key(pkey,pjob->redirect.buffer,pjob->redirect.used+1);
+    for (i = pjob->first;i < pjob->first+pjob->count;++i) {
+        if (hash_cache_key_file(pkey,psession->targets[i].buffer) != 0) {
+            destroy_stringbuf(&contents);
+            return -1;
+        }
+    }
+    result = 0;
+    reset_stringbuf(&contents);
+    iter = read_dependencies(pjob,&contents);
+    if (iter != NULL) {
+        init_stringbuf(&dep);
+        while ((iter = next_dependency(iter,&dep)) != NULL) {
+            hash_cache_key(pkey,dep.buffer,dep.used+1);
+            if (hash_cache_key_file(pkey,dep.buffer) != 0) {
+                result = -1;
+                break;
+            }
+        }
+        destroy_stringbuf(&dep);
+    }
+    destroy_stringbuf(&contents);
+    return result;
+}
+
+const remote_job* remote_files(session* psession,job* pjob)
+{
+    /* a job is sent with its targets and the dependencies recorded for it
+       that are under the working directory; absolute dependencies (e.g.
+       system headers) must be found on the worker; since a job that fails
+       on a worker is not run again here, a job runs locally until its rule
+       writes a $depfile and one has been recorded, and whenever a target or
+       a dependency lies outside of the working directory */
+    int i;
+    int n;
+    char* copy;
+    const char* start;
+    const char* iter;
+    const char** files;
+    remote_job* remote;
+    stringbuf contents;
+    stringbuf dep;
+    if ((psession->flags & SESSION_REMOTE) == 0)
+        return NULL;
+    if (!uses_depfile(&pjob->group->compiler_info->options_template) && !uses_depfile(&psession->options_template))
+        return NULL;
+    for (i = pjob->first;i < pjob->first+pjob->count;++i)
+        if ( !is_worker_path(psession->targets[i].buffer) )
+            return NULL;
+    init_stringbuf(&contents);
+    init_stringbuf(&dep);
+    n = pjob->count+1;
+    start = read_dependencies(pjob,&contents);
+    for (iter = start;iter!=NULL && (iter = next_dependency(iter,&dep))!=NULL;) {
+        if (!is_worker_path(dep.buffer) && !IS_ABSOLUTE_PATH(dep.buffer))
+            break;
+        ++n;
+    }
+    if (start==NULL || iter!=NULL) {
+        destroy_stringbuf(&dep);
+        destroy_stringbuf(&contents);
+        return NULL;
+    }
+    files = arena_alloc(&psession->pool,n*sizeof(const char*));
+    n = 0;
+    for (i = pjob->first;i < pjob->first+pjob->count;++i)
+        files[n++] = psession->targets[i].buffer;
+    for (iter = start;iter!=NULL && (iter = next_dependency(iter,&dep))!=NULL;) {
+        if ( !is_worker_path(dep.buffer) )
+            continue;
+        for (i = 0;i<pjob->count && strcmp(files[i],dep.buffer)!=0;++i)
+            ;
+        if (i < pjob->count)
+            continue;
+        copy = arena_alloc(&psession->pool,dep.used+1);
+        memcpy(copy,dep.buffer,dep.used+1);
+        files[n++] = copy;
+    }
+    files[n] = NULL;
+    destroy_stringbuf(&dep);
+    destroy_stringbuf(&contents);
+    remote = arena_alloc(&psession->pool,sizeof(remote_job));
+    remote->rule = pjob->group->compiler_info->extension.buffer;
+    remote->depfile = pjob->depfile.buffer;
+    remote->files = files;
+    return remote;
+}
+
+int uses_depfile(const option_template* options)
+{
+    int i;
+    for (i = 0;i < options->count;++i)
+        if (options->tokens[i].kind == OPTION_DEPFILE)
+            return 1;
+    return 0;
 }
@@ -5,21 +5,47 @@
 #include "stringbuf.h"
 #include "settings.h"
 
+/* target_group - the targets of a session that are compiled by one rule */
+typedef struct {
+    compiler* compiler_info; /* compiler information for the group */
+    stringbuf program; /* path of the compiler's program; resolved by compile_session() */
+    stringbuf project; /* project name; based on the group's first target minus extension */
+    int first; /* index of the group's first target; the targets of a group are adjacent */
+    int count; /* number of targets in the group */
+} target_group;
+
 /* session - information required for a
    complete invocation of a compiler process */
 typedef struct {
-    compiler* compiler_info; /* compiler information for session */
-    stringbuf project; /* project name; based on first target minus extension */
+    target_group* groups; /* targets grouped by rule in the order in which the rules are first used */
+    int groups_c; /* number of groups; the groups are compiled concurrently */
     stringbuf* targets; /* list of target files to pass to compiler */
     stringbuf* options; /* list of options supplied by user on command line */
+    stringbuf options_text; /* the user's options one after another, each null terminated */
+    option_template options_template; /* 'options_text' compiled by load_session() */
     int targets_c; /* number of targets */
     int options_c; /* number of user supplied options used in options_user */
     int alloc_size; /* allocated number of elements per list */
+    int jobs; /* if non-zero, each target is compiled as its own job with at most 'jobs' running at once */
+    int flags; /* SESSION_* flags that control how the session is compiled */
+    stringbuf cwd; /* working directory named by dependency files; read by the first job that needs one */
+    arena pool; /* owns all strings and lists allocated for the session */
 } session;
 
+/* session flags */
+#define SESSION_KEEP_GOING 0x01 /* in job mode, keep starting jobs after a job fails */
+#define SESSION_INCREMENTAL 0x02 /* skip jobs whose output is newer than their recorded dependencies */
+#define SESSION_CACHE 0x04 /* restore job outputs from the artifact cache when possible */
+#define SESSION_TEE 0x08 /* copy redirected compiler output to standard output as well */
+#define SESSION_SYNC_OUTPUT 0x10 /* collect each compiler's output and write it out in one block when it ends */
+#define SESSION_SYNC_LINES 0x20 /* collect each compiler's output and write it out a whole line at a time */
+#define SESSION_REMOTE 0x40 /* send jobs to the workers listed in the workers file; jobs run locally if no worker takes them */
+
 void init_session(session*,int size); /* allocate string buffers for at most 'size' options per type */
 void destroy_session(session*);
 void load_session(session*,int argc,const char** argv); /* returns 0 on success */
 int compile_session(session*); /* returns 0 on success */
+void list_dependencies(session*,stringbuf* dest); /* append the dependencies recorded for the session's jobs; names are separated by null characters */
+void remove_partial_outputs(session*); /* remove the temporary outputs of the session's jobs after a build was stopped */
 
 #endif
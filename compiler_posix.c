@@ -1,10 +1,139 @@
 /* compiler_posix.c */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
 #include <unistd.h>
 #include <dirent.h> /* requires _GNU_SOURCE to be defined */
 #include <errno.h>
+#include <spawn.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h> /* struct statx */
+#endif
+
+#define PROBE_RATIO 16 /* probe for each extension if the directory has this many entries per rule */
+#define DIRENT_SIZE_ESTIMATE 32 /* estimated bytes of directory size per entry */
+#define DIRENT_BUFFER_SIZE (256*1024)
+#define CHECK_BATCH_MIN 8 /* check fewer files than this one at a time */
+#define CHECK_RING_SIZE 256 /* io_uring submission queue entries */
+#define CHECK_THREADS 16 /* maximum number of threads checking files */
+#ifndef CHECK_STATX_MASK
+#define CHECK_STATX_MASK (STATX_TYPE | STATX_MODE) /* fields stat'ed by io_uring; test_check_files overrides it */
+#endif
+#define OUTPUT_PIPE_SIZE (1024*1024) /* requested capacity of the pipes that carry tee'd output */
+#define CAPTURE_READ_SIZE 65536 /* bytes read from a captured output at a time */
+
+#if defined(SYS_tee) && defined(SYS_splice)
+#define HAVE_SPLICE
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE 1
+#endif
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031
+#endif
+#endif
+
+#ifdef SYS_getdents64
+/* linux_dirent64 - record returned by the getdents64 system call */
+struct linux_dirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+extern char** environ;
+
+/* redirect_output - the redirect file of a running compiler; the output is
+   written to a temporary file that replaces the redirect file only if the
+   compiler succeeds */
+typedef struct redirect_output {
+    pid_t pid;
+    int fd; /* temporary file */
+    int pipefd; /* read end of the compiler's standard output in tee mode; -1 otherwise */
+    int failed; /* non-zero if the output could not be written completely */
+    int teefd; /* where the output is copied in tee mode: standard output or a captured output */
+    pthread_t pump; /* thread that copies the pipe in tee mode */
+    stringbuf temp;
+    stringbuf dest;
+    struct redirect_output* next;
+} redirect_output;
+
+/* captured_output - standard output and error of a running compiler that
+   are collected while it runs so that the output of concurrent compilers
+   does not interleave; the output is written out in one block when the
+   compiler ends or, in line mode, one whole line at a time */
+typedef struct captured_output {
+    pid_t pid;
+    int fds[2]; /* read ends of standard output and error; -1 once closed */
+    int pty; /* non-zero if both are written to a pty read through fds[0] */
+    int lines; /* non-zero to write lines as they complete */
+    stringbuf text[2]; /* output read but not yet written out */
+    stringbuf label; /* names the job in the header of the block */
+    struct captured_output* next;
+} captured_output;
+
+/* reaped_child - a child that was reaped while waiting on others; its
+   status is kept for the call that waits on it */
+typedef struct reaped_child {
+    pid_t pid;
+    int status;
+    struct rusage ru;
+    struct reaped_child* next;
+} reaped_child;
+
+/* check_pool - files shared by threads that check them */
+typedef struct {
+    const char** fileNames;
+    int* results;
+    int count;
+    int next; /* next file to be checked */
+    pthread_mutex_t lock;
+} check_pool;
+
+/* functions internal to this file */
+static int check_files_uring(const char** fileNames,int count,int* results); /* returns -1 if io_uring is unavailable */
+static void* check_files_thread(void* arg);
+static int probe_extensions(const char** ext,int dirfd,const char* useSource);
+static int scan_directory(const char** ext,int dirfd,const char* useSource);
+static const char* match_entry(int dirfd,const char* name,unsigned char type,const char* useSource,int srclen);
+static redirect_output* open_output(const char* redirect,int tee,int* pchildfd); /* returns NULL on failure */
+static void discard_output(redirect_output* out);
+static void finish_output(pid_t pid,int* pcode);
+static void* pump_output(void* arg);
+static void close_tee(redirect_output* out);
+static int drain_pipe(int in,int out,size_t n,int* psplice); /* returns 0 on success */
+static int write_all(int fd,const char* buf,size_t n); /* returns 0 on success */
+static captured_output* open_capture(int lines,const char* label,int* pchildfds); /* returns NULL on failure */
+static int open_pty(int* pmaster,int* pslave); /* returns 0 on success */
+static void discard_capture(captured_output* cap);
+static void read_capture(captured_output* cap,int index);
+static void write_capture(captured_output* cap,int final);
+static void wait_captures(const pid_t* pids,int count);
+static void finish_capture(pid_t pid);
+static int spawn_limited(pid_t* ppid,const char* path,int outfd,int errfd,char* const argv[],const resource_class* res,
+    const remote_job* remote); /* returns 0 or an errno value like posix_spawn() */
+static char** remote_helper(const char* path,char* const argv[],const remote_job* remote,char* count); /* returns NULL if the helper cannot be found; 'count' holds at least 16 bytes */
+static int apply_resources(const resource_class* res); /* returns 0 or an errno value */
+static pid_t reap_child(const pid_t* pids,int count,int* pstatus,struct rusage* pru); /* returns -1 on failure */
+static int poll_children(const pid_t* pids,int count); /* returns the index of an exited child or -1 if pidfds are unavailable */
+
+/* data internal to this file */
+static redirect_output* running_outputs = NULL;
+static captured_output* running_captures = NULL;
+static reaped_child* reaped_children = NULL;
 
 void fatal_stop(const char* message)
 {
@@ -14,17 +143,17 @@ void fatal_stop(const char* message)
 
 int lookup_ext(const char** ext,const char* source)
 {
-    /* look through files in the current working directory */
+    /* look for files named by the source plus a registered extension; if
+       there are few rules compared to the size of the directory then each
+       candidate is probed directly, otherwise the directory is scanned once */
     int i;
     int top;
-    int srclen;
-    DIR* pdir;
+    int dirfd;
+    struct stat st;
     const char* useSource;
-    top = 0;
     *ext = NULL;
     /* locate file name part of source string */
-    srclen = strlen(source);
-    i = srclen - 1;
+    i = strlen(source) - 1;
     while (i>=0 && source[i]!='/')
         --i;
     ++i;
@@ -35,48 +164,110 @@ int lookup_ext(const char** ext,const char* source)
         stringbuf part;
         init_stringbuf(&part);
         assign_stringbuf_ex(&part,source,i);
-        pdir = opendir(part.buffer);
+        dirfd = open(part.buffer,O_RDONLY | O_DIRECTORY | O_CLOEXEC);
         destroy_stringbuf(&part);
     }
     else
         /* file location is understood to be current directory */
-        pdir = opendir(".");
-    /* get length of source string that is used for matching */
+        dirfd = open(".",O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) {
+        if (errno == EACCES)
+            fatal_stop("cannot open current directory: permission denied");
+        fatal_stop("cannot open current directory");
+    }
+    /* estimate the number of directory entries from the directory's size */
+    if (fstat(dirfd,&st)==0 && (long long)get_compiler_count()*PROBE_RATIO < st.st_size/DIRENT_SIZE_ESTIMATE)
+        top = probe_extensions(ext,dirfd,useSource);
+    else
+        top = scan_directory(ext,dirfd,useSource);
+    close(dirfd);
+    return top;
+}
+
+int probe_extensions(const char** ext,int dirfd,const char* useSource)
+{
+    int i;
+    int top;
+    struct stat st;
+    stringbuf name;
+    top = 0;
+    init_stringbuf(&name);
+    for (i = 0;i<get_compiler_count() && top<MAX_EXTENSIONS;++i) {
+        const char* pext = get_extension(i);
+        /* skip repeated extensions and those that a directory scan could not
+           match since they contain more than one '.' */
+        if (check_extension(pext)!=pext || strchr(pext+1,'.')!=NULL)
+            continue;
+        assign_stringbuf(&name,useSource);
+        concat_stringbuf(&name,pext);
+        if (fstatat(dirfd,name.buffer,&st,0)==0 && S_ISREG(st.st_mode))
+            ext[top++] = pext;
+    }
+    destroy_stringbuf(&name);
+    return top;
+}
+
+int scan_directory(const char** ext,int dirfd,const char* useSource)
+{
+    int top;
+    int srclen;
+    const char* pext;
+    top = 0;
     srclen = strlen(useSource);
-    if (pdir != NULL) {
-        struct dirent* ent;
-        while (1) {
-            ent = readdir(pdir);
-            if (ent == NULL)
-                break;
-            if (ent->d_type == DT_REG) {
-                int len;
-                char* pext;
-                /* obtain file extension of entry */
-                len = strlen(ent->d_name);
-                pext = ent->d_name+len;
-                while (len>0 && *pext!='.') {
-                    --len;
-                    --pext;
-                }
-                /* check to see if prefix.ext matches prefix */
-                if (top<MAX_EXTENSIONS && *pext=='.' && len==srclen && strncmp(useSource,ent->d_name,srclen)==0) {
-                    /* the extension must belong to one of the handled extensions */
-                    ext[top] = check_extension(pext);
-                    if (ext[top] != NULL)
-                        ++top;
-                }
+#ifdef SYS_getdents64
+    {
+        /* read entries straight from the kernel with a large buffer */
+        long n;
+        long pos;
+        char* ibuf = heap_alloc(DIRENT_BUFFER_SIZE);
+        while ((n = syscall(SYS_getdents64,dirfd,ibuf,DIRENT_BUFFER_SIZE)) > 0) {
+            for (pos = 0;pos < n;pos += ((struct linux_dirent64*)(ibuf+pos))->d_reclen) {
+                struct linux_dirent64* ent = (struct linux_dirent64*)(ibuf+pos);
+                if (top<MAX_EXTENSIONS && (pext = match_entry(dirfd,ent->d_name,ent->d_type,useSource,srclen)) != NULL)
+                    ext[top++] = pext;
             }
         }
+        heap_free(ibuf);
+        if (n == -1)
+            fatal_stop("cannot read current directory");
+    }
+#else
+    {
+        DIR* pdir;
+        struct dirent* ent;
+        pdir = fdopendir(dup(dirfd));
+        if (pdir == NULL)
+            fatal_stop("cannot read current directory");
+        while ((ent = readdir(pdir)) != NULL) {
+            if (top<MAX_EXTENSIONS && (pext = match_entry(dirfd,ent->d_name,ent->d_type,useSource,srclen)) != NULL)
+                ext[top++] = pext;
+        }
         closedir(pdir);
     }
-    else if (errno == EACCES)
-        fatal_stop("cannot open current directory: permission denied");
-    else
-        fatal_stop("cannot open current directory");
+#endif
     return top;
 }
 
+const char* match_entry(int dirfd,const char* name,unsigned char type,const char* useSource,int srclen)
+{
+    /* check to see if prefix.ext matches prefix where .ext is the entry's
+       final extension and is one of the handled extensions */
+    const char* pext;
+    struct stat st;
+    if (strncmp(name,useSource,srclen)!=0 || name[srclen]!='.' || strchr(name+srclen+1,'.')!=NULL)
+        return NULL;
+    pext = check_extension(name+srclen);
+    if (pext == NULL)
+        return NULL;
+    /* file systems that do not report types (and symbolic links) require
+       a stat to determine whether the entry is a regular file */
+    if (type == DT_REG)
+        return pext;
+    if ((type==DT_UNKNOWN || type==DT_LNK) && fstatat(dirfd,name,&st,0)==0 && S_ISREG(st.st_mode))
+        return pext;
+    return NULL;
+}
+
 int check_file(const char* fileName)
 {
     struct stat st;
@@ -99,49 +290,1114 @@ int check_file(const char* fileName)
     return -1;
 }
 
-int invoke_compiler(const char* compilerName,const char* arguments,const char* redirect)
+void check_files(const char** fileNames,int count,int* results)
 {
+    /* submit the checks through io_uring if the kernel supports it or else
+       spread them over a pool of threads */
     int i;
+    int nthreads;
+    check_pool pool;
+    pthread_t threads[CHECK_THREADS];
+    if (count < CHECK_BATCH_MIN) {
+        for (i = 0;i < count;++i)
+            results[i] = check_file(fileNames[i]);
+        return;
+    }
+    if (check_files_uring(fileNames,count,results) == 0)
+        return;
+    pool.fileNames = fileNames;
+    pool.results = results;
+    pool.count = count;
+    pool.next = 0;
+    pthread_mutex_init(&pool.lock,NULL);
+    nthreads = count < CHECK_THREADS ? count : CHECK_THREADS;
+    for (i = 0;i < nthreads;++i)
+        if (pthread_create(threads+i,NULL,&check_files_thread,&pool) != 0)
+            break;
+    nthreads = i;
+    /* this thread helps too (and does all the work if no thread started) */
+    check_files_thread(&pool);
+    for (i = 0;i < nthreads;++i)
+        pthread_join(threads[i],NULL);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+void* check_files_thread(void* arg)
+{
+    int i;
+    check_pool* pool = arg;
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count)
+            break;
+        pool->results[i] = check_file(pool->fileNames[i]);
+    }
+    return NULL;
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+/* uring - the mapped queues of an io_uring instance */
+typedef struct {
     int fd;
-    int status;
-    pid_t pid;
-    char* argv[MAX_ARGUMENT+1]; /* include the terminating NULL ptr */
-    pid = fork();
-    if (pid == -1)
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring;
+
+static int uring_setup(uring* ring,unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params,0,sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup,entries,&params);
+    if (ring->fd == -1)
+        return -1;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL,ring->sq_ring_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL,ring->cq_ring_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL,ring->sqes_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQES);
+    if (ring->sq_ring==MAP_FAILED || ring->cq_ring==MAP_FAILED || ring->sqes==MAP_FAILED) {
+        if (ring->sq_ring != MAP_FAILED)
+            munmap(ring->sq_ring,ring->sq_ring_size);
+        if (ring->cq_ring != MAP_FAILED)
+            munmap(ring->cq_ring,ring->cq_ring_size);
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes,ring->sqes_size);
+        close(ring->fd);
+        return -1;
+    }
+    ring->sq_head = (unsigned*)((char*)ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned*)((char*)ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)((char*)ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)((char*)ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned*)((char*)ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned*)((char*)ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)((char*)ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ring + params.cq_off.cqes);
+    return 0;
+}
+
+static void uring_destroy(uring* ring)
+{
+    munmap(ring->sqes,ring->sqes_size);
+    munmap(ring->cq_ring,ring->cq_ring_size);
+    munmap(ring->sq_ring,ring->sq_ring_size);
+    close(ring->fd);
+}
+
+static struct io_uring_sqe* uring_next_sqe(uring* ring,unsigned long long data)
+{
+    unsigned tail;
+    unsigned index;
+    struct io_uring_sqe* sqe;
+    tail = *ring->sq_tail;
+    index = tail & *ring->sq_mask;
+    sqe = ring->sqes + index;
+    memset(sqe,0,sizeof(struct io_uring_sqe));
+    sqe->user_data = data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail,tail+1,__ATOMIC_RELEASE);
+    return sqe;
+}
+
+static int uring_run(uring* ring,unsigned count,int* res)
+{
+    /* submit 'count' queued entries and wait for all of them; res[] is
+       indexed by each entry's user data */
+    int n;
+    unsigned head;
+    unsigned submit;
+    unsigned done;
+    submit = count;
+    done = 0;
+    while (done < count) {
+        n = syscall(__NR_io_uring_enter,ring->fd,submit,count-done,IORING_ENTER_GETEVENTS,NULL,0);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        submit -= n;
+        head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = ring->cqes + (head & *ring->cq_mask);
+            res[cqe->user_data] = cqe->res;
+            ++head;
+            ++done;
+        }
+        __atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+int check_files_uring(const char** fileNames,int count,int* results)
+{
+    /* the files are stat'ed in one batch; then the regular files are
+       opened for reading in a second batch to check read permission
+       without opening devices or FIFOs */
+    int i;
+    int first, n;
+    int* res;
+    char* opened;
+    uring ring;
+    struct statx* stx;
+    if (uring_setup(&ring,CHECK_RING_SIZE) == -1)
         return -1;
-    if (pid != 0) {
-        waitpid(pid,&status,0);
-        if (WIFEXITED(status))
-            return WEXITSTATUS(status);
+    res = heap_alloc(count*sizeof(int));
+    opened = heap_alloc(count);
+    stx = heap_alloc(count*sizeof(struct statx));
+    for (first = 0;first < count;first += n) {
+        n = count-first < CHECK_RING_SIZE ? count-first : CHECK_RING_SIZE;
+        for (i = first;i < first+n;++i) {
+            struct io_uring_sqe* sqe = uring_next_sqe(&ring,i);
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long long)(size_t)fileNames[i];
+            sqe->len = CHECK_STATX_MASK;
+            sqe->off = (unsigned long long)(size_t)(stx+i);
+        }
+        if (uring_run(&ring,n,res) == -1)
+            break;
+    }
+    if (first < count) {
+        heap_free(stx);
+        heap_free(opened);
+        heap_free(res);
+        uring_destroy(&ring);
         return -1;
     }
-    /* child process */
-    /* TODO: hook into source parser if available */
-    i = 0;
-    status = 0;
-    while (arguments[i] && status<MAX_ARGUMENT) {
-        argv[status++] = (char*) (arguments+i);
+    for (i = 0;i < count;++i) {
+        if (res[i] == -EINVAL)
+            /* the kernel does not support the operation */
+            results[i] = check_file(fileNames[i]);
+        else if (res[i] < 0)
+            results[i] = res[i] == -ENOENT ? FILE_CHECK_DOES_NOT_EXIST : res[i] == -EACCES ? FILE_CHECK_ACCESS_DENIED : -1;
+        else if ((stx[i].stx_mode & S_IFMT) != S_IFREG)
+            results[i] = FILE_CHECK_NOT_REGULAR_FILE;
+        else
+            results[i] = FILE_CHECK_SUCCESS;
+    }
+    /* open the regular files; files checked by check_file() are not opened
+       again so their results stand */
+    first = 0;
+    while (first < count) {
+        n = 0;
+        for (i = first;i<count && n<CHECK_RING_SIZE;++i) {
+            opened[i] = res[i]!=-EINVAL && results[i]==FILE_CHECK_SUCCESS;
+            if (opened[i]) {
+                struct io_uring_sqe* sqe = uring_next_sqe(&ring,i);
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (unsigned long long)(size_t)fileNames[i];
+                sqe->open_flags = O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC;
+                ++n;
+            }
+        }
+        if (n>0 && uring_run(&ring,n,res) == -1)
+            fatal_stop("cannot check targets");
+        for (;first < i;++first) {
+            if (!opened[first])
+                continue;
+            if (res[first] >= 0)
+                close(res[first]);
+            else if (res[first] == -EINVAL)
+                results[first] = check_file(fileNames[first]);
+            else
+                results[first] = res[first] == -EACCES ? FILE_CHECK_ACCESS_DENIED : -1;
+        }
+    }
+    heap_free(stx);
+    heap_free(opened);
+    heap_free(res);
+    uring_destroy(&ring);
+    return 0;
+}
+#else
+int check_files_uring(const char** fileNames,int count,int* results)
+{
+    return -1;
+}
+#endif
+
+int start_compiler(const char* program,const resource_class* res,const char* arguments,const remote_job* remote,const char* redirect,int flags,const char* label,process_handle* phandle)
+{
+    /* spawn the compiler without copying our address space unless its rule
+       declares a resource class or the job may go to a worker; the argument
+       vector is sized to the argument list */
+    int i;
+    int fd;
+    int argc;
+    int err;
+    int capfds[2];
+    char** argv;
+    redirect_output* out;
+    captured_output* cap;
+    posix_spawn_file_actions_t actions;
+    argc = 0;
+    for (i = 0;arguments[i];++i) {
+        ++argc;
+        while ( arguments[i] )
+            ++i;
+    }
+    argv = heap_alloc((argc+1)*sizeof(char*));
+    argc = 0;
+    for (i = 0;arguments[i];++i) {
+        argv[argc++] = (char*) (arguments+i);
         while ( arguments[i] )
             ++i;
-        ++i;
     }
-    argv[status] = NULL;
+    argv[argc] = NULL;
 
-    /* If a redirect output file was specified, redirect the process's stdout
-     * to the specified file.
+    /* If a redirect output file was specified, open it here so that errors
+     * are reported against the file and have the child use it (or the pipe
+     * that feeds it in tee mode) as stdout.
      */
+    fd = -1;
+    out = NULL;
     if (redirect != NULL) {
-        fd = open(redirect,O_CREAT | O_WRONLY,0666);
-        if (fd == -1) {
-            fatal_stop("cannot open redirect file");
+        out = open_output(redirect,flags & SESSION_TEE,&fd);
+        if (out == NULL) {
+            heap_free(argv);
+            return -1;
+        }
+    }
+
+    /* If the output is synchronized, the child writes its stdout (unless it
+     * is redirected) and stderr to us; output that is tee'd from a redirect
+     * file is captured the same way.
+     */
+    cap = NULL;
+    capfds[0] = capfds[1] = -1;
+    if (flags & (SESSION_SYNC_OUTPUT | SESSION_SYNC_LINES)) {
+        cap = open_capture(flags & SESSION_SYNC_LINES,label,capfds);
+        if (cap == NULL) {
+            if (out != NULL)
+                discard_output(out);
+            heap_free(argv);
+            return -1;
         }
-        if (dup2(fd,STDOUT_FILENO) == -1) {
-            fatal_stop("failed to redirect output to file");
+        if (out!=NULL && out->pipefd!=-1)
+            out->teefd = fcntl(capfds[0],F_DUPFD_CLOEXEC,0);
+    }
+
+    if (res->flags!=0 || remote!=NULL)
+        err = spawn_limited(phandle,program,out != NULL ? fd : capfds[0],capfds[1],argv,res,remote);
+    else {
+        posix_spawn_file_actions_init(&actions);
+        if (out != NULL)
+            posix_spawn_file_actions_adddup2(&actions,fd,STDOUT_FILENO);
+        else if (cap != NULL)
+            posix_spawn_file_actions_adddup2(&actions,capfds[0],STDOUT_FILENO);
+        if (cap != NULL)
+            posix_spawn_file_actions_adddup2(&actions,capfds[1],STDERR_FILENO);
+        err = posix_spawn(phandle,program,&actions,NULL,argv,environ);
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    heap_free(argv);
+    if (cap != NULL) {
+        /* the child (and the tee pump) have their own copies */
+        close(capfds[0]);
+        if (capfds[1] != capfds[0])
+            close(capfds[1]);
+        if (err == 0) {
+            cap->pid = *phandle;
+            cap->next = running_captures;
+            running_captures = cap;
         }
-        close(fd);
+        else
+            discard_capture(cap);
+    }
+    if (out != NULL) {
+        /* the child has its own copy of the file or pipe */
+        if (out->pipefd != -1)
+            close(fd);
+        if (err == 0 && out->pipefd != -1 && pthread_create(&out->pump,NULL,&pump_output,out) != 0) {
+            /* the child is running, so its output must still be read */
+            pump_output(out);
+            close(out->pipefd);
+            out->pipefd = -1;
+        }
+        if (err == 0) {
+            out->pid = *phandle;
+            out->next = running_outputs;
+            running_outputs = out;
+        }
+        else
+            discard_output(out);
+    }
+    if (err != 0) {
+        fprintf(stderr,"%s: error: cannot start '%s': %s\n",PROGRAM_NAME,program,strerror(err));
+        return -1;
     }
-    
-    if (execvp(compilerName,argv) == -1)
-        _exit(1);
     return 0;
 }
+
+int wait_compiler(const process_handle* handles,int count,int* pcode,child_usage* pusage)
+{
+    int i;
+    int status;
+    pid_t pid;
+    struct rusage ru;
+    /* captured output must be read while the compilers run or they would
+       block once a pipe is full */
+    if (running_captures != NULL)
+        wait_captures(handles,count);
+    pid = reap_child(handles,count,&status,&ru);
+    if (pid == -1)
+        return -1;
+    for (i = 0;handles[i] != pid;++i)
+        ;
+    /* ru_maxrss is in kilobytes on Linux and the BSDs */
+    pusage->count = 1;
+    pusage->user_usec = (long long)ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec;
+    pusage->sys_usec = (long long)ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+    pusage->max_rss_kib = ru.ru_maxrss;
+    pusage->voluntary_switches = ru.ru_nvcsw;
+    pusage->involuntary_switches = ru.ru_nivcsw;
+    add_child_usage(pusage);
+    if (WIFEXITED(status))
+        *pcode = WEXITSTATUS(status);
+    else
+        *pcode = -1;
+    /* the tee pump is finished first since it writes to the captured output */
+    finish_output(pid,pcode);
+    finish_capture(pid);
+    return i;
+}
+
+pid_t reap_child(const pid_t* pids,int count,int* pstatus,struct rusage* pru)
+{
+    /* only the children in 'pids' are reaped where pidfds let us wait on a
+       set of children; elsewhere wait4(-1) may reap another child, whose
+       status is then kept for the call that waits on it */
+    int i;
+    pid_t pid;
+    reaped_child* child;
+    reaped_child** link;
+    for (link = &reaped_children;*link != NULL;link = &(*link)->next) {
+        for (i = 0;i<count && pids[i]!=(*link)->pid;++i)
+            ;
+        if (i < count) {
+            child = *link;
+            *link = child->next;
+            pid = child->pid;
+            *pstatus = child->status;
+            *pru = child->ru;
+            heap_free(child);
+            return pid;
+        }
+    }
+    while (1) {
+        if (count == 1)
+            pid = pids[0];
+        else {
+            i = poll_children(pids,count);
+            pid = i == -1 ? -1 : pids[i];
+        }
+        pid = wait4(pid,pstatus,0,pru);
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        for (i = 0;i<count && pids[i]!=pid;++i)
+            ;
+        if (i < count)
+            return pid;
+        child = heap_alloc(sizeof(reaped_child));
+        child->pid = pid;
+        child->status = *pstatus;
+        child->ru = *pru;
+        child->next = reaped_children;
+        reaped_children = child;
+    }
+}
+
+int poll_children(const pid_t* pids,int count)
+{
+    /* a pidfd becomes readable once its process has exited */
+#ifdef SYS_pidfd_open
+    int i, n;
+    int index;
+    struct pollfd* fds;
+    fds = heap_alloc(count*sizeof(struct pollfd));
+    index = -1;
+    for (n = 0;n < count;++n) {
+        fds[n].fd = (int)syscall(SYS_pidfd_open,pids[n],0);
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+        if (fds[n].fd == -1)
+            break;
+    }
+    while (n==count && index==-1) {
+        if (poll(fds,n,-1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (i = 0;i<n && index==-1;++i)
+            if (fds[i].revents != 0)
+                index = i;
+    }
+    for (i = 0;i < n;++i)
+        close(fds[i].fd);
+    heap_free(fds);
+    return index;
+#else
+    (void)pids;
+    (void)count;
+    return -1;
+#endif
+}
+
+int spawn_limited(pid_t* ppid,const char* path,int outfd,int errfd,char* const argv[],const resource_class* res,
+    const remote_job* remote)
+{
+    /* posix_spawn() cannot change the scheduling or the limits of the child,
+       so fork and apply them before exec; the child reports a failure through
+       a close-on-exec pipe that reads end-of-file once exec succeeds; a job
+       with 'remote' execs the helper that offers it to a worker, with its
+       output going where the compiler's would, and that runs the compiler
+       with the same resources if no worker takes the job */
+    int err;
+    int fds[2];
+    ssize_t n;
+    pid_t pid;
+    char count[16];
+    char** helper;
+    helper = remote != NULL ? remote_helper(path,argv,remote,count) : NULL;
+    if (helper != NULL) {
+        path = helper[0];
+        argv = helper;
+    }
+    if (pipe(fds) == -1) {
+        heap_free(helper);
+        return errno;
+    }
+    fcntl(fds[0],F_SETFD,FD_CLOEXEC);
+    fcntl(fds[1],F_SETFD,FD_CLOEXEC);
+    pid = fork();
+    if (pid == -1) {
+        err = errno;
+        close(fds[0]);
+        close(fds[1]);
+        heap_free(helper);
+        return err;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        err = 0;
+        if (outfd!=-1 && dup2(outfd,STDOUT_FILENO)==-1)
+            err = errno;
+        if (errfd!=-1 && dup2(errfd,STDERR_FILENO)==-1)
+            err = errno;
+        if (err == 0)
+            err = apply_resources(res);
+        if (err == 0) {
+            execv(path,argv);
+            err = errno;
+        }
+        n = write(fds[1],&err,sizeof(err));
+        _exit(127);
+    }
+    heap_free(helper);
+    close(fds[1]);
+    do
+        n = read(fds[0],&err,sizeof(err));
+    while (n==-1 && errno==EINTR);
+    close(fds[0]);
+    if (n == sizeof(err)) {
+        while (waitpid(pid,NULL,0)==-1 && errno==EINTR)
+            ;
+        return err;
+    }
+    *ppid = pid;
+    return 0;
+}
+
+char** remote_helper(const char* path,char* const argv[],const remote_job* remote,char* count)
+{
+    /* the helper is our own executable run as 'compile --remote-job RULE
+       DEPFILE PATH N FILE... PROGRAM ARG...' (see run_remote_job()); on
+       Linux it is found through /proc so that it is the same program even if
+       the file was replaced since we started */
+    int i;
+    int n;
+    int argc;
+    char** helper;
+    file_time t;
+    static stringbuf self;
+    static int self_found = -1;
+    if (self_found == -1) {
+        init_stringbuf(&self);
+#ifdef __linux__
+        assign_stringbuf(&self,"/proc/self/exe");
+        self_found = access(self.buffer,X_OK) == 0;
+#else
+        self_found = 0;
+#endif
+        if (!self_found)
+            self_found = find_program(PROGRAM_NAME,&self,&t) == 0;
+    }
+    if (!self_found)
+        return NULL;
+    for (n = 0;remote->files[n] != NULL;++n)
+        ;
+    for (argc = 0;argv[argc] != NULL;++argc)
+        ;
+    sprintf(count,"%d",n);
+    helper = heap_alloc((6+n+argc+1)*sizeof(char*));
+    helper[0] = self.buffer;
+    helper[1] = REMOTE_JOB_OPTION;
+    helper[2] = (char*)remote->rule;
+    helper[3] = (char*)remote->depfile;
+    helper[4] = (char*)path;
+    helper[5] = count;
+    for (i = 0;i < n;++i)
+        helper[6+i] = (char*)remote->files[i];
+    for (i = 0;i <= argc;++i)
+        helper[6+n+i] = argv[i];
+    return helper;
+}
+
+int apply_resources(const resource_class* res)
+{
+    /* affinity and I/O classes are Linux system calls; they are ignored on
+       systems without them */
+    int i;
+    static const int resources[LIMIT_COUNT] = {
+        RLIMIT_AS, RLIMIT_CORE, RLIMIT_CPU, RLIMIT_DATA, RLIMIT_FSIZE, RLIMIT_NOFILE, RLIMIT_STACK
+    };
+#ifdef SYS_sched_setaffinity
+    if ((res->flags & RESOURCE_CPUS) && syscall(SYS_sched_setaffinity,0,sizeof(res->cpus),res->cpus)==-1)
+        return errno;
+#endif
+#ifdef SYS_ioprio_set
+    /* ioprio_set(IOPRIO_WHO_PROCESS,self,class << IOPRIO_CLASS_SHIFT | level) */
+    if ((res->flags & RESOURCE_IOCLASS) && syscall(SYS_ioprio_set,1,0,res->ioclass << 13 | res->iolevel)==-1)
+        return errno;
+#endif
+    if (res->flags & RESOURCE_NICE) {
+        /* the niceness is raised (or lowered) relative to ours as by nice(1) */
+        int prio;
+        errno = 0;
+        prio = getpriority(PRIO_PROCESS,0);
+        if (errno != 0)
+            return errno;
+        prio += res->nice;
+        if (prio < -20)
+            prio = -20;
+        if (prio > 19)
+            prio = 19;
+        if (setpriority(PRIO_PROCESS,0,prio) == -1)
+            return errno;
+    }
+    for (i = 0;i < LIMIT_COUNT;++i) {
+        struct rlimit rl;
+        if (!(res->flags & RESOURCE_LIMIT(i)))
+            continue;
+        /* only the soft limit is set so that the compiler may raise it again */
+        if (getrlimit(resources[i],&rl) == -1)
+            return errno;
+        rl.rlim_cur = res->limits[i] < 0 ? RLIM_INFINITY : (rlim_t)res->limits[i];
+        if (setrlimit(resources[i],&rl) == -1)
+            return errno;
+    }
+    return 0;
+}
+
+redirect_output* open_output(const char* redirect,int tee,int* pchildfd)
+{
+    int fds[2];
+    redirect_output* out;
+    out = heap_alloc(sizeof(redirect_output));
+    init_stringbuf(&out->dest);
+    init_stringbuf(&out->temp);
+    assign_stringbuf(&out->dest,redirect);
+    assign_stringbuf(&out->temp,redirect);
+    concat_stringbuf(&out->temp,OUTPUT_TEMP_SUFFIX);
+    out->pid = -1;
+    out->pipefd = -1;
+    out->teefd = STDOUT_FILENO;
+    out->failed = 0;
+    out->next = NULL;
+    out->fd = open(out->temp.buffer,O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,0666);
+    if (out->fd == -1) {
+        fprintf(stderr,"%s: error: cannot open redirect file '%s': %s\n",PROGRAM_NAME,redirect,strerror(errno));
+        discard_output(out);
+        return NULL;
+    }
+    *pchildfd = out->fd;
+    if (tee) {
+        if (pipe(fds) == -1) {
+            fprintf(stderr,"%s: error: cannot create pipe for '%s': %s\n",PROGRAM_NAME,redirect,strerror(errno));
+            discard_output(out);
+            return NULL;
+        }
+        fcntl(fds[0],F_SETFD,FD_CLOEXEC);
+        fcntl(fds[1],F_SETFD,FD_CLOEXEC);
+#ifdef HAVE_SPLICE
+        /* a larger pipe lets the compiler write more before it must wait */
+        fcntl(fds[1],F_SETPIPE_SZ,OUTPUT_PIPE_SIZE);
+#endif
+        out->pipefd = fds[0];
+        *pchildfd = fds[1];
+    }
+    return out;
+}
+
+void discard_output(redirect_output* out)
+{
+    if (out->pipefd != -1)
+        close(out->pipefd);
+    close_tee(out);
+    if (out->fd != -1) {
+        close(out->fd);
+        unlink(out->temp.buffer);
+    }
+    destroy_stringbuf(&out->temp);
+    destroy_stringbuf(&out->dest);
+    heap_free(out);
+}
+
+void finish_output(pid_t pid,int* pcode)
+{
+    /* replace the redirect file with the output of a successful compiler */
+    redirect_output* out;
+    redirect_output** link;
+    link = &running_outputs;
+    while (*link!=NULL && (*link)->pid!=pid)
+        link = &(*link)->next;
+    out = *link;
+    if (out == NULL)
+        return;
+    *link = out->next;
+    if (out->pipefd != -1) {
+        /* the pump finishes once every writer has closed the pipe */
+        pthread_join(out->pump,NULL);
+        close(out->pipefd);
+        out->pipefd = -1;
+    }
+    if (close(out->fd) == -1)
+        out->failed = 1;
+    out->fd = -1;
+    if (*pcode==0 && out->failed) {
+        fprintf(stderr,"%s: error: cannot write redirect file '%s'\n",PROGRAM_NAME,out->dest.buffer);
+        *pcode = 1;
+    }
+    else if (*pcode==0 && rename(out->temp.buffer,out->dest.buffer)==-1) {
+        fprintf(stderr,"%s: error: cannot replace redirect file '%s': %s\n",PROGRAM_NAME,out->dest.buffer,strerror(errno));
+        *pcode = 1;
+    }
+    if (*pcode != 0)
+        unlink(out->temp.buffer);
+    discard_output(out);
+}
+
+void* pump_output(void* arg)
+{
+    /* copy the compiler's output to the temporary file and to our standard
+       output; where possible the output is duplicated with tee() and moved
+       with splice() so that it is not copied through user space */
+    ssize_t n;
+    char ibuf[65536];
+    redirect_output* out = arg;
+#ifdef HAVE_SPLICE
+    int fds[2];
+    int splice_file, splice_stdout;
+    if (pipe(fds) == 0) {
+        fcntl(fds[0],F_SETFD,FD_CLOEXEC);
+        fcntl(fds[1],F_SETFD,FD_CLOEXEC);
+        fcntl(fds[1],F_SETPIPE_SZ,OUTPUT_PIPE_SIZE);
+        splice_file = splice_stdout = 1;
+        while (1) {
+            n = syscall(SYS_tee,out->pipefd,fds[1],(size_t)OUTPUT_PIPE_SIZE,0);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            if (drain_pipe(out->pipefd,out->fd,n,&splice_file) == -1) {
+                out->failed = 1;
+                break;
+            }
+            if (drain_pipe(fds[0],out->teefd,n,&splice_stdout) == -1)
+                break;
+        }
+        close(fds[0]);
+        close(fds[1]);
+        if (n == 0) {
+            close_tee(out);
+            return NULL;
+        }
+        /* otherwise tee() is not supported here or a write failed; copy
+           (or discard) the rest of the output below */
+    }
+#endif
+    while (1) {
+        n = read(out->pipefd,ibuf,sizeof(ibuf));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        if (!out->failed && write_all(out->fd,ibuf,n) == -1)
+            out->failed = 1;
+        write_all(out->teefd,ibuf,n);
+    }
+    close_tee(out);
+    return NULL;
+}
+
+void close_tee(redirect_output* out)
+{
+    /* a captured output reaches its end once the pump lets go of it */
+    if (out->teefd!=STDOUT_FILENO && out->teefd!=-1)
+        close(out->teefd);
+    out->teefd = -1;
+}
+
+int drain_pipe(int in,int out,size_t n,int* psplice)
+{
+    /* move n bytes out of a pipe; splice() is given up for read() and
+       write() if the destination doesn't support it */
+    ssize_t k;
+    char ibuf[4096];
+    while (n > 0) {
+#ifdef HAVE_SPLICE
+        if (*psplice) {
+            k = syscall(SYS_splice,in,NULL,out,NULL,n,SPLICE_F_MOVE);
+            if (k == -1 && errno == EINVAL) {
+                *psplice = 0;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            k = read(in,ibuf,n < sizeof(ibuf) ? n : sizeof(ibuf));
+            if (k>0 && write_all(out,ibuf,k)==-1)
+                return -1;
+        }
+        if (k == -1 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return -1;
+        n -= k;
+    }
+    return 0;
+}
+
+int write_all(int fd,const char* buf,size_t n)
+{
+    ssize_t k;
+    while (n > 0) {
+        k = write(fd,buf,n);
+        if (k == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += k;
+        n -= k;
+    }
+    return 0;
+}
+
+captured_output* open_capture(int lines,const char* label,int* pchildfds)
+{
+    /* a pty is used while both standard output and error are terminals so
+       that compilers still color their diagnostics; the two are then one
+       stream, which makes no difference on a terminal */
+    int i;
+    int fds[2];
+    captured_output* cap;
+    static int terminal = -1;
+    if (terminal == -1)
+        terminal = isatty(STDOUT_FILENO) && isatty(STDERR_FILENO);
+    cap = heap_alloc(sizeof(captured_output));
+    cap->pid = -1;
+    cap->pty = 0;
+    cap->lines = lines;
+    cap->next = NULL;
+    for (i = 0;i < 2;++i) {
+        cap->fds[i] = -1;
+        init_stringbuf(cap->text+i);
+    }
+    init_stringbuf(&cap->label);
+    assign_stringbuf(&cap->label,label);
+    if (terminal && open_pty(cap->fds,pchildfds)==0) {
+        cap->pty = 1;
+        pchildfds[1] = pchildfds[0];
+        return cap;
+    }
+    for (i = 0;i < 2;++i) {
+        if (pipe(fds) == -1) {
+            fprintf(stderr,"%s: error: cannot create pipe for the output of '%s': %s\n",PROGRAM_NAME,label,strerror(errno));
+            if (i == 1)
+                close(pchildfds[0]);
+            discard_capture(cap);
+            return NULL;
+        }
+        fcntl(fds[0],F_SETFD,FD_CLOEXEC);
+        fcntl(fds[1],F_SETFD,FD_CLOEXEC);
+        cap->fds[i] = fds[0];
+        pchildfds[i] = fds[1];
+    }
+    return cap;
+}
+
+int open_pty(int* pmaster,int* pslave)
+{
+    /* Linux ptys are opened through /dev/ptmx; other systems use pipes */
+#if defined(TIOCGPTN) && defined(TIOCSPTLCK)
+    int n;
+    int unlock;
+    char name[32];
+    struct termios tio;
+    struct winsize ws;
+    *pmaster = open("/dev/ptmx",O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*pmaster == -1)
+        return -1;
+    unlock = 0;
+    if (ioctl(*pmaster,TIOCSPTLCK,&unlock)==-1 || ioctl(*pmaster,TIOCGPTN,&n)==-1) {
+        close(*pmaster);
+        *pmaster = -1;
+        return -1;
+    }
+    sprintf(name,"/dev/pts/%d",n);
+    *pslave = open(name,O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*pslave == -1) {
+        close(*pmaster);
+        *pmaster = -1;
+        return -1;
+    }
+    /* the output is passed through as written (no carriage return is added
+       before each newline) and is formatted for the width of our terminal */
+    if (tcgetattr(*pslave,&tio) == 0) {
+        tio.c_oflag &= ~OPOST;
+        tcsetattr(*pslave,TCSANOW,&tio);
+    }
+    if (ioctl(STDERR_FILENO,TIOCGWINSZ,&ws) == 0)
+        ioctl(*pslave,TIOCSWINSZ,&ws);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void discard_capture(captured_output* cap)
+{
+    int i;
+    for (i = 0;i < 2;++i) {
+        if (cap->fds[i] != -1)
+            close(cap->fds[i]);
+        destroy_stringbuf(cap->text+i);
+    }
+    destroy_stringbuf(&cap->label);
+    heap_free(cap);
+}
+
+void read_capture(captured_output* cap,int index)
+{
+    /* a pty reports EIO rather than end-of-file once the compiler closes it */
+    ssize_t n;
+    stringbuf* text = cap->text+index;
+    reserve_stringbuf(text,text->used+CAPTURE_READ_SIZE);
+    do
+        n = read(cap->fds[index],text->buffer+text->used,CAPTURE_READ_SIZE);
+    while (n==-1 && errno==EINTR);
+    if (n <= 0) {
+        close(cap->fds[index]);
+        cap->fds[index] = -1;
+        return;
+    }
+    text->used += n;
+    text->buffer[text->used] = 0;
+    if (cap->lines)
+        write_capture(cap,0);
+}
+
+void write_capture(captured_output* cap,int final)
+{
+    /* in line mode only complete lines are written until the end; a block
+       is written with a header that names its job */
+    int i;
+    int n;
+    int header;
+    header = !cap->lines;
+    for (i = 0;i < 2;++i) {
+        stringbuf* text = cap->text+i;
+        n = text->used;
+        if (!final) {
+            while (n>0 && text->buffer[n-1]!='\n')
+                --n;
+        }
+        if (n == 0)
+            continue;
+        if (header) {
+            fprintf(stderr,"==> %s <==\n",cap->label.buffer);
+            fflush(stderr);
+            header = 0;
+        }
+        /* the stream of a pty is written where diagnostics go */
+        fflush(stdout);
+        write_all(i==0 && !cap->pty ? STDOUT_FILENO : STDERR_FILENO,text->buffer,n);
+        memmove(text->buffer,text->buffer+n,text->used-n);
+        truncate_stringbuf(text,text->used-n);
+    }
+}
+
+void wait_captures(const pid_t* pids,int count)
+{
+    /* read captured output until a compiler that is waited on has closed
+       its output, which it does when it exits */
+    int i, j, n;
+    int total;
+    struct pollfd* fds;
+    captured_output* cap;
+    captured_output** owners;
+    total = 0;
+    for (cap = running_captures;cap != NULL;cap = cap->next)
+        total += 2;
+    fds = heap_alloc(total*sizeof(struct pollfd));
+    owners = heap_alloc(total*sizeof(captured_output*));
+    while (1) {
+        n = 0;
+        for (cap = running_captures;cap != NULL;cap = cap->next) {
+            if (cap->fds[0]==-1 && cap->fds[1]==-1) {
+                for (i = 0;i < count;++i)
+                    if (pids[i] == cap->pid)
+                        break;
+                if (i < count)
+                    break;
+            }
+            for (j = 0;j < 2;++j) {
+                if (cap->fds[j] == -1)
+                    continue;
+                fds[n].fd = cap->fds[j];
+                fds[n].events = POLLIN;
+                fds[n].revents = 0;
+                owners[n++] = cap;
+            }
+        }
+        if (cap!=NULL || n==0)
+            break;
+        if (poll(fds,n,-1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (i = 0;i < n;++i) {
+            if (fds[i].revents == 0)
+                continue;
+            cap = owners[i];
+            read_capture(cap,cap->fds[0] == fds[i].fd ? 0 : 1);
+        }
+    }
+    heap_free(owners);
+    heap_free(fds);
+}
+
+void finish_capture(pid_t pid)
+{
+    /* read what the compiler wrote before it exited and write it out */
+    int i;
+    captured_output* cap;
+    captured_output** link;
+    link = &running_captures;
+    while (*link!=NULL && (*link)->pid!=pid)
+        link = &(*link)->next;
+    cap = *link;
+    if (cap == NULL)
+        return;
+    *link = cap->next;
+    for (i = 0;i < 2;++i)
+        while (cap->fds[i] != -1)
+            read_capture(cap,i);
+    write_capture(cap,1);
+    discard_capture(cap);
+}
+
+int get_file_time(const char* fileName,file_time* ptime)
+{
+    struct stat st;
+    if (stat(fileName,&st) == -1)
+        return -1;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    *ptime = (file_time)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    *ptime = (file_time)st.st_mtime * 1000000000;
+#endif
+    return 0;
+}
+
+void get_working_directory(stringbuf* dest)
+{
+    while (getcwd(dest->buffer,dest->size) == NULL) {
+        if (errno != ERANGE)
+            fatal_stop("cannot determine current directory");
+        grow_stringbuf(dest);
+    }
+    dest->used = strlen(dest->buffer);
+}
+
+int make_directory(const char* dirName)
+{
+    struct stat st;
+    if (mkdir(dirName,S_IRWXU) == 0)
+        return 0;
+    if (errno==EEXIST && stat(dirName,&st)==0 && S_ISDIR(st.st_mode))
+        return 0;
+    return -1;
+}
+
+int find_program(const char* program,stringbuf* dest,file_time* ptime)
+{
+    /* search PATH for the program the way execvp() would */
+    const char* path;
+    const char* end;
+    if (strchr(program,'/') != NULL) {
+        assign_stringbuf(dest,program);
+        return get_file_time(dest->buffer,ptime);
+    }
+    path = getenv("PATH");
+    if (path == NULL)
+        path = "/usr/bin:/bin";
+    while (1) {
+        end = strchr(path,':');
+        if (end == NULL)
+            end = path+strlen(path);
+        if (end == path)
+            assign_stringbuf(dest,".");
+        else
+            assign_stringbuf_ex(dest,path,end-path);
+        concat_stringbuf(dest,"/");
+        concat_stringbuf(dest,program);
+        if (access(dest->buffer,X_OK)==0 && get_file_time(dest->buffer,ptime)==0)
+            return 0;
+        if (*end == 0)
+            break;
+        path = end+1;
+    }
+    return -1;
+}
+
+int get_processor_count()
+{
+    long n;
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -1,5 +1,59 @@
 /* compiler_windows.c */
 #include <Windows.h>
+#include <Psapi.h>
+
+/* redirect_output - the redirect file of a running compiler; the output is
+   written to a temporary file that replaces the redirect file only if the
+   compiler succeeds */
+typedef struct redirect_output {
+	HANDLE hProcess;
+	HANDLE hFile; /* temporary file */
+	HANDLE hPipe; /* read end of the compiler's standard output in tee mode; NULL otherwise */
+	HANDLE hPump; /* thread that copies the pipe in tee mode */
+	HANDLE hTee; /* where the output is copied in tee mode: standard output or a captured output */
+	int failed; /* non-zero if the output could not be written completely */
+	stringbuf temp;
+	stringbuf dest;
+	struct redirect_output* next;
+} redirect_output;
+
+/* capture_stream, captured_output - standard output and error of a running
+   compiler that are collected by reader threads so that the output of
+   concurrent compilers does not interleave; the output is written out in one
+   block when the compiler ends or, in line mode, one whole line at a time */
+struct captured_output;
+typedef struct {
+	HANDLE hPipe; /* read end */
+	HANDLE hReader; /* thread that reads the pipe */
+	DWORD dwDest; /* STD_OUTPUT_HANDLE or STD_ERROR_HANDLE */
+	stringbuf text; /* output read but not yet written out */
+	struct captured_output* owner;
+} capture_stream;
+
+typedef struct captured_output {
+	HANDLE hProcess;
+	int lines; /* non-zero to write lines as they complete */
+	capture_stream streams[2];
+	stringbuf label; /* names the job in the header of the block */
+	struct captured_output* next;
+} captured_output;
+
+/* functions internal to this file */
+static redirect_output* open_output(const char* redirect,int tee,HANDLE* phChild); /* returns NULL on failure */
+static void discard_output(redirect_output* out);
+static void finish_output(HANDLE hProcess,int* pcode);
+static DWORD WINAPI pump_output(LPVOID arg);
+static BOOL apply_resources(HANDLE hProcess,const resource_class* res);
+static captured_output* open_capture(int lines,const char* label,HANDLE* phChildren); /* returns NULL on failure */
+static void discard_capture(captured_output* cap);
+static DWORD WINAPI read_capture(LPVOID arg);
+static void write_capture(capture_stream* stream,int final);
+static void finish_capture(HANDLE hProcess);
+
+/* data internal to this file */
+static redirect_output* running_outputs = NULL;
+static captured_output* running_captures = NULL;
+static CRITICAL_SECTION capture_lock; /* serializes writing captured output */
 
 void fatal_stop(const char* message)
 {
@@ -21,23 +75,26 @@ int lookup_ext(const char** ext,const char* source)
 	/* find file name part of source string */
 	length = strlen(source);
 	i = length - 1;
-	while (i>=0 && (source[i]!='\\' || source[i]!='/'))
+	while (i>=0 && source[i]!='\\' && source[i]!='/')
 		--i;
 	++i;
 	useSource = source+i;
-	/* open needed directory */
-	if (i > 0) {
-		/* needed directory is specified in source string */
+	/* list only the entries named prefix.* in the needed directory; the
+	   file system filters the listing so large directories are not read */
+	{
 		stringbuf part;
 		init_stringbuf(&part);
-		assign_stringbuf_ex(&part,source,i); /* assign filePath\\ */
-		concat_stringbuf(&part,"*"); /* concat to filePath\\* */
+		if (i > 0)
+			/* needed directory is specified in source string */
+			assign_stringbuf_ex(&part,source,i); /* assign filePath\\ */
+		else
+			/* needed directory is the current working directory */
+			assign_stringbuf(&part,".\\");
+		concat_stringbuf(&part,useSource);
+		concat_stringbuf(&part,".*"); /* concat to filePath\\prefix.* */
 		fFindInfo = FindFirstFile(part.buffer,&findData);
 		destroy_stringbuf(&part);
 	}
-	else
-		/* needed directory is the current working directory */
-		fFindInfo = FindFirstFile(".\\*",&findData);
 	length = strlen(useSource);
 	/* cycle through the directory's listing if it was successfully opened */
 	if (fFindInfo != INVALID_HANDLE_VALUE) {
@@ -63,7 +120,7 @@ int lookup_ext(const char** ext,const char* source)
 		} while (FindNextFile(fFindInfo,&findData) != 0);
 		FindClose(fFindInfo);
 	}
-	else
+	else if (GetLastError() != ERROR_FILE_NOT_FOUND)
 		fatal_stop("could not open needed directory");
 	return top;
 }
@@ -82,18 +139,32 @@ int check_file(const char* fileName)
 	return FILE_CHECK_SUCCESS;
 }
 
-int invoke_compiler(const char* compilerName,const char* arguments,const char* redirect)
+void check_files(const char** fileNames,int count,int* results)
 {
 	int i;
-	HANDLE hFile;
-	DWORD exitCode;
+	for (i = 0;i < count;++i)
+		results[i] = check_file(fileNames[i]);
+}
+
+int start_compiler(const char* program,const resource_class* res,const char* arguments,const remote_job* remote,const char* redirect,int flags,const char* label,process_handle* phandle)
+{
+	/* there are no workers on this system, so 'remote' is not used */
+	int i;
+	BOOL bSuccess;
+	DWORD dwFlags;
+	HANDLE hChild;
+	HANDLE hCapture[2];
 	stringbuf cmdLine;
 	STARTUPINFO startInfo;
-	SECURITY_ATTRIBUTES secattribs;
 	PROCESS_INFORMATION processInfo;
-	/* compile the command line (arguments are separated by zero bytes and contains program name) */
+	redirect_output* out;
+	captured_output* cap;
+	/* compile the command line (arguments are separated by zero bytes and contains program name);
+	   the resolved program is quoted in place of the program name */
 	init_stringbuf(&cmdLine);
-	assign_stringbuf(&cmdLine,compilerName);
+	assign_stringbuf(&cmdLine,"\"");
+	concat_stringbuf(&cmdLine,program);
+	concat_stringbuf(&cmdLine,"\"");
 	i = strlen(arguments)+1; /* move past first argument which is program name */
 	while ( arguments[i] ) {
 		concat_stringbuf(&cmdLine," ");
@@ -106,34 +177,464 @@ int invoke_compiler(const char* compilerName,const char* arguments,const char* r
 	ZeroMemory(&processInfo,sizeof(PROCESS_INFORMATION));
 	ZeroMemory(&startInfo,sizeof(STARTUPINFO));
 	startInfo.cb = sizeof(STARTUPINFO);
+	out = NULL;
+	cap = NULL;
 	if (redirect != NULL) {
-		ZeroMemory(&secattribs,sizeof(SECURITY_ATTRIBUTES));
-		secattribs.nLength = sizeof(SECURITY_ATTRIBUTES);
-		secattribs.bInheritHandle = TRUE;
-		hFile = CreateFile(redirect,GENERIC_WRITE,FILE_SHARE_WRITE,&secattribs,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
-		if (hFile == INVALID_HANDLE_VALUE) {
-			fatal_stop("failed to open redirect file");
+		out = open_output(redirect,flags & SESSION_TEE,&hChild);
+		if (out == NULL) {
+			destroy_stringbuf(&cmdLine);
+			return -1;
 		}
 		startInfo.dwFlags = STARTF_USESTDHANDLES;
-		startInfo.hStdOutput = hFile;
+		startInfo.hStdOutput = hChild;
 		startInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
 		startInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
 	}
-	else {
-		hFile = INVALID_HANDLE_VALUE;
+	/* if the output is synchronized, the child writes its stdout (unless it
+	   is redirected) and stderr to us; output that is tee'd from a redirect
+	   file is captured the same way */
+	if (flags & (SESSION_SYNC_OUTPUT | SESSION_SYNC_LINES)) {
+		cap = open_capture(flags & SESSION_SYNC_LINES,label,hCapture);
+		if (cap == NULL) {
+			if (out != NULL)
+				discard_output(out);
+			destroy_stringbuf(&cmdLine);
+			return -1;
+		}
+		if (out!=NULL && out->hPipe!=NULL)
+			DuplicateHandle(GetCurrentProcess(),hCapture[0],GetCurrentProcess(),&out->hTee,0,FALSE,DUPLICATE_SAME_ACCESS);
+		startInfo.dwFlags = STARTF_USESTDHANDLES;
+		startInfo.hStdOutput = out != NULL ? hChild : hCapture[0];
+		startInfo.hStdError = hCapture[1];
+		startInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
 	}
 	/* run the compiler process; don't specify an application name so that
-	   the program name is run through the shell which will locate the compiler */
-	if (CreateProcess(NULL,cmdLine.buffer,NULL,NULL,TRUE,0,NULL,NULL,&startInfo,&processInfo) == 0)
+	   batch files are run through the shell */
+	dwFlags = res->flags != 0 ? CREATE_SUSPENDED : 0;
+	bSuccess = CreateProcess(NULL,cmdLine.buffer,NULL,NULL,TRUE,dwFlags,NULL,NULL,&startInfo,&processInfo);
+	destroy_stringbuf(&cmdLine);
+	if (cap != NULL) {
+		/* the child has its own copies of the write ends */
+		CloseHandle(hCapture[0]);
+		CloseHandle(hCapture[1]);
+	}
+	if (bSuccess && dwFlags==CREATE_SUSPENDED) {
+		/* the resource class is applied before the compiler runs */
+		if ( apply_resources(processInfo.hProcess,res) )
+			ResumeThread(processInfo.hThread);
+		else {
+			fprintf(stderr,"%s: error: cannot apply the resource class of '%s'\n",PROGRAM_NAME,program);
+			TerminateProcess(processInfo.hProcess,1);
+			WaitForSingleObject(processInfo.hProcess,INFINITE);
+			CloseHandle(processInfo.hProcess);
+			CloseHandle(processInfo.hThread);
+			bSuccess = FALSE;
+		}
+	}
+	if (cap != NULL) {
+		if (bSuccess) {
+			for (i = 0;i < 2;++i)
+				cap->streams[i].hReader = CreateThread(NULL,0,&read_capture,cap->streams+i,0,NULL);
+			cap->hProcess = processInfo.hProcess;
+			cap->next = running_captures;
+			running_captures = cap;
+		}
+		else
+			discard_capture(cap);
+	}
+	if (out != NULL) {
+		/* the child has its own copy of the file or pipe handle */
+		if (out->hPipe != NULL)
+			CloseHandle(hChild);
+		if (bSuccess && out->hPipe != NULL) {
+			out->hPump = CreateThread(NULL,0,&pump_output,out,0,NULL);
+			if (out->hPump == NULL) {
+				/* the child is running, so its output must still be read */
+				pump_output(out);
+				CloseHandle(out->hPipe);
+				out->hPipe = NULL;
+			}
+		}
+		if (bSuccess) {
+			out->hProcess = processInfo.hProcess;
+			out->next = running_outputs;
+			running_outputs = out;
+		}
+		else
+			discard_output(out);
+	}
+	if (bSuccess == 0)
 		return -1;
-	WaitForSingleObject(processInfo.hProcess,INFINITE);
-	exitCode = -1;
-	GetExitCodeProcess(processInfo.hProcess,&exitCode);
-	CloseHandle(processInfo.hProcess);
 	CloseHandle(processInfo.hThread);
-	if (hFile != INVALID_HANDLE_VALUE) {
-		CloseHandle(hFile);
+	*phandle = processInfo.hProcess;
+	return 0;
+}
+
+BOOL apply_resources(HANDLE hProcess,const resource_class* res)
+{
+	/* niceness maps to priority classes and the address space limit to a job
+	   memory limit; CPUs past the first 64, I/O classes and other limits are
+	   not supported */
+	if (res->flags & RESOURCE_CPUS) {
+		int i;
+		DWORD_PTR mask = 0;
+		for (i = 0;i < 64 && i < RESOURCE_MAX_CPUS;++i)
+			if (res->cpus[i / (8*sizeof(unsigned long))] & (1UL << (i % (8*sizeof(unsigned long)))))
+				mask |= (DWORD_PTR)1 << i;
+		if ( !SetProcessAffinityMask(hProcess,mask) )
+			return FALSE;
 	}
-	destroy_stringbuf(&cmdLine);
-	return (int)exitCode;
-}
\ No newline at end of file
+	if (res->flags & RESOURCE_NICE) {
+		DWORD dwClass;
+		if (res->nice >= 10)
+			dwClass = IDLE_PRIORITY_CLASS;
+		else if (res->nice > 0)
+			dwClass = BELOW_NORMAL_PRIORITY_CLASS;
+		else if (res->nice <= -10)
+			dwClass = HIGH_PRIORITY_CLASS;
+		else if (res->nice < 0)
+			dwClass = ABOVE_NORMAL_PRIORITY_CLASS;
+		else
+			dwClass = NORMAL_PRIORITY_CLASS;
+		if ( !SetPriorityClass(hProcess,dwClass) )
+			return FALSE;
+	}
+	if ((res->flags & RESOURCE_LIMIT(LIMIT_AS)) && res->limits[LIMIT_AS] >= 0) {
+		/* the job lives on while the process is assigned to it */
+		BOOL bSuccess;
+		HANDLE hJob;
+		JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+		hJob = CreateJobObject(NULL,NULL);
+		if (hJob == NULL)
+			return FALSE;
+		ZeroMemory(&limits,sizeof(limits));
+		limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+		limits.ProcessMemoryLimit = (SIZE_T)res->limits[LIMIT_AS];
+		bSuccess = SetInformationJobObject(hJob,JobObjectExtendedLimitInformation,&limits,sizeof(limits))
+			&& AssignProcessToJobObject(hJob,hProcess);
+		CloseHandle(hJob);
+		if ( !bSuccess )
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void record_usage(HANDLE hProcess,child_usage* pusage)
+{
+	/* FILETIME values are in 100 nanosecond units */
+	FILETIME creation, exit, kernel, user;
+	PROCESS_MEMORY_COUNTERS counters;
+	memset(pusage,0,sizeof(child_usage));
+	pusage->count = 1;
+	if ( GetProcessTimes(hProcess,&creation,&exit,&kernel,&user) ) {
+		pusage->user_usec = (((long long)user.dwHighDateTime << 32) | user.dwLowDateTime) / 10;
+		pusage->sys_usec = (((long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) / 10;
+	}
+	if ( GetProcessMemoryInfo(hProcess,&counters,sizeof(counters)) )
+		pusage->max_rss_kib = counters.PeakWorkingSetSize / 1024;
+	add_child_usage(pusage);
+}
+
+int wait_compiler(const process_handle* handles,int count,int* pcode,child_usage* pusage)
+{
+	DWORD dwResult;
+	DWORD exitCode;
+	dwResult = WaitForMultipleObjects((DWORD)count,handles,FALSE,INFINITE);
+	if (dwResult < WAIT_OBJECT_0 || dwResult >= WAIT_OBJECT_0+(DWORD)count)
+		return -1;
+	exitCode = -1;
+	GetExitCodeProcess(handles[dwResult-WAIT_OBJECT_0],&exitCode);
+	record_usage(handles[dwResult-WAIT_OBJECT_0],pusage);
+	*pcode = (int)exitCode;
+	/* the tee pump is finished first since it writes to the captured output */
+	finish_output(handles[dwResult-WAIT_OBJECT_0],pcode);
+	finish_capture(handles[dwResult-WAIT_OBJECT_0]);
+	CloseHandle(handles[dwResult-WAIT_OBJECT_0]);
+	return (int)(dwResult-WAIT_OBJECT_0);
+}
+
+redirect_output* open_output(const char* redirect,int tee,HANDLE* phChild)
+{
+	HANDLE hRead, hWrite;
+	SECURITY_ATTRIBUTES secattribs;
+	redirect_output* out;
+	out = heap_alloc(sizeof(redirect_output));
+	init_stringbuf(&out->dest);
+	init_stringbuf(&out->temp);
+	assign_stringbuf(&out->dest,redirect);
+	assign_stringbuf(&out->temp,redirect);
+	concat_stringbuf(&out->temp,OUTPUT_TEMP_SUFFIX);
+	out->hProcess = NULL;
+	out->hPipe = NULL;
+	out->hPump = NULL;
+	out->hTee = GetStdHandle(STD_OUTPUT_HANDLE);
+	out->failed = 0;
+	out->next = NULL;
+	/* the file is only inherited by the child if it writes to it directly */
+	ZeroMemory(&secattribs,sizeof(SECURITY_ATTRIBUTES));
+	secattribs.nLength = sizeof(SECURITY_ATTRIBUTES);
+	secattribs.bInheritHandle = tee ? FALSE : TRUE;
+	out->hFile = CreateFile(out->temp.buffer,GENERIC_WRITE,FILE_SHARE_WRITE,&secattribs,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+	if (out->hFile == INVALID_HANDLE_VALUE) {
+		fprintf(stderr,"%s: error: cannot open redirect file '%s'\n",PROGRAM_NAME,redirect);
+		discard_output(out);
+		return NULL;
+	}
+	*phChild = out->hFile;
+	if (tee) {
+		secattribs.bInheritHandle = TRUE;
+		if ( !CreatePipe(&hRead,&hWrite,&secattribs,0) ) {
+			fprintf(stderr,"%s: error: cannot create pipe for '%s'\n",PROGRAM_NAME,redirect);
+			discard_output(out);
+			return NULL;
+		}
+		SetHandleInformation(hRead,HANDLE_FLAG_INHERIT,0);
+		out->hPipe = hRead;
+		*phChild = hWrite;
+	}
+	return out;
+}
+
+void discard_output(redirect_output* out)
+{
+	if (out->hPipe != NULL)
+		CloseHandle(out->hPipe);
+	if (out->hTee != GetStdHandle(STD_OUTPUT_HANDLE))
+		CloseHandle(out->hTee);
+	if (out->hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(out->hFile);
+		DeleteFile(out->temp.buffer);
+	}
+	destroy_stringbuf(&out->temp);
+	destroy_stringbuf(&out->dest);
+	heap_free(out);
+}
+
+void finish_output(HANDLE hProcess,int* pcode)
+{
+	/* replace the redirect file with the output of a successful compiler */
+	redirect_output* out;
+	redirect_output** link;
+	link = &running_outputs;
+	while (*link!=NULL && (*link)->hProcess!=hProcess)
+		link = &(*link)->next;
+	out = *link;
+	if (out == NULL)
+		return;
+	*link = out->next;
+	if (out->hPump != NULL) {
+		/* the pump finishes once every writer has closed the pipe */
+		WaitForSingleObject(out->hPump,INFINITE);
+		CloseHandle(out->hPump);
+	}
+	if (out->hTee != GetStdHandle(STD_OUTPUT_HANDLE)) {
+		/* a captured output reaches its end once the pump lets go of it */
+		CloseHandle(out->hTee);
+		out->hTee = GetStdHandle(STD_OUTPUT_HANDLE);
+	}
+	if (out->hPipe != NULL) {
+		CloseHandle(out->hPipe);
+		out->hPipe = NULL;
+	}
+	CloseHandle(out->hFile);
+	out->hFile = INVALID_HANDLE_VALUE;
+	if (*pcode==0 && out->failed) {
+		fprintf(stderr,"%s: error: cannot write redirect file '%s'\n",PROGRAM_NAME,out->dest.buffer);
+		*pcode = 1;
+	}
+	else if (*pcode==0 && !MoveFileEx(out->temp.buffer,out->dest.buffer,MOVEFILE_REPLACE_EXISTING)) {
+		fprintf(stderr,"%s: error: cannot replace redirect file '%s'\n",PROGRAM_NAME,out->dest.buffer);
+		*pcode = 1;
+	}
+	if (*pcode != 0)
+		DeleteFile(out->temp.buffer);
+	discard_output(out);
+}
+
+DWORD WINAPI pump_output(LPVOID arg)
+{
+	/* copy the compiler's output to the temporary file and to our standard
+	   output; Windows has no equivalent of splice() for anonymous pipes */
+	DWORD dwRead, dwWritten;
+	char ibuf[65536];
+	redirect_output* out = arg;
+	while (ReadFile(out->hPipe,ibuf,sizeof(ibuf),&dwRead,NULL) && dwRead > 0) {
+		if (!out->failed && (!WriteFile(out->hFile,ibuf,dwRead,&dwWritten,NULL) || dwWritten != dwRead))
+			out->failed = 1;
+		WriteFile(out->hTee,ibuf,dwRead,&dwWritten,NULL);
+	}
+	return 0;
+}
+
+captured_output* open_capture(int lines,const char* label,HANDLE* phChildren)
+{
+	/* the write ends are inherited by the child; there is no pty here, so
+	   compilers see pipes rather than a console */
+	int i;
+	HANDLE hRead;
+	SECURITY_ATTRIBUTES secattribs;
+	captured_output* cap;
+	static int initialized = 0;
+	if ( !initialized ) {
+		InitializeCriticalSection(&capture_lock);
+		initialized = 1;
+	}
+	cap = heap_alloc(sizeof(captured_output));
+	cap->hProcess = NULL;
+	cap->lines = lines;
+	cap->next = NULL;
+	for (i = 0;i < 2;++i) {
+		cap->streams[i].hPipe = NULL;
+		cap->streams[i].hReader = NULL;
+		cap->streams[i].dwDest = i == 0 ? STD_OUTPUT_HANDLE : STD_ERROR_HANDLE;
+		cap->streams[i].owner = cap;
+		init_stringbuf(&cap->streams[i].text);
+	}
+	init_stringbuf(&cap->label);
+	assign_stringbuf(&cap->label,label);
+	ZeroMemory(&secattribs,sizeof(SECURITY_ATTRIBUTES));
+	secattribs.nLength = sizeof(SECURITY_ATTRIBUTES);
+	secattribs.bInheritHandle = TRUE;
+	for (i = 0;i < 2;++i) {
+		if ( !CreatePipe(&hRead,phChildren+i,&secattribs,0) ) {
+			fprintf(stderr,"%s: error: cannot create pipe for the output of '%s'\n",PROGRAM_NAME,label);
+			if (i == 1)
+				CloseHandle(phChildren[0]);
+			discard_capture(cap);
+			return NULL;
+		}
+		SetHandleInformation(hRead,HANDLE_FLAG_INHERIT,0);
+		cap->streams[i].hPipe = hRead;
+	}
+	return cap;
+}
+
+void discard_capture(captured_output* cap)
+{
+	int i;
+	for (i = 0;i < 2;++i) {
+		if (cap->streams[i].hPipe != NULL)
+			CloseHandle(cap->streams[i].hPipe);
+		destroy_stringbuf(&cap->streams[i].text);
+	}
+	destroy_stringbuf(&cap->label);
+	heap_free(cap);
+}
+
+DWORD WINAPI read_capture(LPVOID arg)
+{
+	DWORD dwRead;
+	capture_stream* stream = arg;
+	stringbuf* text = &stream->text;
+	while (1) {
+		reserve_stringbuf(text,text->used+65536);
+		if (!ReadFile(stream->hPipe,text->buffer+text->used,65536,&dwRead,NULL) || dwRead==0)
+			break;
+		text->used += (int)dwRead;
+		text->buffer[text->used] = 0;
+		if (stream->owner->lines)
+			write_capture(stream,0);
+	}
+	return 0;
+}
+
+void write_capture(capture_stream* stream,int final)
+{
+	/* in line mode only complete lines are written until the end; the lock
+	   keeps the lines of concurrent compilers whole */
+	int n;
+	DWORD dwWritten;
+	stringbuf* text = &stream->text;
+	n = text->used;
+	if (!final) {
+		while (n>0 && text->buffer[n-1]!='\n')
+			--n;
+	}
+	if (n == 0)
+		return;
+	EnterCriticalSection(&capture_lock);
+	fflush(stdout);
+	WriteFile(GetStdHandle(stream->dwDest),text->buffer,(DWORD)n,&dwWritten,NULL);
+	LeaveCriticalSection(&capture_lock);
+	memmove(text->buffer,text->buffer+n,text->used-n);
+	truncate_stringbuf(text,text->used-n);
+}
+
+void finish_capture(HANDLE hProcess)
+{
+	/* the readers finish once the compiler has closed its output; a block
+	   is written with a header that names its job */
+	int i;
+	captured_output* cap;
+	captured_output** link;
+	link = &running_captures;
+	while (*link!=NULL && (*link)->hProcess!=hProcess)
+		link = &(*link)->next;
+	cap = *link;
+	if (cap == NULL)
+		return;
+	*link = cap->next;
+	for (i = 0;i < 2;++i) {
+		if (cap->streams[i].hReader != NULL) {
+			WaitForSingleObject(cap->streams[i].hReader,INFINITE);
+			CloseHandle(cap->streams[i].hReader);
+		}
+		else /* the thread could not be started */
+			read_capture(cap->streams+i);
+	}
+	if (!cap->lines && (cap->streams[0].text.used>0 || cap->streams[1].text.used>0)) {
+		fprintf(stderr,"==> %s <==\n",cap->label.buffer);
+		fflush(stderr);
+	}
+	for (i = 0;i < 2;++i)
+		write_capture(cap->streams+i,1);
+	discard_capture(cap);
+}
+
+int get_file_time(const char* fileName,file_time* ptime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attribs;
+	if ( !GetFileAttributesEx(fileName,GetFileExInfoStandard,&attribs) )
+		return -1;
+	*ptime = ((file_time)attribs.ftLastWriteTime.dwHighDateTime << 32) | attribs.ftLastWriteTime.dwLowDateTime;
+	return 0;
+}
+
+void get_working_directory(stringbuf* dest)
+{
+	DWORD dwLength;
+	while ((dwLength = GetCurrentDirectory(dest->size,dest->buffer)) >= (DWORD)dest->size)
+		grow_stringbuf(dest);
+	if (dwLength == 0)
+		fatal_stop("cannot determine current directory");
+	dest->used = (int)dwLength;
+}
+
+int make_directory(const char* dirName)
+{
+	DWORD dwAttr;
+	if ( CreateDirectory(dirName,NULL) )
+		return 0;
+	dwAttr = GetFileAttributes(dirName);
+	if (dwAttr!=INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_DIRECTORY))
+		return 0;
+	return -1;
+}
+
+int find_program(const char* program,stringbuf* dest,file_time* ptime)
+{
+	DWORD dwLength;
+	while ((dwLength = SearchPath(NULL,program,".exe",dest->size,dest->buffer,NULL)) >= (DWORD)dest->size)
+		grow_stringbuf(dest);
+	if (dwLength == 0)
+		return -1;
+	dest->used = (int)dwLength;
+	return get_file_time(dest->buffer,ptime);
+}
+
+int get_processor_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
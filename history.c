@@ -0,0 +1,358 @@
+/* history.c */
+#include "history.h"
+#include "settings.h"
+#include "cache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define HISTORY_WINDOW 3 /* a job is expected to take the mean wall time of its last few runs */
+#define HISTORY_SAMPLES 8 /* runs kept for each target when the history file is compacted */
+#define HISTORY_MAX_SIZE (1024*1024) /* the history file is compacted to half this many bytes when it grows beyond it */
+
+extern const char* PROGRAM_NAME;
+
+/* history_sample - a line of the history file, which holds the key, the
+   time, the wall time in microseconds, the peak RSS in KiB, the rule and
+   the target separated by spaces */
+typedef struct {
+    unsigned long long key; /* hash of the rule and target */
+    long long time; /* when the job finished in seconds since the epoch */
+    long long wall_usec;
+    long long rss_kib;
+    const char* line; /* the whole line; later runs of a target have later lines */
+    const char* name; /* the rule and target */
+} history_sample;
+
+/* history_table - the history file loaded into memory */
+typedef struct {
+    arena pool;
+    stringbuf contents; /* the file with the newline of each line replaced by a null character */
+    history_sample* samples; /* sorted by key and then by line */
+    int count;
+} history_table;
+
+/* history_target - the runs of one target in a history_table */
+typedef struct {
+    const history_sample* first; /* the earliest run */
+    int count;
+} history_target;
+
+/* data internal to this unit */
+static stringbuf pending; /* lines recorded by this process; written by close_history() */
+static int pending_init = 0;
+static history_table loaded; /* read by the first lookup */
+static int history_loaded = 0;
+
+/* functions internal to this unit */
+static const char* get_history_path();
+static unsigned long long history_key(const char* rule,const char* target);
+static void read_history(history_table* ptable);
+static void destroy_history(history_table* ptable);
+static int list_targets(history_table* ptable,history_target** ptargets); /* returns the number of targets */
+static long long mean_wall_time(const history_sample* samples,int count);
+static void compact_history();
+static int compare_samples(const void* left,const void* right);
+static int compare_recent(const void* left,const void* right);
+static int compare_slowest(const void* left,const void* right);
+static int rename_history_file(const char* src,const char* dest); /* system-specific implementation - replaces dest; returns 0 on success */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#define PATH_SEPARATOR "/"
+#include "history_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#define PATH_SEPARATOR "\\"
+#include "history_windows.c"
+#endif
+
+/* platform-independent code */
+
+long long lookup_history(const char* rule,const char* target)
+{
+    /* the history file is read once by the first lookup and kept until
+       close_history() */
+    int lo, hi, mid;
+    int end;
+    unsigned long long key;
+    if (!history_loaded) {
+        read_history(&loaded);
+        history_loaded = 1;
+    }
+    key = history_key(rule,target);
+    lo = 0;
+    hi = loaded.count;
+    while (lo < hi) {
+        mid = lo + (hi-lo)/2;
+        if (loaded.samples[mid].key < key)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    for (end = lo;end<loaded.count && loaded.samples[end].key==key;++end)
+        ;
+    if (end == lo)
+        return -1;
+    if (end-lo > HISTORY_WINDOW)
+        lo = end-HISTORY_WINDOW;
+    return mean_wall_time(loaded.samples+lo,end-lo);
+}
+
+void record_history(const char* rule,const char* target,long long wall_usec,long long rss_kib)
+{
+    char prefix[100];
+    if (strchr(target,'\n') != NULL)
+        return;
+    if (!pending_init) {
+        init_stringbuf(&pending);
+        pending_init = 1;
+    }
+    sprintf(prefix,"%016llx %lld %lld %lld ",history_key(rule,target),(long long)time(NULL),wall_usec,rss_kib);
+    concat_stringbuf(&pending,prefix);
+    concat_stringbuf(&pending,rule);
+    concat_stringbuf(&pending," ");
+    concat_stringbuf(&pending,target);
+    concat_stringbuf(&pending,"\n");
+}
+
+void close_history()
+{
+    /* the lines are appended with a single write so that the lines of
+       concurrent processes do not interleave; the file is compacted once it
+       has grown too large */
+    long size;
+    FILE* fp;
+    if (history_loaded) {
+        destroy_history(&loaded);
+        history_loaded = 0;
+    }
+    if (!pending_init)
+        return;
+    size = 0;
+    fp = fopen(get_history_path(),"ab");
+    if (fp != NULL) {
+        setvbuf(fp,NULL,_IONBF,0);
+        if (fwrite(pending.buffer,1,pending.used,fp) == (size_t)pending.used)
+            size = ftell(fp);
+        fclose(fp);
+    }
+    if (size <= 0)
+        fprintf(stderr,"%s: warning: cannot write history file '%s'\n",PROGRAM_NAME,get_history_path());
+    destroy_stringbuf(&pending);
+    pending_init = 0;
+    if (size > HISTORY_MAX_SIZE)
+        compact_history();
+}
+
+void print_history(int count)
+{
+    /* the targets are listed by the wall time of their latest run; the trend
+       compares the mean wall time of the later half of the runs that are
+       kept with that of the earlier half */
+    int i, j;
+    int n;
+    int half;
+    long long rss;
+    long long older, recent;
+    char trend[32];
+    history_table table;
+    history_target* targets;
+    const history_target* t;
+    read_history(&table);
+    n = list_targets(&table,&targets);
+    qsort(targets,n,sizeof(history_target),&compare_slowest);
+    printf("history file: %s\n",get_history_path());
+    printf("targets: %d\n",n);
+    printf("runs: %d\n",table.count);
+    if (n > 0)
+        printf("%10s %10s %7s %12s %5s  %s\n","last","mean","trend","peak RSS","runs","rule and target");
+    for (i = 0;i<n && i<count;++i) {
+        t = targets+i;
+        rss = 0;
+        for (j = 0;j < t->count;++j)
+            if (t->first[j].rss_kib > rss)
+                rss = t->first[j].rss_kib;
+        strcpy(trend,"-");
+        if (t->count >= 2) {
+            half = t->count/2;
+            older = mean_wall_time(t->first,half);
+            recent = mean_wall_time(t->first+half,t->count-half);
+            if (older > 0)
+                sprintf(trend,"%+d%%",(int)(100.0 * (recent-older) / older));
+        }
+        printf("%9.3fs %9.3fs %7s %8lld KiB %5d  %s\n",t->first[t->count-1].wall_usec / 1e6,
+            mean_wall_time(t->first,t->count) / 1e6,trend,rss,t->count,t->first[t->count-1].name);
+    }
+    destroy_history(&table);
+}
+
+/* definitions of internal functions */
+
+const char* get_history_path()
+{
+    static char fileName[FILENAME_MAX];
+    if (fileName[0] == 0) {
+        strcpy(fileName,get_settings_directory());
+        strcat(fileName,PATH_SEPARATOR "history");
+    }
+    return fileName;
+}
+
+unsigned long long history_key(const char* rule,const char* target)
+{
+    cache_key key;
+    init_cache_key(&key);
+    hash_cache_key(&key,rule,strlen(rule)+1);
+    hash_cache_key(&key,target,strlen(target)+1);
+    return key.hash[0];
+}
+
+void read_history(history_table* ptable)
+{
+    /* lines that cannot be parsed (e.g. one cut short by a full disk) are
+       skipped */
+    int n;
+    int offset;
+    size_t m;
+    char* iter;
+    char* end;
+    char ibuf[4096];
+    FILE* fp;
+    history_sample* psample;
+    init_arena(&ptable->pool);
+    init_stringbuf_arena(&ptable->contents,&ptable->pool);
+    ptable->samples = NULL;
+    ptable->count = 0;
+    fp = fopen(get_history_path(),"rb");
+    if (fp == NULL)
+        return;
+    while ((m = fread(ibuf,1,sizeof(ibuf),fp)) > 0)
+        append_stringbuf(&ptable->contents,ibuf,(int)m);
+    fclose(fp);
+    n = 0;
+    for (iter = ptable->contents.buffer;(iter = memchr(iter,'\n',ptable->contents.buffer+ptable->contents.used-iter)) != NULL;++iter)
+        ++n;
+    ptable->samples = arena_alloc(&ptable->pool,(n+1)*sizeof(history_sample));
+    iter = ptable->contents.buffer;
+    while ((end = memchr(iter,'\n',ptable->contents.buffer+ptable->contents.used-iter)) != NULL) {
+        *end = 0;
+        psample = ptable->samples+ptable->count;
+        offset = 0;
+        if (sscanf(iter,"%llx %lld %lld %lld %n",&psample->key,&psample->time,&psample->wall_usec,
+                &psample->rss_kib,&offset) == 4 && offset > 0 && strchr(iter+offset,' ') != NULL) {
+            psample->line = iter;
+            psample->name = iter+offset;
+            ++ptable->count;
+        }
+        iter = end+1;
+    }
+    qsort(ptable->samples,ptable->count,sizeof(history_sample),&compare_samples);
+}
+
+void destroy_history(history_table* ptable)
+{
+    /* the contents and samples are released with the table's arena */
+    destroy_arena(&ptable->pool);
+    ptable->samples = NULL;
+    ptable->count = 0;
+}
+
+int list_targets(history_table* ptable,history_target** ptargets)
+{
+    int i;
+    int n;
+    n = 0;
+    *ptargets = arena_alloc(&ptable->pool,(ptable->count+1)*sizeof(history_target));
+    for (i = 0;i < ptable->count;++i) {
+        if (i==0 || ptable->samples[i].key!=ptable->samples[i-1].key) {
+            (*ptargets)[n].first = ptable->samples+i;
+            (*ptargets)[n++].count = 0;
+        }
+        ++(*ptargets)[n-1].count;
+    }
+    return n;
+}
+
+long long mean_wall_time(const history_sample* samples,int count)
+{
+    int i;
+    long long total;
+    total = 0;
+    for (i = 0;i < count;++i)
+        total += samples[i].wall_usec;
+    return total / count;
+}
+
+void compact_history()
+{
+    /* keep the latest runs of the most recently run targets; the history is
+       written to a temporary file that is renamed over the history file so
+       that readers never see a partially written file */
+    int i, j;
+    int n;
+    long size;
+    FILE* fp;
+    stringbuf temp;
+    history_table table;
+    history_target* targets;
+    read_history(&table);
+    n = list_targets(&table,&targets);
+    qsort(targets,n,sizeof(history_target),&compare_recent);
+    init_stringbuf(&temp);
+    assign_stringbuf(&temp,get_history_path());
+    concat_stringbuf(&temp,".tmp");
+    fp = fopen(temp.buffer,"wb");
+    if (fp != NULL) {
+        size = 0;
+        for (i = 0;i<n && size<HISTORY_MAX_SIZE/2;++i) {
+            j = targets[i].count > HISTORY_SAMPLES ? targets[i].count-HISTORY_SAMPLES : 0;
+            for (;j < targets[i].count;++j)
+                size += fprintf(fp,"%s\n",targets[i].first[j].line);
+        }
+        if (fclose(fp)!=0 || rename_history_file(temp.buffer,get_history_path())!=0)
+            remove(temp.buffer);
+    }
+    destroy_stringbuf(&temp);
+    destroy_history(&table);
+}
+
+int compare_samples(const void* left,const void* right)
+{
+    const history_sample* a = left;
+    const history_sample* b = right;
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    if (a->line < b->line)
+        return -1;
+    return a->line > b->line;
+}
+
+int compare_recent(const void* left,const void* right)
+{
+    /* the most recently run target comes first */
+    const history_target* a = left;
+    const history_target* b = right;
+    long long ta = a->first[a->count-1].time;
+    long long tb = b->first[b->count-1].time;
+    if (ta > tb)
+        return -1;
+    return ta < tb;
+}
+
+int compare_slowest(const void* left,const void* right)
+{
+    /* the target whose latest run took longest comes first */
+    const history_target* a = left;
+    const history_target* b = right;
+    long long wa = a->first[a->count-1].wall_usec;
+    long long wb = b->first[b->count-1].wall_usec;
+    if (wa != wb)
+        return wa > wb ? -1 : 1;
+    return strcmp(a->first[a->count-1].name,b->first[b->count-1].name);
+}
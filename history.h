@@ -0,0 +1,13 @@
+/* history.h */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/* job history; the wall time and peak resident set size of each finished
+   job are kept in the 'history' file of the settings directory under the
+   job's rule (its program) and its first target (a full path) */
+long long lookup_history(const char* rule,const char* target); /* returns the expected wall time in microseconds or -1 if the job has no history */
+void record_history(const char* rule,const char* target,long long wall_usec,long long rss_kib);
+void close_history(); /* append the jobs recorded by this process to the history file */
+void print_history(int count); /* report the 'count' slowest targets and their trends */
+
+#endif
@@ -0,0 +1,6 @@
+/* history_posix.c */
+
+int rename_history_file(const char* src,const char* dest)
+{
+    return rename(src,dest);
+}
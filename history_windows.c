@@ -0,0 +1,7 @@
+/* history_windows.c */
+#include <Windows.h>
+
+int rename_history_file(const char* src,const char* dest)
+{
+	return MoveFileEx(src,dest,MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+}
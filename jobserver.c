@@ -0,0 +1,107 @@
+/* jobserver.c */
+#include "jobserver.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define MAX_HELD_TOKENS 1024
+
+/* data internal to this unit */
+static int jobserver_loaded = 0;
+static int jobserver_active = 0; /* non-zero if MAKEFLAGS named a usable jobserver */
+static int implicit_token_free = 1;
+static int held_tokens_c = 0;
+static char held_tokens[MAX_HELD_TOKENS]; /* bytes read from the jobserver; they are written back unchanged */
+
+/* functions internal to this unit */
+static void load_jobserver();
+static int open_jobserver(const char* auth); /* system-specific implementation - returns 0 on success */
+static int take_token(char* ptoken); /* system-specific implementation - returns 0 on success; does not block */
+static void give_token(char token); /* system-specific implementation */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#include "jobserver_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#include "jobserver_windows.c"
+#endif
+
+/* platform-independent code */
+
+int acquire_job_token()
+{
+    if ( !jobserver_loaded )
+        load_jobserver();
+    if ( implicit_token_free ) {
+        implicit_token_free = 0;
+        return 0;
+    }
+    if ( !jobserver_active )
+        return 0;
+    if (held_tokens_c>=MAX_HELD_TOKENS || take_token(held_tokens+held_tokens_c)!=0)
+        return -1;
+    ++held_tokens_c;
+    return 0;
+}
+
+void release_job_token()
+{
+    /* tokens from the jobserver go back first so that other recipes may
+       use them as soon as possible */
+    if (held_tokens_c > 0)
+        give_token(held_tokens[--held_tokens_c]);
+    else
+        implicit_token_free = 1;
+}
+
+void reset_job_tokens()
+{
+    implicit_token_free = 1;
+    held_tokens_c = 0;
+}
+
+int get_jobserver_auth(char* value,int size)
+{
+    /* the last --jobserver-auth option in MAKEFLAGS is the one that applies;
+       make before 4.2 called it --jobserver-fds */
+    size_t n;
+    const char* flags;
+    const char* iter;
+    const char* auth;
+    flags = getenv("MAKEFLAGS");
+    if (flags == NULL)
+        return -1;
+    auth = NULL;
+    for (iter = flags;*iter;++iter) {
+        if (strncmp(iter,"--jobserver-auth=",17) == 0)
+            auth = iter+17;
+        else if (strncmp(iter,"--jobserver-fds=",16) == 0)
+            auth = iter+16;
+    }
+    if (auth == NULL)
+        return -1;
+    n = strcspn(auth," ");
+    if (n >= (size_t)size)
+        return -1;
+    memcpy(value,auth,n);
+    value[n] = 0;
+    return 0;
+}
+
+/* definitions of internal functions */
+
+void load_jobserver()
+{
+    char value[FILENAME_MAX];
+    jobserver_loaded = 1;
+    if (get_jobserver_auth(value,sizeof(value)) != 0)
+        return;
+    /* make names the jobserver even in recipes that it closes the
+       descriptors for, so an unusable jobserver is silently ignored */
+    jobserver_active = open_jobserver(value) == 0;
+}
@@ -0,0 +1,16 @@
+/* jobserver.h */
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+/* client of the GNU make jobserver: when compile runs in a recipe of
+   'make -jN', make gives it one implicit token; every compiler that runs at
+   the same time as another must hold a token taken from the jobserver named
+   by --jobserver-auth in MAKEFLAGS; without a jobserver tokens are always
+   available; the jobserver's descriptors stay open for compilers that take
+   part in the protocol themselves (e.g. 'gcc -flto=jobserver') */
+int acquire_job_token(); /* returns 0 if a token was taken or -1 if none is available right now */
+void release_job_token(); /* return the most recently taken token */
+void reset_job_tokens(); /* in a forked child: the child holds only its implicit token */
+int get_jobserver_auth(char* value,int size); /* copy the value of MAKEFLAGS' --jobserver-auth (e.g. "3,4" or "fifo:PATH"); returns 0 if there is one */
+
+#endif
@@ -0,0 +1,65 @@
+/* jobserver_posix.c */
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+/* data internal to this file */
+static int token_read_fd = -1;
+static int token_write_fd = -1;
+static int token_read_shared = 0; /* non-zero if reads use make's file description, which must stay blocking */
+
+int open_jobserver(const char* auth)
+{
+    /* the fifo form (make 4.4) is opened by name; in the pipe form the
+       descriptors are inherited from make; they are left open and
+       inheritable so that compilers can use the jobserver as well */
+    int r, w;
+    char path[64];
+    if (strncmp(auth,"fifo:",5) == 0) {
+        token_read_fd = open(auth+5,O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        token_write_fd = token_read_fd;
+        return token_read_fd == -1 ? -1 : 0;
+    }
+    if (sscanf(auth,"%d,%d",&r,&w) != 2 || r < 0 || w < 0)
+        return -1;
+    /* make closes the descriptors for commands that it does not consider
+       recursive */
+    if (fcntl(r,F_GETFD) == -1 || fcntl(w,F_GETFD) == -1)
+        return -1;
+    /* reading a pipe through a file description of our own lets us read
+       without blocking and without changing make's description */
+    sprintf(path,"/proc/self/fd/%d",r);
+    token_read_fd = open(path,O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (token_read_fd == -1) {
+        token_read_fd = r;
+        token_read_shared = 1;
+    }
+    token_write_fd = w;
+    return 0;
+}
+
+int take_token(char* ptoken)
+{
+    ssize_t n;
+    struct pollfd pfd;
+    if ( token_read_shared ) {
+        /* another client may still take the token between poll() and read(),
+           in which case read() waits for the next one */
+        pfd.fd = token_read_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd,1,0) <= 0)
+            return -1;
+    }
+    do {
+        n = read(token_read_fd,ptoken,1);
+    } while (n == -1 && errno == EINTR);
+    return n == 1 ? 0 : -1;
+}
+
+void give_token(char token)
+{
+    while (write(token_write_fd,&token,1) == -1 && errno == EINTR)
+        ;
+}
@@ -0,0 +1,22 @@
+/* jobserver_windows.c */
+#include <Windows.h>
+
+/* data internal to this file */
+static HANDLE hTokens = NULL; /* semaphore named by --jobserver-auth */
+
+int open_jobserver(const char* auth)
+{
+	hTokens = OpenSemaphore(SEMAPHORE_ALL_ACCESS,FALSE,auth);
+	return hTokens == NULL ? -1 : 0;
+}
+
+int take_token(char* ptoken)
+{
+	*ptoken = 0;
+	return WaitForSingleObject(hTokens,0) == WAIT_OBJECT_0 ? 0 : -1;
+}
+
+void give_token(char token)
+{
+	ReleaseSemaphore(hTokens,1,NULL);
+}
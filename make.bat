@@ -9,6 +9,15 @@ cl /c /Foobj\compile.obj compile.c /DBUILD_COMPILE_WINDOWS
 cl /c /Foobj\compiler.obj compiler.c /DBUILD_COMPILE_WINDOWS
 cl /c /Foobj\settings.obj settings.c /DBUILD_COMPILE_WINDOWS
 cl /c /Foobj\stringbuf.obj stringbuf.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\cache.obj cache.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\arena.obj arena.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\watch.obj watch.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\server.obj server.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\batch.obj batch.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\jobserver.obj jobserver.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\stats.obj stats.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\worker.obj worker.c /DBUILD_COMPILE_WINDOWS
+cl /c /Foobj\history.obj history.c /DBUILD_COMPILE_WINDOWS
 
 cl /Fecompile.exe obj\*.obj Shell32.lib
 goto end
@@ -0,0 +1,98 @@
+/* server.c */
+#include "server.h"
+#include "settings.h"
+#include "stats.h"
+#include "jobserver.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define REQUEST_MAGIC 0x52504d43 /* "CMPR" */
+#define REQUEST_VERSION 2
+#define MAX_REQUEST_SIZE (16*1024*1024)
+
+extern const char* PROGRAM_NAME;
+
+/* request_header - the fixed part of a request; it is followed by 'size'
+   bytes holding the working directory, each argument and then each
+   environment variable, all null terminated; the response is the command's
+   exit code as an int */
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int argc;
+    int envc;
+    int size;
+    int jobserver[2]; /* the client's descriptors for make's jobserver pipe, which are passed after its standard files; -1 if there are none */
+} request_header;
+
+/* functions internal to this unit */
+static void encode_request(stringbuf* dest,request_header* header,int argc,const char* argv[],const char* cwd,char* const* env);
+static const char** decode_request(const request_header* header,char* payload,const char** pcwd,char*** penv); /* returns NULL if the request is malformed */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#include "server_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#include "server_windows.c"
+#endif
+
+/* definitions of internal functions */
+
+void encode_request(stringbuf* dest,request_header* header,int argc,const char* argv[],const char* cwd,char* const* env)
+{
+    int i;
+    reset_stringbuf(dest);
+    concat_stringbuf(dest,cwd);
+    append_terminator_stringbuf(dest);
+    for (i = 0;i < argc;++i) {
+        concat_stringbuf(dest,argv[i]);
+        append_terminator_stringbuf(dest);
+    }
+    for (i = 0;env[i] != NULL;++i) {
+        concat_stringbuf(dest,env[i]);
+        append_terminator_stringbuf(dest);
+    }
+    header->magic = REQUEST_MAGIC;
+    header->version = REQUEST_VERSION;
+    header->argc = argc;
+    header->envc = i;
+    header->size = dest->used;
+}
+
+const char** decode_request(const request_header* header,char* payload,const char** pcwd,char*** penv)
+{
+    /* the returned argument vector is null terminated like main()'s and is
+       followed by the environment, which is null terminated like environ */
+    int i;
+    char* iter;
+    char* end;
+    char** vec;
+    if (header->magic!=REQUEST_MAGIC || header->version!=REQUEST_VERSION || header->argc<1 || header->envc<0
+        || header->size<=0 || header->size>MAX_REQUEST_SIZE || payload[header->size-1]!=0
+        || header->argc+header->envc > header->size)
+        return NULL;
+    vec = heap_alloc((header->argc+header->envc+2)*sizeof(char*));
+    iter = payload;
+    end = payload+header->size;
+    *pcwd = iter;
+    iter += strlen(iter)+1;
+    for (i = 0;i < header->argc+header->envc;++i) {
+        if (iter >= end) {
+            heap_free(vec);
+            return NULL;
+        }
+        /* the environment starts after the argument vector's terminator */
+        vec[i < header->argc ? i : i+1] = iter;
+        iter += strlen(iter)+1;
+    }
+    vec[header->argc] = NULL;
+    vec[header->argc+header->envc+1] = NULL;
+    *penv = vec+header->argc+1;
+    return (const char**)vec;
+}
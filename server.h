@@ -0,0 +1,19 @@
+/* server.h */
+#ifndef SERVER_H
+#define SERVER_H
+
+/* command_handler - runs a command-line in the current directory once the
+   settings are loaded and returns its exit code */
+typedef int (*command_handler)(int argc,const char* argv[]);
+
+/* run_server - serve command-lines sent by clients over the socket in the
+   settings directory until the server is stopped; each command runs in its
+   own process with the client's working directory and standard files; the
+   settings are reloaded when the targets file changes */
+int run_server(command_handler handler);
+
+/* run_client - send a command-line to a running server; returns -1 if no
+   server could be reached or else 0 with the command's exit code in *pcode */
+int run_client(int argc,const char* argv[],int* pcode);
+
+#endif
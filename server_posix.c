@@ -0,0 +1,370 @@
+/* server_posix.c */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pwd.h>
+
+#define SOCKET_NAME "/.compile/server.sock" /* path relative to home directory */
+#define PASSED_FILES 3 /* the client's standard input, output and error */
+#define MAX_PASSED_FILES 5 /* the standard files and make's jobserver pipe */
+
+extern char** environ;
+
+/* data internal to this file */
+static volatile sig_atomic_t server_stopping = 0;
+
+/* functions internal to this file */
+static int socket_address(struct sockaddr_un* paddr); /* returns 0 on success */
+static int server_running(const struct sockaddr_un* paddr);
+static void stop_server(int signum);
+static int serve_request(int conn,command_handler handler); /* returns the command's exit code */
+static int find_jobserver_pipe(int* fds); /* returns 0 if make's jobserver pipe is open in this process */
+static int install_files(int conn,int* fds,const int* targets,int count); /* returns the new descriptor of the connection */
+static int read_fully(int fd,void* buffer,size_t size); /* returns 0 if all bytes were read */
+
+int run_server(command_handler handler)
+{
+    int fd;
+    int conn;
+    pid_t pid;
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    if (socket_address(&addr) != 0) {
+        fprintf(stderr,"%s: error: cannot determine server socket name\n",PROGRAM_NAME);
+        return 1;
+    }
+    fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if (fd == -1) {
+        fprintf(stderr,"%s: error: cannot create server socket: %s\n",PROGRAM_NAME,strerror(errno));
+        return 1;
+    }
+    if (bind(fd,(struct sockaddr*)&addr,sizeof(addr)) == -1) {
+        /* replace the socket left behind by a server that is no longer running */
+        if (errno==EADDRINUSE && !server_running(&addr)) {
+            unlink(addr.sun_path);
+            if (bind(fd,(struct sockaddr*)&addr,sizeof(addr)) == 0)
+                errno = 0;
+        }
+        if (errno != 0) {
+            if (errno == EADDRINUSE)
+                fprintf(stderr,"%s: error: a server is already running on '%s'\n",PROGRAM_NAME,addr.sun_path);
+            else
+                fprintf(stderr,"%s: error: cannot bind server socket '%s': %s\n",PROGRAM_NAME,addr.sun_path,strerror(errno));
+            close(fd);
+            return 1;
+        }
+    }
+    if (listen(fd,SOMAXCONN) == -1) {
+        fprintf(stderr,"%s: error: cannot listen on server socket: %s\n",PROGRAM_NAME,strerror(errno));
+        close(fd);
+        unlink(addr.sun_path);
+        return 1;
+    }
+    /* request processes are reaped automatically; a stop request interrupts
+       accept() so that the socket can be removed */
+    memset(&sa,0,sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGCHLD,&sa,NULL);
+    sa.sa_handler = &stop_server;
+    sigaction(SIGINT,&sa,NULL);
+    sigaction(SIGTERM,&sa,NULL);
+    sigaction(SIGHUP,&sa,NULL);
+    fprintf(stderr,"%s: serving on '%s'\n",PROGRAM_NAME,addr.sun_path);
+    while (!server_stopping) {
+        conn = accept(fd,NULL,NULL);
+        if (conn == -1) {
+            if (errno==EINTR || errno==ECONNABORTED)
+                continue;
+            fprintf(stderr,"%s: error: cannot accept request: %s\n",PROGRAM_NAME,strerror(errno));
+            break;
+        }
+        fcntl(conn,F_SETFD,FD_CLOEXEC);
+        if ( settings_changed() ) {
+            unload_settings();
+            load_settings_from_file();
+            fprintf(stderr,"%s: reloaded targets file\n",PROGRAM_NAME);
+        }
+        fflush(stdout);
+        pid = fork();
+        if (pid == 0) {
+            close(fd);
+            sa.sa_handler = SIG_DFL;
+            sigaction(SIGCHLD,&sa,NULL);
+            sigaction(SIGINT,&sa,NULL);
+            sigaction(SIGTERM,&sa,NULL);
+            sigaction(SIGHUP,&sa,NULL);
+            _exit(serve_request(conn,handler));
+        }
+        else if (pid == -1)
+            fprintf(stderr,"%s: error: cannot start request process: %s\n",PROGRAM_NAME,strerror(errno));
+        close(conn);
+    }
+    close(fd);
+    unlink(addr.sun_path);
+    return 0;
+}
+
+int run_client(int argc,const char* argv[],int* pcode)
+{
+    int fd;
+    int code;
+    int count;
+    char* cwd;
+    size_t size;
+    int files[MAX_PASSED_FILES];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    struct sockaddr_un addr;
+    request_header header;
+    stringbuf payload;
+    union {
+        char buf[CMSG_SPACE(MAX_PASSED_FILES*sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    if (socket_address(&addr) != 0)
+        return -1;
+    fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd,(struct sockaddr*)&addr,sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    size = 256;
+    cwd = heap_alloc(size);
+    while (getcwd(cwd,size) == NULL) {
+        if (errno != ERANGE) {
+            heap_free(cwd);
+            close(fd);
+            return -1;
+        }
+        size *= 2;
+        cwd = heap_realloc(cwd,size);
+    }
+    init_stringbuf(&payload);
+    encode_request(&payload,&header,argc,argv,cwd,environ);
+    heap_free(cwd);
+    /* the header carries the standard files so that the command writes
+       straight to the client's terminal, and make's jobserver pipe so that
+       the command's compilers take part in the client's 'make -jN' */
+    count = 0;
+    while (count < PASSED_FILES) {
+        files[count] = count;
+        ++count;
+    }
+    header.jobserver[0] = header.jobserver[1] = -1;
+    if (find_jobserver_pipe(header.jobserver) == 0) {
+        files[count++] = header.jobserver[0];
+        files[count++] = header.jobserver[1];
+    }
+    memset(&msg,0,sizeof(msg));
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(count*sizeof(int));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count*sizeof(int));
+    memcpy(CMSG_DATA(cmsg),files,count*sizeof(int));
+    if (sendmsg(fd,&msg,MSG_NOSIGNAL) != sizeof(header)) {
+        /* nothing was run yet so the command can still run locally */
+        destroy_stringbuf(&payload);
+        close(fd);
+        return -1;
+    }
+    size = 0;
+    while (size < (size_t)payload.used) {
+        ssize_t n = send(fd,payload.buffer+size,payload.used-size,MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        size += n;
+    }
+    destroy_stringbuf(&payload);
+    /* a request process that stops on a fatal error closes the connection
+       without sending a code */
+    if (read_fully(fd,&code,sizeof(code)) != 0)
+        code = 1;
+    close(fd);
+    *pcode = code;
+    return 0;
+}
+
+/* definitions of internal functions */
+
+int socket_address(struct sockaddr_un* paddr)
+{
+    /* the socket is in the settings directory under HOME, or under the
+       home directory of the user's account if it is not set */
+    const char* home;
+    struct passwd* pwd;
+    home = getenv("HOME");
+    if (home==NULL || *home==0) {
+        pwd = getpwuid(getuid());
+        if (pwd == NULL)
+            return -1;
+        home = pwd->pw_dir;
+    }
+    if (strlen(home)+strlen(SOCKET_NAME) >= sizeof(paddr->sun_path))
+        return -1;
+    memset(paddr,0,sizeof(struct sockaddr_un));
+    paddr->sun_family = AF_UNIX;
+    strcpy(paddr->sun_path,home);
+    strcat(paddr->sun_path,SOCKET_NAME);
+    return 0;
+}
+
+int server_running(const struct sockaddr_un* paddr)
+{
+    int fd;
+    int result;
+    fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if (fd == -1)
+        return 1;
+    result = connect(fd,(const struct sockaddr*)paddr,sizeof(struct sockaddr_un)) == 0 || errno != ECONNREFUSED;
+    close(fd);
+    return result;
+}
+
+void stop_server(int signum)
+{
+    (void)signum;
+    server_stopping = 1;
+}
+
+int serve_request(int conn,command_handler handler)
+{
+    int code;
+    int count;
+    int fds[MAX_PASSED_FILES];
+    int targets[MAX_PASSED_FILES];
+    char* payload;
+    char** env;
+    const char* cwd;
+    const char** argv;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    request_header header;
+    union {
+        char buf[CMSG_SPACE(MAX_PASSED_FILES*sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&msg,0,sizeof(msg));
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(conn,&msg,0) != sizeof(header))
+        return 1;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    count = header.jobserver[0] >= 0 ? MAX_PASSED_FILES : PASSED_FILES;
+    if (cmsg==NULL || cmsg->cmsg_level!=SOL_SOCKET || cmsg->cmsg_type!=SCM_RIGHTS
+        || cmsg->cmsg_len!=CMSG_LEN(count*sizeof(int)))
+        return 1;
+    memcpy(fds,CMSG_DATA(cmsg),count*sizeof(int));
+    if (header.size<=0 || header.size>MAX_REQUEST_SIZE)
+        return 1;
+    payload = heap_alloc(header.size);
+    if (read_fully(conn,payload,header.size) != 0)
+        return 1;
+    argv = decode_request(&header,payload,&cwd,&env);
+    if (argv == NULL)
+        return 1;
+    /* take on the client's environment, standard files, jobserver pipe and
+       working directory before the command looks up its compilers; the
+       jobserver pipe keeps the descriptor numbers named by MAKEFLAGS */
+    for (count = 0;count < PASSED_FILES;++count)
+        targets[count] = count;
+    if (header.jobserver[0]>PASSED_FILES-1 && header.jobserver[1]>PASSED_FILES-1) {
+        targets[count++] = header.jobserver[0];
+        targets[count++] = header.jobserver[1];
+    }
+    else if (header.jobserver[0] >= 0) {
+        close(fds[PASSED_FILES]);
+        close(fds[PASSED_FILES+1]);
+    }
+    environ = env;
+    fflush(stdout);
+    fflush(stderr);
+    conn = install_files(conn,fds,targets,count);
+    if (chdir(cwd) == -1) {
+        fprintf(stderr,"%s: error: cannot change to directory '%s': %s\n",PROGRAM_NAME,cwd,strerror(errno));
+        code = 1;
+    }
+    else {
+        /* the settings were loaded by the server, not for this command */
+        reset_stats();
+        begin_phase(STATS_TOTAL);
+        code = handler(header.argc,argv);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    send(conn,&code,sizeof(code),MSG_NOSIGNAL);
+    heap_free((void*)argv);
+    heap_free(payload);
+    return code;
+}
+
+int find_jobserver_pipe(int* fds)
+{
+    /* make closes the pipe for commands that it does not consider recursive */
+    char value[64];
+    if (get_jobserver_auth(value,sizeof(value))!=0 || sscanf(value,"%d,%d",fds,fds+1)!=2
+        || fds[0]<PASSED_FILES || fds[1]<PASSED_FILES || fcntl(fds[0],F_GETFD)==-1 || fcntl(fds[1],F_GETFD)==-1) {
+        fds[0] = fds[1] = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int install_files(int conn,int* fds,const int* targets,int count)
+{
+    /* everything is first moved above the target numbers so that installing
+       one descriptor cannot close another that is still needed */
+    int i;
+    int fd;
+    int top;
+    top = 0;
+    for (i = 0;i < count;++i)
+        if (targets[i] >= top)
+            top = targets[i]+1;
+    for (i = 0;i < count;++i) {
+        fd = fcntl(fds[i],F_DUPFD_CLOEXEC,top);
+        close(fds[i]);
+        fds[i] = fd;
+    }
+    fd = fcntl(conn,F_DUPFD_CLOEXEC,top);
+    close(conn);
+    for (i = 0;i < count;++i) {
+        if (fds[i] != -1) {
+            dup2(fds[i],targets[i]);
+            close(fds[i]);
+        }
+    }
+    return fd;
+}
+
+int read_fully(int fd,void* buffer,size_t size)
+{
+    ssize_t n;
+    while (size > 0) {
+        n = read(fd,buffer,size);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buffer = (char*)buffer + n;
+        size -= n;
+    }
+    return 0;
+}
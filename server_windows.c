@@ -0,0 +1,12 @@
+/* server_windows.c */
+
+int run_server(command_handler handler)
+{
+	fprintf(stderr,"%s: error: --server is not supported on this system\n",PROGRAM_NAME);
+	return 1;
+}
+
+int run_client(int argc,const char* argv[],int* pcode)
+{
+	return -1;
+}
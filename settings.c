@@ -1,6 +1,7 @@
 /* settings.c */
 #include "settings.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
@@ -12,24 +13,99 @@
 #define PACKAGE_STRING "compile (build unknown)"
 #endif
 
-#define MAX_COMPILERS 512
+#define SNAPSHOT_MAGIC 0x53504d43 /* "CMPS" */
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_DUPLICATE 0x01 /* rule repeats the extension of an earlier rule */
 
 extern const char* PROGRAM_NAME;
 
+/* file_identity - identifies a version of the targets file; a snapshot is
+   only used if the targets file's identity is unchanged */
+typedef struct {
+    unsigned long long mtime;
+    unsigned long long size;
+    unsigned long long inode;
+    unsigned long long device;
+} file_identity;
+
+/* snapshot_header, snapshot_rule - layout of the binary snapshot of the
+   scanned targets file; the rule records are followed by the extension index
+   and then by a table of null terminated strings addressed by offset */
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int header_size; /* sizeof(snapshot_header) + sizeof(snapshot_rule) of writer */
+    unsigned int rules_c;
+    unsigned int index_size; /* number of slots in the extension index */
+    unsigned int strings_size;
+    file_identity source; /* identity of the targets file that was parsed */
+} snapshot_header;
+
+typedef struct {
+    unsigned int offsets[2]; /* string table offsets: extension, line */
+    int lengths[2]; /* lengths of the strings above */
+    int flags;
+} snapshot_rule;
+
+/* rule_source - the line of the targets file that a rule is parsed from;
+   rules are only parsed when they are first used */
+typedef struct {
+    const char* text; /* in the settings arena or a snapshot; not null terminated */
+    int length;
+    int parsed; /* non-zero once the rule's compiler has been loaded */
+} rule_source;
+
 /* data internal to this unit */
-static compiler loaded_compilers[MAX_COMPILERS];
+static compiler* loaded_compilers = NULL;
 static int loaded_compilers_c = 0;
+static int loaded_compilers_alloc = 0;
+static rule_source* rule_sources = NULL; /* line of each compiler in loaded_compilers */
+/* open-addressing hash index from extension to position in loaded_compilers;
+   empty slots are -1 and the number of slots is a power of two */
+static int* extension_index = NULL;
+static int extension_index_size = 0;
+static arena settings_pool; /* owns the strings of loaded compilers */
+static const char* settings_directory = NULL;
+static const char* targets_file = NULL;
+static file_identity targets_identity; /* identity of the targets file when it was loaded */
+static const char* snapshot_image = NULL; /* mapped snapshot backing loaded_compilers; NULL if scanned */
+static size_t snapshot_image_size = 0;
 static const char* const DEFAULT_TARGET_ENTRIES = ".c gcc -o$project\n";
+static const char* const LIMIT_NAMES[LIMIT_COUNT] = { /* @rlimit_<name> tokens by LIMIT_* index */
+    "as", "core", "cpu", "data", "fsize", "nofile", "stack"
+};
+
+static const char* const OPTION_NAMES[OPTION_END] = { /* $name of each OPTION_* variable */
+    NULL, "project", "depfile", "target", "targets", "dir", "stem", "jobs", "ncpu"
+};
 
 /* functions internal to this unit */
 static void fatal_stop(const char* message); /* system-specific implementation */
 static const char* seek_until_space(const char* iterator);
 static void seek_whitespace(const char** iterator);
+static int load_resource(compiler* pcomp,const char* token,int length); /* returns -1 if the token is not a resource setting */
+static int parse_cpu_list(resource_class* res,const char* list); /* returns 0 on success */
+static int parse_limit(const char* value,long long* plimit); /* returns 0 on success */
+static int scan_options(const char* text,int count,option_token* tokens); /* returns the number of tokens; they are stored if 'tokens' is not NULL */
+static int match_variable(const char* name,int length); /* returns the OPTION_* kind or OPTION_LITERAL if unknown */
 static const char* check_settings_path(); /* system-specific implementation */
 static const char* find_targets_file(const char* settingsDir); /* system-specific implementation */
-static void open_settings_file(const char* fname); /* system-specific implementation */
-static void close_settings_file(); /* system-specific implementation */
-static const char* read_next_entry(); /* system-specific implementation */
+static void load_rules(const char* fname);
+static void load_extension(compiler* pcomp,const char* line,int length);
+static compiler* parse_rule(int position);
+static compiler* append_compiler();
+static unsigned int hash_extension(const char* ext);
+static int find_extension(const char* ext); /* returns position in loaded_compilers or -1 */
+static int index_extension(int position); /* returns -1 if the extension was already indexed */
+static int insert_extension(int position); /* returns -1 if the extension was already indexed */
+static int load_snapshot(const char* fname); /* returns 0 if the snapshot was used */
+static void save_snapshot(const char* fname);
+static int get_file_identity(const char* fname,file_identity* pident); /* system-specific implementation - returns 0 on success */
+static const char* map_snapshot_file(const char* fname,size_t* psize); /* system-specific implementation - returns NULL on failure */
+static void unmap_snapshot_file(const char* image,size_t size); /* system-specific implementation */
+static int map_targets_file(const char* fname,const char** pimage,size_t* psize); /* system-specific implementation - returns 0 on success; an empty file maps to NULL */
+static void unmap_targets_file(const char* image,size_t size); /* system-specific implementation */
+static void write_snapshot_file(const char* fname,const char* image,size_t size); /* system-specific implementation */
 
 /* platform-dependent code */
 
@@ -41,13 +117,24 @@ static const char* read_next_entry(); /* system-specific implementation */
 
 /* platform-independent code */
 
-void init_compiler(compiler* pcomp)
+void init_compiler(compiler* pcomp,arena* pool)
 {
-    init_stringbuf(&pcomp->program);
-    init_stringbuf(&pcomp->options);
-    init_stringbuf(&pcomp->extension);
-    init_stringbuf(&pcomp->redirect);
+    if (pool != NULL) {
+        init_stringbuf_arena(&pcomp->program,pool);
+        init_stringbuf_arena(&pcomp->options,pool);
+        init_stringbuf_arena(&pcomp->extension,pool);
+        init_stringbuf_arena(&pcomp->redirect,pool);
+    }
+    else {
+        init_stringbuf(&pcomp->program);
+        init_stringbuf(&pcomp->options);
+        init_stringbuf(&pcomp->extension);
+        init_stringbuf(&pcomp->redirect);
+    }
     pcomp->options_c = 0;
+    compile_options(&pcomp->options_template,"",0,pool);
+    compile_options(&pcomp->redirect_template,"",0,pool);
+    pcomp->resources.flags = 0;
 }
 
 void destroy_compiler(compiler* pcomp)
@@ -56,9 +143,23 @@ void destroy_compiler(compiler* pcomp)
     destroy_stringbuf(&pcomp->options);
     destroy_stringbuf(&pcomp->extension);
     destroy_stringbuf(&pcomp->redirect);
+    destroy_template(&pcomp->options_template);
+    destroy_template(&pcomp->redirect_template);
     pcomp->options_c = 0;
 }
 
+void move_compiler(compiler* dest,compiler* src)
+{
+    move_stringbuf(&dest->program,&src->program);
+    move_stringbuf(&dest->options,&src->options);
+    move_stringbuf(&dest->extension,&src->extension);
+    move_stringbuf(&dest->redirect,&src->redirect);
+    dest->options_c = src->options_c;
+    dest->options_template = src->options_template;
+    dest->redirect_template = src->redirect_template;
+    dest->resources = src->resources;
+}
+
 void load_compiler(compiler* pcomp,const char* entry)
 {
     /* entry format:
@@ -73,9 +174,9 @@ void load_compiler(compiler* pcomp,const char* entry)
     /* read extension; note: if extension doesn't begin with
        a dot then we add it here */
     if (*entry != '.')
-        concat_stringbuf(&pcomp->extension,".");
-    concat_stringbuf_ex(&pcomp->extension,entry,len);
-    entry = ptr+1;
+        append_char_stringbuf(&pcomp->extension,'.');
+    append_stringbuf(&pcomp->extension,entry,len);
+    entry = ptr;
     seek_whitespace(&entry);
     ptr = seek_until_space(entry);
     len = ptr - entry;
@@ -84,10 +185,12 @@ void load_compiler(compiler* pcomp,const char* entry)
         fatal_stop("syntax error in target file");
     }
     /* read program name */
-    assign_stringbuf_ex(&pcomp->program,entry,len);
+    reset_stringbuf(&pcomp->program);
+    append_stringbuf(&pcomp->program,entry,len);
     /* read options: note that options are optional; special
        option tokens are prefixed by a $ sign followed by an identifier */
     pcomp->options_c = 0;
+    pcomp->resources.flags = 0;
     state = 0;
     while (*ptr) {
         entry = ptr+1;
@@ -106,7 +209,8 @@ void load_compiler(compiler* pcomp,const char* entry)
                 /* The file name token is a part of the current token:
                  *  (e.g. '>output')
                  */
-                assign_stringbuf_ex(&pcomp->redirect,entry+1,len-1);
+                reset_stringbuf(&pcomp->redirect);
+                append_stringbuf(&pcomp->redirect,entry+1,len-1);
             }
             else {
                 /* The file name token will appear as the next token:
@@ -117,12 +221,19 @@ void load_compiler(compiler* pcomp,const char* entry)
             continue;
         }
         if (state == 1) {
-            assign_stringbuf_ex(&pcomp->redirect,entry,len);
+            reset_stringbuf(&pcomp->redirect);
+            append_stringbuf(&pcomp->redirect,entry,len);
             state = 0;
             continue;
         }
 
-        concat_stringbuf_ex(&pcomp->options,entry,len);
+        /* Handle resource tokens (e.g. '@nice=10'). These set up the
+         * scheduling class and limits of the compiler process.
+         */
+        if (entry[0]=='@' && load_resource(pcomp,entry,len)==0)
+            continue;
+
+        append_stringbuf(&pcomp->options,entry,len);
         /* separate the options by a zero byte */
         append_terminator_stringbuf(&pcomp->options);
         ++pcomp->options_c;
@@ -136,74 +247,432 @@ void load_compiler(compiler* pcomp,const char* entry)
     }
 
     /* add a final null terminator to signify the end */
-    len = pcomp->options.used++;
-    while (pcomp->options.used > pcomp->options.size)
-        grow_stringbuf(&pcomp->options);
-    pcomp->options.buffer[len] = 0;
+    append_terminator_stringbuf(&pcomp->options);
+
+    /* Compile the options and the redirect file name once so that each job
+     * expands them by copying spans.
+     */
+    compile_options(&pcomp->options_template,pcomp->options.buffer,pcomp->options_c,pcomp->options.owner);
+    compile_options(&pcomp->redirect_template,pcomp->redirect.buffer,pcomp->redirect.used > 0,pcomp->redirect.owner);
+}
+
+void compile_options(option_template* dest,const char* text,int count,arena* pool)
+{
+    int i;
+    dest->count = scan_options(text,count,NULL);
+    dest->owner = pool;
+    dest->tokens = pool != NULL ? arena_alloc(pool,dest->count*sizeof(option_token) + 1)
+        : heap_alloc(dest->count*sizeof(option_token) + 1);
+    scan_options(text,count,dest->tokens);
+    dest->size = 0;
+    for (i = 0;i < dest->count;++i)
+        dest->size += dest->tokens[i].kind == OPTION_END ? 1 : dest->tokens[i].length;
+}
+
+void destroy_template(option_template* tmpl)
+{
+    if (tmpl->owner == NULL)
+        heap_free(tmpl->tokens);
+    tmpl->tokens = NULL;
+    tmpl->count = 0;
+    tmpl->size = 0;
+}
+
+void find_settings_directory()
+{
+    settings_directory = check_settings_path();
 }
 
 void load_settings_from_file()
 {
-    const char* dname, *fname, *pentry;
+    const char* dname, *fname;
     assert(loaded_compilers_c == 0);
     dname = check_settings_path();
+    settings_directory = dname;
     fname = find_targets_file(dname);
-    open_settings_file(fname);
-    while (loaded_compilers_c < MAX_COMPILERS) {
-        int i;
-        compiler* comp = loaded_compilers+loaded_compilers_c;
-        pentry = read_next_entry();
-        if (pentry == NULL)
-            break;
-        init_compiler(comp);
-        load_compiler(comp,pentry);
-        for (i = 0;i < loaded_compilers_c;++i) {
-            if (strcmp(loaded_compilers[i].extension.buffer,comp->extension.buffer) == 0) {
-                fprintf(stderr,"%s: warning: extension '%s' appear in targets file multiple times\n",PROGRAM_NAME,comp->extension.buffer);
-                fprintf(stderr,"%s: warning: using first occurrance of extension '%s' in targets file\n",PROGRAM_NAME,comp->extension.buffer);
-                break;
-            }
-        }
-        ++loaded_compilers_c;
-    }
-    close_settings_file();
+    targets_file = fname;
+    if (get_file_identity(fname,&targets_identity) != 0)
+        memset(&targets_identity,0,sizeof(file_identity));
+    /* use the snapshot of the scanned targets file if it is still current */
+    init_arena(&settings_pool);
+    if (load_snapshot(fname) == 0)
+        return;
+    load_rules(fname);
+    save_snapshot(fname);
 }
 
 void unload_settings()
 {
-    int i = 0;
-    while (i < loaded_compilers_c) {
-        destroy_compiler(loaded_compilers+i);
-        ++i;
+    /* compilers' strings are released with the settings arena or refer to
+       the mapped snapshot */
+    if (snapshot_image != NULL) {
+        unmap_snapshot_file(snapshot_image,snapshot_image_size);
+        snapshot_image = NULL;
     }
+    else
+        heap_free(extension_index);
+    destroy_arena(&settings_pool);
+    heap_free(loaded_compilers);
+    heap_free(rule_sources);
+    loaded_compilers = NULL;
+    rule_sources = NULL;
     loaded_compilers_c = 0;
+    loaded_compilers_alloc = 0;
+    extension_index = NULL;
+    extension_index_size = 0;
+}
+
+int settings_changed()
+{
+    file_identity ident;
+    assert(targets_file != NULL);
+    if (get_file_identity(targets_file,&ident) != 0)
+        return 1;
+    return memcmp(&ident,&targets_identity,sizeof(file_identity)) != 0;
+}
+
+const char* get_settings_directory()
+{
+    assert(settings_directory != NULL);
+    return settings_directory;
 }
 
 compiler* lookup_compiler(const char* ext)
 {
     int i;
-    i = 0;
-    while (i < loaded_compilers_c) {
-        if (strcmp(loaded_compilers[i].extension.buffer,ext) == 0)
-            return loaded_compilers+i;
-        ++i;
-    }
-    return NULL;
+    i = find_extension(ext);
+    return i == -1 ? NULL : parse_rule(i);
+}
+
+int get_compiler_count()
+{
+    return loaded_compilers_c;
+}
+
+const char* get_extension(int index)
+{
+    assert(index>=0 && index<loaded_compilers_c);
+    return loaded_compilers[index].extension.buffer;
 }
 
 const char* check_extension(const char* ext)
 {
     int i;
-    i = 0;
-    while (i < loaded_compilers_c) {
-        if (strcmp(loaded_compilers[i].extension.buffer,ext) == 0)
-            return loaded_compilers[i].extension.buffer;
-        ++i;
-    }
-    return NULL;
+    i = find_extension(ext);
+    return i == -1 ? NULL : loaded_compilers[i].extension.buffer;
 }
 
 /* definitions of internal functions */
+void load_rules(const char* fname)
+{
+    /* map the targets file and find the extension of each non-empty line;
+       lines are found with memchr() and are parsed only when used; the file
+       is copied out of the mapping first so that editing or truncating it
+       later changes no loaded rule */
+    size_t size;
+    char* text;
+    const char* image;
+    const char* iter;
+    const char* end;
+    const char* eol;
+    compiler* comp;
+    if (map_targets_file(fname,&image,&size) != 0) {
+        fprintf(stderr,"%s: error: cannot open file '%s'\n",PROGRAM_NAME,fname);
+        fatal_stop("could not open needed settings file");
+    }
+    text = arena_alloc(&settings_pool,size+1);
+    if (image != NULL) {
+        memcpy(text,image,size);
+        unmap_targets_file(image,size);
+    }
+    iter = text;
+    end = text + size;
+    while (iter < end) {
+        const char* line;
+        eol = memchr(iter,'\n',end-iter);
+        if (eol == NULL)
+            eol = end;
+        line = iter;
+        iter = eol+1;
+        while (line<eol && isspace(*line))
+            ++line;
+        if (line == eol)
+            continue;
+        comp = append_compiler();
+        rule_sources[loaded_compilers_c-1].text = line;
+        rule_sources[loaded_compilers_c-1].length = (int)(eol-line);
+        rule_sources[loaded_compilers_c-1].parsed = 0;
+        init_compiler(comp,&settings_pool);
+        load_extension(comp,line,(int)(eol-line));
+        if (index_extension(loaded_compilers_c-1) == -1) {
+            fprintf(stderr,"%s: warning: extension '%s' appear in targets file multiple times\n",PROGRAM_NAME,comp->extension.buffer);
+            fprintf(stderr,"%s: warning: using first occurrance of extension '%s' in targets file\n",PROGRAM_NAME,comp->extension.buffer);
+        }
+    }
+}
+
+void load_extension(compiler* pcomp,const char* line,int length)
+{
+    /* the extension is the first token of the line; as in load_compiler(),
+       a dot is added if the extension doesn't begin with one */
+    int len;
+    len = 0;
+    while (len<length && !isspace(line[len]))
+        ++len;
+    reset_stringbuf(&pcomp->extension);
+    if (*line != '.')
+        append_char_stringbuf(&pcomp->extension,'.');
+    append_stringbuf(&pcomp->extension,line,len);
+}
+
+compiler* parse_rule(int position)
+{
+    /* load the rule's compiler from its line the first time it is used; the
+       extension is parsed again into a new buffer since a snapshot's
+       extension lies in its read-only mapping */
+    stringbuf entry;
+    compiler* comp = loaded_compilers+position;
+    rule_source* src = rule_sources+position;
+    if ( !src->parsed ) {
+        init_stringbuf(&entry);
+        append_stringbuf(&entry,src->text,src->length);
+        init_stringbuf_arena(&comp->program,&settings_pool);
+        init_stringbuf_arena(&comp->options,&settings_pool);
+        init_stringbuf_arena(&comp->redirect,&settings_pool);
+        init_stringbuf_arena(&comp->extension,&settings_pool);
+        load_compiler(comp,entry.buffer);
+        destroy_stringbuf(&entry);
+        src->parsed = 1;
+    }
+    return comp;
+}
+
+compiler* append_compiler()
+{
+    /* compilers are moved with move_compiler() rather than realloc() since
+       their short strings are stored inside them */
+    if (loaded_compilers_c >= loaded_compilers_alloc) {
+        int i;
+        compiler* moved;
+        loaded_compilers_alloc = loaded_compilers_alloc == 0 ? 16 : loaded_compilers_alloc*2;
+        moved = heap_alloc(loaded_compilers_alloc*sizeof(compiler));
+        for (i = 0;i < loaded_compilers_c;++i)
+            move_compiler(moved+i,loaded_compilers+i);
+        heap_free(loaded_compilers);
+        loaded_compilers = moved;
+        rule_sources = heap_realloc(rule_sources,loaded_compilers_alloc*sizeof(rule_source));
+    }
+    return loaded_compilers + loaded_compilers_c++;
+}
+
+unsigned int hash_extension(const char* ext)
+{
+    /* FNV-1a */
+    unsigned int hash = 2166136261u;
+    while (*ext) {
+        hash ^= (unsigned char)*ext++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int find_extension(const char* ext)
+{
+    unsigned int i;
+    unsigned int mask;
+    if (extension_index_size == 0)
+        return -1;
+    mask = extension_index_size - 1;
+    i = hash_extension(ext) & mask;
+    while (extension_index[i] != -1) {
+        if (strcmp(loaded_compilers[extension_index[i]].extension.buffer,ext) == 0)
+            return extension_index[i];
+        i = (i+1) & mask; /* linear probing */
+    }
+    return -1;
+}
+
+int index_extension(int position)
+{
+    int i;
+    /* keep the index at most half full; rebuilding reinserts the earlier
+       rules in order so the first occurrence of an extension keeps its slot */
+    if ((position+1)*2 > extension_index_size) {
+        heap_free(extension_index);
+        extension_index_size = extension_index_size == 0 ? 32 : extension_index_size*2;
+        extension_index = heap_alloc(extension_index_size*sizeof(int));
+        for (i = 0;i < extension_index_size;++i)
+            extension_index[i] = -1;
+        for (i = 0;i < position;++i)
+            insert_extension(i);
+    }
+    return insert_extension(position);
+}
+
+int insert_extension(int position)
+{
+    unsigned int i;
+    unsigned int mask;
+    const char* ext = loaded_compilers[position].extension.buffer;
+    mask = extension_index_size - 1;
+    i = hash_extension(ext) & mask;
+    while (extension_index[i] != -1) {
+        if (strcmp(loaded_compilers[extension_index[i]].extension.buffer,ext) == 0)
+            return -1;
+        i = (i+1) & mask; /* linear probing */
+    }
+    extension_index[i] = position;
+    return 0;
+}
+
+int load_snapshot(const char* fname)
+{
+    /* map the snapshot and point the compilers' string buffers into it; the
+       snapshot is rejected unless it was written for the current targets
+       file and every record lies within the image */
+    int i, j;
+    int empty;
+    size_t size;
+    const char* image;
+    const char* strings;
+    const snapshot_header* header;
+    const snapshot_rule* rules;
+    const int* index;
+    file_identity ident;
+    stringbuf snapname;
+    if (get_file_identity(fname,&ident) != 0)
+        return -1;
+    init_stringbuf(&snapname);
+    assign_stringbuf(&snapname,fname);
+    concat_stringbuf(&snapname,".cache");
+    image = map_snapshot_file(snapname.buffer,&size);
+    destroy_stringbuf(&snapname);
+    if (image == NULL)
+        return -1;
+    header = (const snapshot_header*)image;
+    if (size < sizeof(snapshot_header) || header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION
+        || header->header_size != sizeof(snapshot_header)+sizeof(snapshot_rule)
+        || memcmp(&header->source,&ident,sizeof(file_identity)) != 0
+        || header->rules_c > size/sizeof(snapshot_rule) || header->index_size > size/sizeof(int)
+        || (header->index_size & (header->index_size-1)) != 0 || header->index_size < header->rules_c
+        || size != sizeof(snapshot_header) + header->rules_c*sizeof(snapshot_rule)
+            + header->index_size*sizeof(int) + header->strings_size) {
+        unmap_snapshot_file(image,size);
+        return -1;
+    }
+    rules = (const snapshot_rule*)(image+sizeof(snapshot_header));
+    index = (const int*)(rules+header->rules_c);
+    strings = (const char*)(index+header->index_size);
+    /* find_extension() probes until it reaches an empty slot, so an index
+       needs at least one */
+    empty = 0;
+    for (i = 0;i < (int)header->index_size;++i) {
+        if (index[i] < -1 || index[i] >= (int)header->rules_c) {
+            unmap_snapshot_file(image,size);
+            return -1;
+        }
+        if (index[i] == -1)
+            ++empty;
+    }
+    if (header->index_size>0 && empty==0) {
+        unmap_snapshot_file(image,size);
+        return -1;
+    }
+    for (i = 0;i < (int)header->rules_c;++i) {
+        for (j = 0;j < 2;++j) {
+            if (rules[i].lengths[j] < 0 || rules[i].offsets[j] >= header->strings_size
+                || header->strings_size - rules[i].offsets[j] <= (unsigned int)rules[i].lengths[j]
+                || strings[rules[i].offsets[j]+rules[i].lengths[j]] != 0) {
+                unmap_snapshot_file(image,size);
+                return -1;
+            }
+        }
+    }
+    loaded_compilers_alloc = header->rules_c;
+    loaded_compilers = heap_alloc(loaded_compilers_alloc*sizeof(compiler));
+    rule_sources = heap_alloc(loaded_compilers_alloc*sizeof(rule_source));
+    for (i = 0;i < (int)header->rules_c;++i) {
+        compiler* comp = loaded_compilers+i;
+        /* the extension buffer refers to the read-only mapping; the other
+           strings are allocated when the rule is parsed */
+        comp->extension.buffer = (char*)strings + rules[i].offsets[0];
+        comp->extension.used = rules[i].lengths[0];
+        comp->extension.size = rules[i].lengths[0] + 1;
+        comp->extension.owner = NULL;
+        comp->options_c = 0;
+        rule_sources[i].text = strings + rules[i].offsets[1];
+        rule_sources[i].length = rules[i].lengths[1];
+        rule_sources[i].parsed = 0;
+        if (rules[i].flags & SNAPSHOT_DUPLICATE) {
+            fprintf(stderr,"%s: warning: extension '%s' appear in targets file multiple times\n",PROGRAM_NAME,comp->extension.buffer);
+            fprintf(stderr,"%s: warning: using first occurrance of extension '%s' in targets file\n",PROGRAM_NAME,comp->extension.buffer);
+        }
+    }
+    loaded_compilers_c = header->rules_c;
+    extension_index = (int*)index;
+    extension_index_size = header->index_size;
+    snapshot_image = image;
+    snapshot_image_size = size;
+    return 0;
+}
+
+void save_snapshot(const char* fname)
+{
+    int i, j;
+    size_t size;
+    char* image;
+    unsigned int offset;
+    snapshot_header* header;
+    snapshot_rule* rules;
+    stringbuf snapname;
+    /* determine the size of the string table */
+    offset = 0;
+    for (i = 0;i < loaded_compilers_c;++i)
+        offset += loaded_compilers[i].extension.used + rule_sources[i].length + 2;
+    size = sizeof(snapshot_header) + loaded_compilers_c*sizeof(snapshot_rule)
+        + extension_index_size*sizeof(int) + offset;
+    image = calloc(1,size);
+    header = (snapshot_header*)image;
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->header_size = sizeof(snapshot_header) + sizeof(snapshot_rule);
+    header->rules_c = loaded_compilers_c;
+    header->index_size = extension_index_size;
+    header->strings_size = offset;
+    if (get_file_identity(fname,&header->source) != 0) {
+        free(image);
+        return;
+    }
+    rules = (snapshot_rule*)(image+sizeof(snapshot_header));
+    if (extension_index_size > 0)
+        memcpy(rules+loaded_compilers_c,extension_index,extension_index_size*sizeof(int));
+    offset = 0;
+    for (i = 0;i < loaded_compilers_c;++i) {
+        char* strings = (char*)(rules+loaded_compilers_c) + extension_index_size*sizeof(int);
+        const char* texts[2];
+        int lengths[2];
+        compiler* comp = loaded_compilers+i;
+        texts[0] = comp->extension.buffer;
+        lengths[0] = comp->extension.used;
+        texts[1] = rule_sources[i].text;
+        lengths[1] = rule_sources[i].length;
+        for (j = 0;j < 2;++j) {
+            rules[i].offsets[j] = offset;
+            rules[i].lengths[j] = lengths[j];
+            memcpy(strings+offset,texts[j],lengths[j]); /* the table was zeroed; terminator is implied */
+            offset += lengths[j] + 1;
+        }
+        if (find_extension(comp->extension.buffer) != i)
+            rules[i].flags |= SNAPSHOT_DUPLICATE;
+    }
+    init_stringbuf(&snapname);
+    assign_stringbuf(&snapname,fname);
+    concat_stringbuf(&snapname,".cache");
+    write_snapshot_file(snapname.buffer,image,size);
+    destroy_stringbuf(&snapname);
+    free(image);
+}
+
 const char* seek_until_space(const char* iterator)
 {
     while (*iterator && !isspace(*iterator))
@@ -216,3 +685,211 @@ void seek_whitespace(const char** iterator)
     while ( isspace(**iterator) )
         ++(*iterator);
 }
+
+int load_resource(compiler* pcomp,const char* token,int length)
+{
+    /* tokens have the form @name=value; other tokens that begin with '@'
+       (e.g. response files) are compiler options */
+    int i;
+    int n;
+    int bad;
+    char name[16];
+    char value[64];
+    const char* sep;
+    resource_class* res = &pcomp->resources;
+    sep = memchr(token,'=',length);
+    n = sep == NULL ? 0 : sep - token - 1;
+    if (n<=0 || n>=(int)sizeof(name))
+        return -1;
+    memcpy(name,token+1,n);
+    name[n] = 0;
+    i = LIMIT_COUNT;
+    if (strcmp(name,"cpus")!=0 && strcmp(name,"nice")!=0 && strcmp(name,"ioclass")!=0) {
+        if (strncmp(name,"rlimit_",7) != 0)
+            return -1;
+        for (i = 0;i < LIMIT_COUNT;++i)
+            if (strcmp(name+7,LIMIT_NAMES[i]) == 0)
+                break;
+        if (i >= LIMIT_COUNT)
+            return -1;
+    }
+    /* the value is copied so that it is null terminated; a value that
+       does not fit is invalid */
+    n = length - n - 2;
+    bad = n >= (int)sizeof(value);
+    if (bad)
+        n = sizeof(value) - 1;
+    memcpy(value,sep+1,n);
+    value[n] = 0;
+    if (strcmp(name,"cpus") == 0) {
+        bad |= parse_cpu_list(res,value);
+        res->flags |= RESOURCE_CPUS;
+    }
+    else if (strcmp(name,"nice") == 0) {
+        char* end;
+        long nice = strtol(value,&end,10);
+        bad |= end==value || *end!=0 || nice<-20 || nice>19;
+        res->nice = (int)nice;
+        res->flags |= RESOURCE_NICE;
+    }
+    else if (strcmp(name,"ioclass") == 0) {
+        /* idle, best-effort[:level] or realtime[:level] */
+        char* end;
+        char* level = strchr(value,':');
+        if (level != NULL)
+            *level++ = 0;
+        res->iolevel = 4;
+        if (strcmp(value,"idle") == 0) {
+            res->ioclass = IOCLASS_IDLE;
+            bad |= level != NULL;
+        }
+        else if (strcmp(value,"best-effort") == 0)
+            res->ioclass = IOCLASS_BEST_EFFORT;
+        else if (strcmp(value,"realtime") == 0)
+            res->ioclass = IOCLASS_REALTIME;
+        else
+            bad = 1;
+        if (level!=NULL && !bad) {
+            res->iolevel = (int)strtol(level,&end,10);
+            bad = *level==0 || *end!=0 || res->iolevel<0 || res->iolevel>7;
+        }
+        res->flags |= RESOURCE_IOCLASS;
+    }
+    else {
+        bad |= parse_limit(value,res->limits+i);
+        res->flags |= RESOURCE_LIMIT(i);
+    }
+    if (bad) {
+        fprintf(stderr,"%s: syntax error: invalid value in '%.*s' for extension '%s'\n",PROGRAM_NAME,
+            length,token,pcomp->extension.buffer);
+        fatal_stop("syntax error in target file");
+    }
+    return 0;
+}
+
+int parse_cpu_list(resource_class* res,const char* list)
+{
+    /* list of CPU numbers and ranges (e.g. 0-3,8,10-11) */
+    int i;
+    long first, last;
+    char* end;
+    const int bits = 8 * sizeof(unsigned long);
+    memset(res->cpus,0,sizeof(res->cpus));
+    while (1) {
+        if ( !isdigit(*list) )
+            return -1;
+        first = last = strtol(list,&end,10);
+        if (*end == '-') {
+            list = end+1;
+            if ( !isdigit(*list) )
+                return -1;
+            last = strtol(list,&end,10);
+        }
+        if (first>last || last>=RESOURCE_MAX_CPUS)
+            return -1;
+        for (i = (int)first;i <= (int)last;++i)
+            res->cpus[i / bits] |= 1UL << (i % bits);
+        if (*end == 0)
+            return 0;
+        if (*end != ',')
+            return -1;
+        list = end+1;
+    }
+}
+
+int parse_limit(const char* value,long long* plimit)
+{
+    /* a number with an optional K, M or G suffix (multiples of 1024) or 'unlimited' */
+    char* end;
+    long long n;
+    if (strcmp(value,"unlimited") == 0) {
+        *plimit = -1;
+        return 0;
+    }
+    if ( !isdigit(*value) )
+        return -1;
+    n = strtoll(value,&end,10);
+    switch (toupper(*end)) {
+    case 'G':
+        n *= 1024;
+        /* fall through */
+    case 'M':
+        n *= 1024;
+        /* fall through */
+    case 'K':
+        n *= 1024;
+        ++end;
+        break;
+    }
+    *plimit = n;
+    return *end != 0 ? -1 : 0;
+}
+
+int scan_options(const char* text,int count,option_token* tokens)
+{
+    /* a '$' that is not followed by a letter or digit is literal text; an
+       unknown variable is reported and expands to nothing */
+    int i;
+    int n;
+    int len;
+    int kind;
+    int pos, start;
+    n = 0;
+    pos = 0;
+    for (i = 0;i < count;++i) {
+        start = pos;
+        while (1) {
+            if (text[pos]!=0 && !(text[pos]=='$' && isalnum((unsigned char)text[pos+1]))) {
+                ++pos;
+                continue;
+            }
+            if (pos > start) {
+                if (tokens != NULL) {
+                    tokens[n].kind = OPTION_LITERAL;
+                    tokens[n].offset = start;
+                    tokens[n].length = pos-start;
+                }
+                ++n;
+            }
+            if (text[pos] == 0)
+                break;
+            len = 1;
+            while ( isalnum((unsigned char)text[pos+len]) )
+                ++len;
+            kind = match_variable(text+pos+1,len-1);
+            if (kind != OPTION_LITERAL) {
+                if (tokens != NULL) {
+                    tokens[n].kind = kind;
+                    tokens[n].offset = pos;
+                    tokens[n].length = 0;
+                }
+                ++n;
+            }
+            else if (tokens != NULL)
+                fprintf(stderr,"%s: warning: the special option '%.*s' is not recognized\n",PROGRAM_NAME,len,text+pos);
+            pos += len;
+            start = pos;
+        }
+        if (tokens != NULL) {
+            tokens[n].kind = OPTION_END;
+            tokens[n].offset = pos;
+            tokens[n].length = 0;
+        }
+        ++n;
+        ++pos;
+    }
+    return n;
+}
+
+int match_variable(const char* name,int length)
+{
+    /* variable names are not case sensitive */
+    int i, j;
+    for (i = OPTION_LITERAL+1;i < OPTION_END;++i) {
+        for (j = 0;j<length && OPTION_NAMES[i][j]==tolower((unsigned char)name[j]);++j)
+            ;
+        if (j==length && OPTION_NAMES[i][j]==0)
+            return i;
+    }
+    return OPTION_LITERAL;
+}
@@ -3,6 +3,71 @@
 #define SETTINGS_H
 #include "stringbuf.h"
 
+#define RESOURCE_MAX_CPUS 1024
+#define RESOURCE_CPU_WORDS (RESOURCE_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+/* bits of resource_class::flags */
+#define RESOURCE_CPUS 0x01
+#define RESOURCE_NICE 0x02
+#define RESOURCE_IOCLASS 0x04
+#define RESOURCE_LIMIT(i) (0x100 << (i)) /* limits[i] is set */
+
+/* I/O scheduling classes (same values as Linux's IOPRIO_CLASS_*) */
+#define IOCLASS_REALTIME 1
+#define IOCLASS_BEST_EFFORT 2
+#define IOCLASS_IDLE 3
+
+/* indices of resource_class::limits */
+#define LIMIT_AS 0
+#define LIMIT_CORE 1
+#define LIMIT_CPU 2
+#define LIMIT_DATA 3
+#define LIMIT_FSIZE 4
+#define LIMIT_NOFILE 5
+#define LIMIT_STACK 6
+#define LIMIT_COUNT 7
+
+/* resource_class - scheduling class and limits of a rule's compiler processes;
+   declared in the targets file by @name=value tokens */
+typedef struct {
+    int flags; /* RESOURCE_* bits of the settings that the rule declares */
+    int nice; /* added to the niceness of the compiler */
+    int ioclass;
+    int iolevel; /* priority within the I/O class: 0 (highest) to 7 */
+    unsigned long cpus[RESOURCE_CPU_WORDS]; /* CPU affinity mask */
+    long long limits[LIMIT_COUNT]; /* soft limits; -1 means unlimited */
+} resource_class;
+
+/* kinds of option_token; the variables are written as $name in options and
+   redirect file names */
+#define OPTION_LITERAL 0 /* text copied as it is */
+#define OPTION_PROJECT 1 /* first target minus its extension */
+#define OPTION_DEPFILE 2 /* dependency file recorded for the job */
+#define OPTION_TARGET 3 /* first target */
+#define OPTION_TARGETS 4 /* every target of the job */
+#define OPTION_DIR 5 /* directory of the first target */
+#define OPTION_STEM 6 /* file name of the first target minus its extension */
+#define OPTION_JOBS 7 /* number of jobs run at once */
+#define OPTION_NCPU 8 /* number of processors */
+#define OPTION_END 9 /* end of an option */
+
+/* option_token - a span of literal text or a variable of a compiled option */
+typedef struct {
+    int kind; /* OPTION_* kind */
+    int offset; /* start of a literal in the template's text */
+    int length; /* length of a literal */
+} option_token;
+
+/* option_template - options compiled into tokens so that expanding them
+   copies spans rather than scanning text; every option ends with an
+   OPTION_END token */
+typedef struct {
+    option_token* tokens;
+    int count;
+    int size; /* length of the literals plus a terminator per option */
+    arena* owner; /* arena that owns 'tokens'; NULL if allocated from the heap */
+} option_template;
+
 typedef struct {
     stringbuf program; /* program name to invoke */
     /* 'options' are separated by null characters and terminated by a final null character
@@ -11,16 +76,27 @@ typedef struct {
     stringbuf extension; /* the file extension that maps to the compiler */
     int options_c;
     stringbuf redirect;
+    option_template options_template; /* 'options' compiled by load_compiler() */
+    option_template redirect_template; /* 'redirect' compiled by load_compiler(); has no options if output is not redirected */
+    resource_class resources;
 } compiler;
 
-void init_compiler(compiler*);
+void init_compiler(compiler*,arena* pool); /* strings are allocated from 'pool' if not NULL */
 void destroy_compiler(compiler*);
+void move_compiler(compiler* dest,compiler* src); /* 'dest' takes over the strings of 'src' */
 void load_compiler(compiler*,const char* entry); /* load compiler settings from entry in settings file */
+void compile_options(option_template* dest,const char* text,int count,arena* pool); /* compile 'count' null terminated options stored one after another in 'text'; tokens are allocated from 'pool' if not NULL */
+void destroy_template(option_template*);
 
 /* settings file management */
 void load_settings_from_file(); /* read settings file(s) to initialize settings information */
+void find_settings_directory(); /* find the settings directory without reading the targets file */
 void unload_settings();
-compiler* lookup_compiler(const char* ext);
+int settings_changed(); /* returns non-zero if the targets file changed since it was loaded */
+const char* get_settings_directory(); /* settings directory found by load_settings_from_file() or find_settings_directory() */
+compiler* lookup_compiler(const char* ext); /* the rule is parsed when it is first looked up */
+int get_compiler_count();
+const char* get_extension(int index); /* extensions in targets file order; may repeat an extension */
 const char* check_extension(const char* ext); /* returns pointer to compiler info extension string buffer on success else NULL */
 
 #endif
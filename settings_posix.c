@@ -1,15 +1,12 @@
 /* settings_posix.c */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pwd.h>
 #include <errno.h>
 
-/* internal data definitions */
-static int settings_fd = -1;
-static stringbuf entry_buffer;
-
 /* internal function definitions */
 void fatal_stop(const char* message)
 {
@@ -21,20 +18,25 @@ const char* check_settings_path()
 {
     static char fnbuf[FILENAME_MAX];
     static const char* init_dir = "/.compile"; /* path relative to home directory */
-    uid_t uid;
+    const char* home;
     struct passwd* pwd;
     int i;
     struct stat istat;
     short flag;
-    /* lookup user info to find home directory */
-    uid = getuid();
-    pwd = getpwuid(uid);
-    if (pwd == NULL)
-        fatal_stop("could not obtain user information for accessing settings");
+    /* find the home directory from HOME, or from the user info if it is not set */
+    home = getenv("HOME");
+    if (home==NULL || *home==0) {
+        pwd = getpwuid(getuid());
+        if (pwd == NULL)
+            fatal_stop("could not obtain user information for accessing settings");
+        home = pwd->pw_dir;
+    }
     flag = 0;
     /* compile settings directory name */
-    i = strlen(pwd->pw_dir);
-    strcpy(fnbuf,pwd->pw_dir);
+    i = strlen(home);
+    if (i+strlen(init_dir) >= sizeof(fnbuf))
+        fatal_stop("home directory name is too long");
+    strcpy(fnbuf,home);
     strcpy(fnbuf+i,init_dir);
     /* check to see if settings directory exists as directory */
     if (stat(fnbuf,&istat) == -1) {
@@ -113,57 +115,94 @@ const char* find_targets_file(const char* settingsDir)
     return fnbuf;
 }
 
-void open_settings_file(const char* fname)
+int get_file_identity(const char* fname,file_identity* pident)
 {
-    assert(settings_fd == -1);
-    settings_fd = open(fname,O_RDONLY);
-    if (settings_fd == -1) {
-        fprintf(stderr,"%s: error: cannot open file '%s'\n",PROGRAM_NAME,fname);
-        fatal_stop("could not open needed settings file");
+    struct stat st;
+    if (stat(fname,&st) == -1)
+        return -1;
+    memset(pident,0,sizeof(file_identity));
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    pident->mtime = (unsigned long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    pident->mtime = (unsigned long long)st.st_mtime * 1000000000;
+#endif
+    pident->size = st.st_size;
+    pident->inode = st.st_ino;
+    pident->device = st.st_dev;
+    return 0;
+}
+
+const char* map_snapshot_file(const char* fname,size_t* psize)
+{
+    int fd;
+    void* image;
+    struct stat st;
+    fd = open(fname,O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd,&st)==-1 || st.st_size==0) {
+        close(fd);
+        return NULL;
     }
-    /* allocate string buffer for entry input */
-    init_stringbuf(&entry_buffer);
+    image = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (image == MAP_FAILED)
+        return NULL;
+    *psize = st.st_size;
+    return image;
 }
 
-void close_settings_file()
+void unmap_snapshot_file(const char* image,size_t size)
 {
-    assert(settings_fd != -1);
-    close(settings_fd);
-    settings_fd = -1;
-    /* deallocate entry buffer */
-    destroy_stringbuf(&entry_buffer);
+    munmap((void*)image,size);
 }
 
-const char* read_next_entry()
+int map_targets_file(const char* fname,const char** pimage,size_t* psize)
 {
-    static int n = 0;
-    static char ibuf[120];
-    static const char* pbuf = NULL;
-    assert(settings_fd != -1);
-    reset_stringbuf(&entry_buffer);
-    while (1) {
-        int len;
-        char last;
-        if (n <= 0) { /* (n could be -1) */
-            n = read(settings_fd,ibuf,120);
-            if (n < 0)
-                fatal_stop("could not read from settings file");
-            else if (n == 0) {
-                if (entry_buffer.used == 0)
-                    return NULL;
-                break;
-            }
-            pbuf = ibuf;
+    int fd;
+    void* image;
+    struct stat st;
+    fd = open(fname,O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd,&st) == -1) {
+        close(fd);
+        return -1;
+    }
+    image = NULL;
+    if (st.st_size > 0) {
+        image = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        if (image == MAP_FAILED) {
+            close(fd);
+            return -1;
         }
-        len = 0;
-        while (len<n && pbuf[len]!='\n')
-            ++len;
-        concat_stringbuf_ex(&entry_buffer,pbuf,len);
-        last = len<n ? pbuf[len] : 0;
-        n -= ++len; /* increment len to count pbuf[len] */
-        pbuf += len;
-        if (last == '\n')
-            break;
     }
-    return entry_buffer.buffer;
+    close(fd);
+    *pimage = image;
+    *psize = st.st_size;
+    return 0;
+}
+
+void unmap_targets_file(const char* image,size_t size)
+{
+    munmap((void*)image,size);
+}
+
+void write_snapshot_file(const char* fname,const char* image,size_t size)
+{
+    /* write a temporary file and rename it into place so that concurrent
+       readers never map a partial snapshot */
+    int fd;
+    ssize_t n;
+    stringbuf temp;
+    init_stringbuf(&temp);
+    assign_stringbuf(&temp,fname);
+    concat_stringbuf(&temp,".tmp");
+    fd = open(temp.buffer,O_CREAT|O_WRONLY|O_TRUNC,S_IRUSR|S_IWUSR);
+    if (fd != -1) {
+        n = write(fd,image,size);
+        if (close(fd)==-1 || n!=(ssize_t)size || rename(temp.buffer,fname)==-1)
+            unlink(temp.buffer);
+    }
+    destroy_stringbuf(&temp);
 }
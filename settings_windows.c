@@ -2,10 +2,6 @@
 #include <Windows.h>
 #include <Shlobj.h>
 
-/* internal data */
-static HANDLE settingsFile = INVALID_HANDLE_VALUE;
-static stringbuf entryBuffer;
-
 void fatal_stop(const char* message)
 {
 	fprintf(stderr,"%s: fatal error: %s\n",PROGRAM_NAME,message);
@@ -62,58 +58,59 @@ const char* find_targets_file(const char* settingsFolder)
 	return targetsPath;
 }
 
-void open_settings_file(const char* fname)
+/* snapshots of the targets file are not used on Windows */
+int get_file_identity(const char* fname,file_identity* pident)
+{
+	return -1;
+}
+
+const char* map_snapshot_file(const char* fname,size_t* psize)
+{
+	return NULL;
+}
+
+void unmap_snapshot_file(const char* image,size_t size)
+{
+}
+
+void write_snapshot_file(const char* fname,const char* image,size_t size)
 {
-	assert(settingsFile == INVALID_HANDLE_VALUE);
-	settingsFile = CreateFile(fname,GENERIC_READ,0,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
-	if (settingsFile == INVALID_HANDLE_VALUE) {
-		fprintf(stderr,"%s: error: cannot open file '%s'\n",PROGRAM_NAME,fname);
-		fatal_stop("cannot open needed settings file");
-	}
-	/* allocate string buffer for entry input */
-	init_stringbuf(&entryBuffer);
 }
 
-void close_settings_file()
+int map_targets_file(const char* fname,const char** pimage,size_t* psize)
 {
-	assert(settingsFile != INVALID_HANDLE_VALUE);
-	CloseHandle(settingsFile);
-	settingsFile = INVALID_HANDLE_VALUE;
-	/* deallocate entry buffer */
-	destroy_stringbuf(&entryBuffer);
+	HANDLE hFile;
+	HANDLE hMapping;
+	DWORD dwSize;
+	const char* image;
+	hFile = CreateFile(fname,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return -1;
+	dwSize = GetFileSize(hFile,NULL);
+	if (dwSize == INVALID_FILE_SIZE) {
+		CloseHandle(hFile);
+		return -1;
+	}
+	image = NULL;
+	if (dwSize > 0) {
+		/* the view keeps the mapping open after its handle is closed */
+		hMapping = CreateFileMapping(hFile,NULL,PAGE_READONLY,0,0,NULL);
+		if (hMapping != NULL) {
+			image = MapViewOfFile(hMapping,FILE_MAP_READ,0,0,0);
+			CloseHandle(hMapping);
+		}
+		if (image == NULL) {
+			CloseHandle(hFile);
+			return -1;
+		}
+	}
+	CloseHandle(hFile);
+	*pimage = image;
+	*psize = dwSize;
+	return 0;
 }
 
-const char* read_next_entry()
+void unmap_targets_file(const char* image,size_t size)
 {
-	static int n = 0;
-    static char ibuf[120];
-    static const char* pbuf = NULL;
-    assert(settingsFile != INVALID_HANDLE_VALUE);
-    reset_stringbuf(&entryBuffer);
-    while (1) {
-        int len;
-        char last;
-        if (n <= 0) { /* (n could be less than 0) */
-			DWORD dwRead;
-            if ( !ReadFile(settingsFile,ibuf,120,&dwRead,NULL) )
-                fatal_stop("could not read from settings file");
-            else if (dwRead == 0) {
-                if (entryBuffer.used == 0)
-                    return NULL;
-                break;
-            }
-			n = (int)dwRead;
-            pbuf = ibuf;
-        }
-        len = 0;
-        while (len<n && pbuf[len]!='\n')
-            ++len;
-		concat_stringbuf_ex(&entryBuffer,pbuf,len);
-        last = len<n ? pbuf[len] : 0;
-        n -= ++len; /* increment len to count pbuf[len] */
-        pbuf += len;
-        if (last == '\n')
-            break;
-    }
-    return entryBuffer.buffer;
+	UnmapViewOfFile(image);
 }
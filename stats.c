@@ -0,0 +1,81 @@
+/* stats.c */
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+extern const char* PROGRAM_NAME;
+
+/* data internal to this unit */
+static long long phase_time[STATS_PHASE_COUNT]; /* accumulated nanoseconds */
+static long long phase_start[STATS_PHASE_COUNT];
+static child_usage children;
+static const char* const PHASE_NAMES[STATS_PHASE_COUNT] = {
+    "total", "settings", "resolve", "assemble", "spawn", "wait"
+};
+static const char* const PHASE_TITLES[STATS_PHASE_COUNT] = {
+    "total", "settings load", "target resolution", "argument assembly", "spawn", "wait for compiler"
+};
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#include "stats_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#include "stats_windows.c"
+#endif
+
+/* platform-independent code */
+
+void reset_stats()
+{
+    memset(phase_time,0,sizeof(phase_time));
+    memset(&children,0,sizeof(children));
+}
+
+void begin_phase(int phase)
+{
+    phase_start[phase] = get_monotonic_time();
+}
+
+void end_phase(int phase)
+{
+    phase_time[phase] += get_monotonic_time() - phase_start[phase];
+}
+
+void add_child_usage(const child_usage* usage)
+{
+    children.count += usage->count;
+    children.user_usec += usage->user_usec;
+    children.sys_usec += usage->sys_usec;
+    if (usage->max_rss_kib > children.max_rss_kib)
+        children.max_rss_kib = usage->max_rss_kib;
+    children.voluntary_switches += usage->voluntary_switches;
+    children.involuntary_switches += usage->involuntary_switches;
+}
+
+void print_stats(int json)
+{
+    int i;
+    if (json) {
+        fprintf(stderr,"{\"phases\":{");
+        for (i = 0;i < STATS_PHASE_COUNT;++i)
+            fprintf(stderr,"%s\"%s\":%.6f",i == 0 ? "" : ",",PHASE_NAMES[i],phase_time[i] / 1e9);
+        fprintf(stderr,"},\"children\":{\"count\":%d,\"user\":%.6f,\"sys\":%.6f,\"max_rss_kib\":%lld,"
+            "\"voluntary_switches\":%lld,\"involuntary_switches\":%lld}}\n",children.count,
+            children.user_usec / 1e6,children.sys_usec / 1e6,children.max_rss_kib,
+            children.voluntary_switches,children.involuntary_switches);
+        return;
+    }
+    for (i = 0;i < STATS_PHASE_COUNT;++i)
+        fprintf(stderr,"%s: stats: %-18s %10.3f ms\n",PROGRAM_NAME,PHASE_TITLES[i],phase_time[i] / 1e6);
+    fprintf(stderr,"%s: stats: compiler processes %10d\n",PROGRAM_NAME,children.count);
+    fprintf(stderr,"%s: stats: compiler user CPU  %10.3f ms\n",PROGRAM_NAME,children.user_usec / 1e3);
+    fprintf(stderr,"%s: stats: compiler sys CPU   %10.3f ms\n",PROGRAM_NAME,children.sys_usec / 1e3);
+    fprintf(stderr,"%s: stats: compiler peak RSS  %10lld KiB\n",PROGRAM_NAME,children.max_rss_kib);
+    fprintf(stderr,"%s: stats: context switches   %lld voluntary, %lld involuntary\n",PROGRAM_NAME,
+        children.voluntary_switches,children.involuntary_switches);
+}
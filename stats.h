@@ -0,0 +1,32 @@
+/* stats.h */
+#ifndef STATS_H
+#define STATS_H
+
+/* phases of an invocation that are timed for --stats; a phase may be
+   entered many times (e.g. once per job) and its times are summed */
+#define STATS_TOTAL 0 /* the whole invocation */
+#define STATS_SETTINGS 1 /* loading the targets file */
+#define STATS_RESOLVE 2 /* resolving and checking targets in load_session() */
+#define STATS_ASSEMBLE 3 /* building compiler command-lines */
+#define STATS_SPAWN 4 /* starting compiler processes */
+#define STATS_WAIT 5 /* waiting for compiler processes */
+#define STATS_PHASE_COUNT 6
+
+/* child_usage - resources used by finished compiler processes */
+typedef struct {
+    int count; /* number of processes */
+    long long user_usec; /* user CPU time */
+    long long sys_usec; /* system CPU time */
+    long long max_rss_kib; /* largest peak resident set size of any process */
+    long long voluntary_switches;
+    long long involuntary_switches;
+} child_usage;
+
+void reset_stats();
+void begin_phase(int phase);
+void end_phase(int phase);
+void add_child_usage(const child_usage* usage); /* count the resources of one or more finished processes */
+void print_stats(int json); /* print to stderr as text or as a JSON object on one line */
+long long get_monotonic_time(); /* system-specific implementation - returns nanoseconds since an arbitrary start */
+
+#endif
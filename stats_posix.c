@@ -0,0 +1,9 @@
+/* stats_posix.c */
+#include <time.h>
+
+long long get_monotonic_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
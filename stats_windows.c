@@ -0,0 +1,12 @@
+/* stats_windows.c */
+#include <Windows.h>
+
+long long get_monotonic_time()
+{
+	LARGE_INTEGER count;
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&count);
+	return (long long)((double)count.QuadPart * 1e9 / frequency.QuadPart);
+}
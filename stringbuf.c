@@ -5,104 +5,144 @@
 
 void init_stringbuf(stringbuf* pbuf)
 {
-    pbuf->buffer = malloc(20);
+    pbuf->buffer = pbuf->local;
     pbuf->buffer[0] = 0; /* make empty string */
     pbuf->used = 0;
-    pbuf->size = 20;
+    pbuf->size = STRINGBUF_LOCAL_SIZE;
+    pbuf->owner = NULL;
+}
+
+void init_stringbuf_arena(stringbuf* pbuf,arena* owner)
+{
+    /* nothing is taken from the arena until the string outgrows 'local' */
+    init_stringbuf(pbuf);
+    pbuf->owner = owner;
 }
 
 void destroy_stringbuf(stringbuf* pbuf)
 {
-    free(pbuf->buffer);
+    /* arena buffers are released with their arena */
+    if (pbuf->owner==NULL && pbuf->buffer!=pbuf->local)
+        heap_free(pbuf->buffer);
     pbuf->buffer = NULL;
     pbuf->used = 0;
     pbuf->size = 0;
 }
 
+void move_stringbuf(stringbuf* dest,stringbuf* src)
+{
+    *dest = *src;
+    if (src->buffer == src->local)
+        dest->buffer = dest->local;
+    src->buffer = NULL;
+    src->used = 0;
+    src->size = 0;
+}
+
 void grow_stringbuf(stringbuf* pbuf)
 {
+    reserve_stringbuf(pbuf,pbuf->size*2-1);
+}
+
+void reserve_stringbuf(stringbuf* pbuf,int length)
+{
+    /* the size at least doubles so that appending n characters one at a
+       time costs O(log n) allocations */
     int newsz;
+    char* pnew;
+    if (length < pbuf->size)
+        return;
     newsz = pbuf->size * 2;
-    if (newsz > 1) {
-        int i;
-        char* pnew;
-        pnew = malloc(newsz);
-        for (i = 0;i<pbuf->used;i++)
-            pnew[i] = pbuf->buffer[i];
-        pnew[i] = 0;
-        free(pbuf->buffer);
-        pbuf->buffer = pnew;
-        pbuf->size = newsz;
+    if (newsz <= length)
+        newsz = length + 1;
+    if (pbuf->buffer == pbuf->local) {
+        /* move the string out of the structure */
+        if (pbuf->owner != NULL)
+            pnew = arena_alloc(pbuf->owner,newsz);
+        else
+            pnew = heap_alloc(newsz);
+        memcpy(pnew,pbuf->local,pbuf->used+1);
     }
+    else if (pbuf->owner != NULL)
+        pnew = arena_grow(pbuf->owner,pbuf->buffer,pbuf->size,newsz);
+    else
+        pnew = heap_realloc(pbuf->buffer,newsz);
+    pbuf->buffer = pnew;
+    pbuf->size = newsz;
 }
 
 void assign_stringbuf(stringbuf* pbuf,const char* str)
 {
-    /* include null character */
-    int sz;
-    sz = strlen(str);
-    while (sz >= pbuf->size)
-        grow_stringbuf(pbuf);
-    strcpy(pbuf->buffer,str);
-    pbuf->used = sz;
+    pbuf->used = 0;
+    append_stringbuf(pbuf,str,strlen(str));
 }
 
 void assign_stringbuf_ex(stringbuf* pbuf,const char* str,int n)
 {
-    int sz = 0;
-    while (sz<n && str[sz])
-        ++sz;
-    n = sz;
-    while (sz >= pbuf->size)
-        grow_stringbuf(pbuf);
-    strncpy(pbuf->buffer,str,n); /* provide null terminator */
-    pbuf->buffer[n] = 0;
-    pbuf->used = n;
+    pbuf->used = 0;
+    concat_stringbuf_ex(pbuf,str,n);
+}
+
+void copy_stringbuf(stringbuf* dest,const stringbuf* src)
+{
+    dest->used = 0;
+    append_stringbuf(dest,src->buffer,src->used);
 }
 
 void concat_stringbuf(stringbuf* pbuf,const char* str)
 {
-    /* include null character */
-    int sz;
-    sz = strlen(str);
-    sz += pbuf->used;
-    while (sz >= pbuf->size)
-        grow_stringbuf(pbuf);
-    strcpy(pbuf->buffer+pbuf->used,str);
-    pbuf->used = sz;
+    append_stringbuf(pbuf,str,strlen(str));
 }
 
 void concat_stringbuf_ex(stringbuf* pbuf,const char* str,int n)
+{
+    const char* end;
+    end = memchr(str,0,n);
+    if (end != NULL)
+        n = end - str;
+    append_stringbuf(pbuf,str,n);
+}
+
+void append_stringbuf(stringbuf* pbuf,const char* bytes,int n)
 {
     /* provide null terminator */
-    int sz = 0;
-    char* app;
-    while (sz<n && str[sz])
-        ++sz;
-    n = sz;
-    sz += pbuf->used;
-    while (sz >= pbuf->size)
+    if (pbuf->used+n >= pbuf->size)
+        reserve_stringbuf(pbuf,pbuf->used+n);
+    memcpy(pbuf->buffer+pbuf->used,bytes,n);
+    pbuf->used += n;
+    pbuf->buffer[pbuf->used] = 0;
+}
+
+void append_char_stringbuf(stringbuf* pbuf,char c)
+{
+    if (pbuf->used+1 >= pbuf->size)
         grow_stringbuf(pbuf);
-    app = pbuf->buffer+pbuf->used;
-    strncpy(app,str,n);
-    app[n] = 0; /* provide null terminator */
-    pbuf->used = sz;
+    pbuf->buffer[pbuf->used++] = c;
+    pbuf->buffer[pbuf->used] = 0;
+}
+
+void append_view_stringbuf(stringbuf* pbuf,stringview view)
+{
+    append_stringbuf(pbuf,view.data,view.length);
 }
 
 void truncate_stringbuf(stringbuf* pbuf,int length)
 {
+    /* the buffer keeps its size so that the string can grow again
+       without another allocation */
     if (length>=0 && length<pbuf->used) {
         pbuf->buffer[length] = 0;
         pbuf->used = length;
-        pbuf->size = length+1;
     }
 }
 
 void append_terminator_stringbuf(stringbuf* pbuf)
 {
-    ++pbuf->used; /* include last terminator in string payload */
-    if (pbuf->used >= pbuf->size)
+    /* grow first: reserve_stringbuf() copies the string and the
+       terminator at 'used' */
+    if (pbuf->used+1 >= pbuf->size)
         grow_stringbuf(pbuf);
+    ++pbuf->used; /* include last terminator in string payload */
     pbuf->buffer[pbuf->used] = 0;
 }
 
@@ -111,3 +151,19 @@ void reset_stringbuf(stringbuf* pbuf)
     pbuf->used = 0;
     pbuf->buffer[0] = 0;
 }
+
+stringview view_stringbuf(const stringbuf* pbuf)
+{
+    stringview view;
+    view.data = pbuf->buffer;
+    view.length = pbuf->used;
+    return view;
+}
+
+stringview make_stringview(const char* str)
+{
+    stringview view;
+    view.data = str;
+    view.length = strlen(str);
+    return view;
+}
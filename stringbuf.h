@@ -1,25 +1,50 @@
 /* stringbuf.h */
 #ifndef STRINGBUF_H
 #define STRINGBUF_H
+#include "arena.h"
+
+#define STRINGBUF_LOCAL_SIZE 24 /* bytes stored inside the stringbuf before a buffer is allocated */
 
 /* string_buffer - a simple type
    that represents a null-terminated
-   string */
+   string; short strings are stored
+   in the structure itself, so a
+   stringbuf must be moved with
+   move_stringbuf() rather than
+   copied */
 typedef struct {
-    char* buffer;
+    char* buffer; /* refers to 'local' until the string outgrows it */
     int used; /* how many characters are used not including the null character */
     int size; /* how many characters are available in 'buffer' including the null character (allocation size) */
+    arena* owner; /* arena that owns 'buffer'; NULL if allocated from the heap */
+    char local[STRINGBUF_LOCAL_SIZE];
 } stringbuf;
 
+/* stringview - a string that is not owned by the view and need not be
+   null-terminated */
+typedef struct {
+    const char* data;
+    int length;
+} stringview;
+
 void init_stringbuf(stringbuf*);
+void init_stringbuf_arena(stringbuf*,arena* owner); /* buffer is allocated from (and released with) 'owner' */
 void destroy_stringbuf(stringbuf*);
-void grow_stringbuf(stringbuf*); /* grow string buffer - copy existing buffer into new buffer */
+void move_stringbuf(stringbuf* dest,stringbuf* src); /* 'dest' takes over the string; 'src' must not be used afterwards */
+void grow_stringbuf(stringbuf*); /* grow string buffer - double its size */
+void reserve_stringbuf(stringbuf*,int length); /* make room for a string of 'length' characters */
 void assign_stringbuf(stringbuf*,const char* str);
 void assign_stringbuf_ex(stringbuf*,const char* string,int n); /* assign up to null terminator or the first n bytes */
+void copy_stringbuf(stringbuf* dest,const stringbuf* src);
 void concat_stringbuf(stringbuf*,const char* str);
 void concat_stringbuf_ex(stringbuf*,const char* str,int n); /* concatenate up to null terminator or the first n bytes */
+void append_stringbuf(stringbuf*,const char* bytes,int n); /* append exactly n bytes, which may include null characters */
+void append_char_stringbuf(stringbuf*,char c);
+void append_view_stringbuf(stringbuf*,stringview view);
 void truncate_stringbuf(stringbuf*,int length); /* truncate string up to specified length */
 void append_terminator_stringbuf(stringbuf*); /* appends a zero byte to the end of the string */
 void reset_stringbuf(stringbuf*);
+stringview view_stringbuf(const stringbuf*);
+stringview make_stringview(const char* str);
 
 #endif
@@ -0,0 +1,83 @@
+/* test_check_files.c - check of the io_uring file checks run by 'make check';
+   the statx mask is made invalid so that the kernel fails each statx with
+   EINVAL and every file falls back to check_file(); the unit is included so
+   that its internal functions can be called */
+#define CHECK_STATX_MASK 0x80000000U /* STATX__RESERVED */
+#include "compiler.c"
+#include <fcntl.h>
+#include <unistd.h>
+
+#define CHECK(cond) check((cond),#cond,__LINE__)
+#define TEST_FILES 40 /* regular files checked besides a directory and a missing file */
+
+/* globals */
+const char* PROGRAM_NAME = "test_check_files";
+
+/* data internal to this unit */
+static int failures = 0;
+
+/* functions internal to this unit */
+static void check(int cond,const char* text,int line);
+
+int main()
+{
+    int i;
+    int fd;
+    int pipefds[2];
+    char dir[] = "/tmp/compile-check.XXXXXX";
+    char names[TEST_FILES+2][64];
+    const char* fileNames[TEST_FILES+2];
+    int results[TEST_FILES+2];
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr,"%s: cannot create scratch directory\n",PROGRAM_NAME);
+        return 99;
+    }
+    for (i = 0;i < TEST_FILES+2;++i) {
+        sprintf(names[i],"%s/file%d",dir,i);
+        fileNames[i] = names[i];
+        if (i < TEST_FILES)
+            close(open(names[i],O_CREAT|O_WRONLY,S_IRUSR|S_IWUSR));
+    }
+    mkdir(names[TEST_FILES],S_IRWXU);
+    /* standard input is a pipe that a stray close(0) would shut */
+    if (pipe(pipefds) == -1 || dup2(pipefds[0],0) == -1) {
+        fprintf(stderr,"%s: cannot create pipe\n",PROGRAM_NAME);
+        return 99;
+    }
+    close(pipefds[0]);
+    if (check_files_uring(fileNames,TEST_FILES+2,results) == -1) {
+        rmdir(names[TEST_FILES]);
+        for (i = 0;i < TEST_FILES;++i)
+            unlink(names[i]);
+        rmdir(dir);
+        return 77; /* no io_uring: skipped */
+    }
+    for (i = 0;i < TEST_FILES;++i)
+        CHECK(results[i] == FILE_CHECK_SUCCESS);
+    CHECK(results[TEST_FILES] == FILE_CHECK_NOT_REGULAR_FILE);
+    CHECK(results[TEST_FILES+1] == FILE_CHECK_DOES_NOT_EXIST);
+    CHECK(fcntl(0,F_GETFD) != -1);
+    /* no descriptor was left open either */
+    fd = open(names[0],O_RDONLY);
+    CHECK(fd == pipefds[0]);
+    close(fd);
+    rmdir(names[TEST_FILES]);
+    for (i = 0;i < TEST_FILES;++i)
+        unlink(names[i]);
+    rmdir(dir);
+    if (failures > 0) {
+        fprintf(stderr,"%s: %d checks failed\n",PROGRAM_NAME,failures);
+        return 1;
+    }
+    return 0;
+}
+
+/* definitions of internal functions */
+
+void check(int cond,const char* text,int line)
+{
+    if (!cond) {
+        fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,line,text);
+        ++failures;
+    }
+}
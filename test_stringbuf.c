@@ -0,0 +1,160 @@
+/* test_stringbuf.c - checks of stringbuf storage run by 'make check': short
+   strings inside the structure, moving them to heap and arena buffers, and
+   growth at the size of the inline buffer */
+#include "stringbuf.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond) check((cond),#cond,__LINE__)
+
+/* globals */
+const char* PROGRAM_NAME = "test_stringbuf";
+
+/* data internal to this unit */
+static int failures = 0;
+
+/* functions internal to this unit */
+static void check(int cond,const char* text,int line);
+static void fill(char* dest,int n); /* n letters and a terminator */
+static void test_inline();
+static void test_growth(arena* owner);
+static void test_terminator(arena* owner);
+static void test_move();
+
+int main()
+{
+    arena pool;
+    test_inline();
+    test_growth(NULL);
+    test_terminator(NULL);
+    init_arena(&pool);
+    test_growth(&pool);
+    test_terminator(&pool);
+    destroy_arena(&pool);
+    test_move();
+    if (failures > 0) {
+        fprintf(stderr,"%s: %d checks failed\n",PROGRAM_NAME,failures);
+        return 1;
+    }
+    return 0;
+}
+
+/* definitions of internal functions */
+
+void check(int cond,const char* text,int line)
+{
+    if (!cond) {
+        fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,line,text);
+        ++failures;
+    }
+}
+
+void fill(char* dest,int n)
+{
+    int i;
+    for (i = 0;i < n;++i)
+        dest[i] = 'a' + i%26;
+    dest[n] = 0;
+}
+
+void test_inline()
+{
+    /* a string that fits with its terminator stays in the structure */
+    char text[STRINGBUF_LOCAL_SIZE];
+    stringbuf buf;
+    fill(text,STRINGBUF_LOCAL_SIZE-1);
+    init_stringbuf(&buf);
+    CHECK(buf.buffer == buf.local);
+    assign_stringbuf(&buf,text);
+    CHECK(buf.buffer == buf.local);
+    CHECK(buf.used == STRINGBUF_LOCAL_SIZE-1);
+    CHECK(strcmp(buf.buffer,text) == 0);
+    reset_stringbuf(&buf);
+    CHECK(buf.used==0 && buf.buffer[0]==0);
+    destroy_stringbuf(&buf);
+}
+
+void test_growth(arena* owner)
+{
+    /* strings of 23, 24 and 25 characters appended at once, a character at
+       a time and after reserving room */
+    int n, i;
+    char text[STRINGBUF_LOCAL_SIZE+2];
+    stringbuf buf;
+    for (n = STRINGBUF_LOCAL_SIZE-1;n <= STRINGBUF_LOCAL_SIZE+1;++n) {
+        fill(text,n);
+        init_stringbuf_arena(&buf,owner);
+        append_stringbuf(&buf,text,n);
+        CHECK(buf.used == n);
+        CHECK(buf.size > n);
+        CHECK(strcmp(buf.buffer,text) == 0);
+        CHECK((buf.buffer == buf.local) == (n < STRINGBUF_LOCAL_SIZE));
+        destroy_stringbuf(&buf);
+
+        init_stringbuf_arena(&buf,owner);
+        for (i = 0;i < n;++i)
+            append_char_stringbuf(&buf,text[i]);
+        CHECK(buf.used == n);
+        CHECK(strcmp(buf.buffer,text) == 0);
+        destroy_stringbuf(&buf);
+
+        init_stringbuf_arena(&buf,owner);
+        assign_stringbuf(&buf,"x");
+        reserve_stringbuf(&buf,n);
+        CHECK(buf.size > n);
+        CHECK(strcmp(buf.buffer,"x") == 0);
+        concat_stringbuf(&buf,text+1);
+        CHECK(buf.used == n);
+        CHECK(strcmp(buf.buffer+1,text+1) == 0);
+        destroy_stringbuf(&buf);
+    }
+}
+
+void test_terminator(arena* owner)
+{
+    /* a terminator appended to a string that fills 'local' moves it out */
+    int n;
+    char text[STRINGBUF_LOCAL_SIZE+2];
+    stringbuf buf;
+    for (n = STRINGBUF_LOCAL_SIZE-2;n <= STRINGBUF_LOCAL_SIZE;++n) {
+        fill(text,n);
+        init_stringbuf_arena(&buf,owner);
+        assign_stringbuf(&buf,text);
+        append_terminator_stringbuf(&buf);
+        CHECK(buf.used == n+1);
+        CHECK(buf.size > n+1);
+        CHECK(memcmp(buf.buffer,text,n+1) == 0);
+        CHECK(buf.buffer[n+1] == 0);
+        append_stringbuf(&buf,"yz",2);
+        CHECK(buf.used == n+3);
+        CHECK(memcmp(buf.buffer+n,"\0yz",4) == 0);
+        destroy_stringbuf(&buf);
+    }
+}
+
+void test_move()
+{
+    /* a moved string stays in the destination's structure if it was short
+       and keeps its buffer otherwise */
+    char text[STRINGBUF_LOCAL_SIZE*2];
+    const char* heap;
+    stringbuf src, dest;
+    init_stringbuf(&src);
+    assign_stringbuf(&src,"short");
+    move_stringbuf(&dest,&src);
+    CHECK(dest.buffer == dest.local);
+    CHECK(strcmp(dest.buffer,"short") == 0);
+    CHECK(src.buffer == NULL);
+    append_stringbuf(&dest,"er",2);
+    CHECK(strcmp(dest.buffer,"shorter") == 0);
+    destroy_stringbuf(&dest);
+
+    fill(text,sizeof(text)-1);
+    init_stringbuf(&src);
+    assign_stringbuf(&src,text);
+    heap = src.buffer;
+    move_stringbuf(&dest,&src);
+    CHECK(dest.buffer == heap);
+    CHECK(strcmp(dest.buffer,text) == 0);
+    destroy_stringbuf(&dest);
+}
@@ -0,0 +1,25 @@
+# tests/alloc-stats.sh - --alloc-stats
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+END
+i=0
+while test $i -lt 200; do
+    echo "exit 0" >t$i.q
+    i=`expr $i + 1`
+done
+
+# allocs - the number of heap allocations reported for a command
+allocs() {
+    run --alloc-stats "$@" 2>&1 >/dev/null | sed -n 's/.*heap allocations: \([0-9]*\), frees: [0-9]*$/\1/p'
+}
+
+one=`allocs t0.q`
+test -n "$one" || fail "no allocation counters reported"
+test "$one" -gt 0 || fail "no allocations counted"
+
+# the strings of a command come from arenas, so the number of allocations
+# does not grow with the number of targets
+many=`allocs t*.q`
+test "$many" -lt `expr $one + 50` || fail "$many allocations for 200 targets, $one for one"
@@ -0,0 +1,31 @@
+# tests/arguments.sh - command lines of any length and failures to start a compiler
+. "$srcdir/tests/common.sh"
+
+printf '#!/bin/sh\necho $# >count\n' >"$SCRATCH/bin/count"
+chmod +x "$SCRATCH/bin/count"
+rules <<'END'
+.q count
+.r missing-program-for-test
+.s count >nodir/$project.out
+END
+
+# every target and option reaches the compiler
+i=0
+args=
+while test $i -lt 700; do
+    touch t$i.q
+    args="$args t$i.q -D$i"
+    i=`expr $i + 1`
+done
+run $args || fail "long command failed"
+test "`cat count`" = 1400 || fail "the compiler was given `cat count` arguments instead of 1400"
+
+# a program that cannot be found is reported
+touch a.r
+if run a.r 2>err; then fail "a missing program succeeded"; fi
+grep -q missing-program-for-test err || fail "the missing program was not named"
+
+# so is a redirect file that cannot be opened
+touch a.s
+if run a.s 2>err; then fail "an unwritable redirect file succeeded"; fi
+grep -q "nodir/a.out" err || fail "the redirect file was not named"
@@ -0,0 +1,52 @@
+# tests/batch.sh - --batch
+. "$srcdir/tests/common.sh"
+
+printf '#!/bin/sh\nfor a; do printf "%%s|" "$a"; done >>args\necho >>args\n' >"$SCRATCH/bin/show"
+chmod +x "$SCRATCH/bin/show"
+rules <<'END'
+.q show
+.s sh
+END
+touch a.q b.q "with space.q"
+
+# each line is a command; quotes work as in the shell and '#' starts a comment
+cat >list <<'END'
+a.q -Done
+# a.q -Dcomment
+"with space.q" '-Dtwo words'
+
+b.q
+END
+run --batch list -Dall || fail "--batch with a file failed"
+sort args >got
+printf '%s\n' "a.q|-Dall|-Done|" "b.q|-Dall|" "with space.q|-Dall|-Dtwo words|" >expected
+cmp got expected || fail "wrong commands: `cat got`"
+
+# records are read from standard input, and may end with null characters
+rm args
+printf 'a.q -Dx\0b.q\0' | run --batch || fail "--batch from standard input failed"
+sort args >got
+printf '%s\n' "a.q|-Dx|" "b.q|" >expected
+cmp got expected || fail "wrong commands from null-terminated records: `cat got`"
+rm args
+echo a.q | run --batch=- || fail "--batch=- failed"
+test "`cat args`" = "a.q|" || fail "wrong command from --batch=-"
+
+# --jobs N runs up to N records at once
+for t in s1 s2 s3 s4; do
+    printf 'echo start >>log\nsleep 1\necho end >>log\n' >$t.s
+done
+printf '%s\n' s1.s s2.s s3.s s4.s | run --batch --jobs 2 || fail "--batch --jobs failed"
+max=`awk '/^start/ {++n; if (n>m) m=n} /^end/ {--n} END {print m}' log`
+test "$max" = 2 || fail "$max records ran at once instead of 2"
+
+# no records are started after one fails unless --keep-going is given
+echo "exit 1" >bad.s
+echo "echo ran >>ran" >ran.s
+if printf '%s\n' bad.s ran.s ran.s | run --batch 2>/dev/null; then fail "a failed record succeeded"; fi
+test ! -f ran || fail "records were started after a failure"
+if printf '%s\n' bad.s ran.s ran.s | run --batch --keep-going 2>/dev/null; then fail "a failed record succeeded"; fi
+test `wc -l <ran | tr -d ' '` = 2 || fail "--keep-going did not run every record"
+
+# an error in one record does not stop the others
+if printf '%s\n' missing.q a.q | run --batch --keep-going 2>/dev/null; then fail "a missing target succeeded"; fi
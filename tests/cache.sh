@@ -0,0 +1,53 @@
+# tests/cache.sh - --cache, --cache-stats and --cache-size
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q fakecc -o$project -MF$depfile
+END
+echo "include inc.h" >a.q
+echo "header" >inc.h
+
+# count - the number of times the compiler has run
+count() {
+    wc -l <runs | tr -d ' '
+}
+
+# stat NAME - a line of the --cache-stats report
+stat() {
+    run --cache-stats | sed -n "s/^$1: //p"
+}
+
+run --cache a.q || fail "first build failed"
+test `count` = 1 || fail "compiler did not run once"
+cp a a.expected
+
+# a removed output is restored from the cache without running the compiler
+rm a
+run --cache a.q >out || fail "cached build failed"
+test `count` = 1 || fail "a cached output was compiled again"
+grep -q "restored from cache" out || fail "restored output not reported"
+cmp a a.expected || fail "restored output differs"
+
+# a dependency with new contents is a miss
+echo "new header" >inc.h
+run --cache a.q || fail "build after changing the header failed"
+test `count` = 2 || fail "a changed dependency did not miss the cache"
+grep -q "new header" a || fail "stale output after changing the header"
+
+test "`stat hits`" = 1 || fail "wrong hit count"
+test "`stat misses`" = 2 || fail "wrong miss count"
+
+# --cache-size sets the maximum size
+run --cache-size=2M || fail "--cache-size failed"
+test "`stat 'max size'`" = "2048 KiB" || fail "--cache-size=2M not applied"
+if run --cache-size=12X 2>/dev/null; then fail "an invalid size was accepted"; fi
+
+# entries beyond the maximum size are evicted
+awk 'BEGIN { for (i = 0;i < 200;++i) print "a line to make the output bigger than the cache" }' >big.q
+run --cache-size=4K || fail "--cache-size failed"
+run --cache big.q || fail "build of big target failed"
+test "`stat size`" = "0 KiB" || fail "cache was not shrunk below its maximum size"
+n=`count`
+rm big
+run --cache big.q || fail "build of big target failed"
+test `count` = `expr $n + 1` || fail "an evicted entry was restored"
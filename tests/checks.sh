@@ -0,0 +1,35 @@
+# tests/checks.sh - checks of the targets before any compiler runs
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+END
+i=0
+targets=
+while test $i -lt 300; do
+    echo "exit 0" >t$i.q
+    targets="$targets t$i.q"
+    i=`expr $i + 1`
+done
+
+run $targets || fail "valid targets failed"
+
+# a missing target among many is reported and nothing is compiled
+echo "echo ran >ran" >first.q
+if run first.q $targets gone.q 2>err; then fail "a missing target succeeded"; fi
+grep -q "'gone.q' does not exist" err || fail "the missing target was not reported"
+test ! -f ran || fail "a compiler ran despite a missing target"
+
+# a target that is not a regular file
+mkdir dir.q
+if run first.q dir.q 2>err; then fail "a directory target succeeded"; fi
+grep -q "'dir.q' is not a regular file" err || fail "a directory target was not reported"
+
+# a target that cannot be read (not testable as root)
+echo "exit 0" >locked.q
+chmod 000 locked.q
+if ! test -r locked.q; then
+    if run first.q locked.q 2>err; then fail "an unreadable target succeeded"; fi
+    grep -q "permission denied" err || fail "an unreadable target was not reported"
+fi
+chmod 644 locked.q
@@ -0,0 +1,66 @@
+# tests/common.sh - sourced by each test script; runs the test in a scratch
+# directory with its own settings directory so that the user's settings and
+# any running server are left alone
+
+set -e
+
+if test -z "$COMPILE"; then
+    echo "COMPILE must name the compile program" >&2
+    exit 99
+fi
+
+SCRATCH=`mktemp -d "${TMPDIR:-/tmp}/compile-test.XXXXXX"`
+# background processes listed in DAEMONS are stopped when the test ends
+DAEMONS=
+trap 'for p in $DAEMONS; do kill $p 2>/dev/null || true; done; rm -rf "$SCRATCH"' EXIT
+HOME=$SCRATCH/home
+export HOME
+unset MAKEFLAGS MFLAGS
+mkdir -p "$HOME/.compile" "$SCRATCH/work" "$SCRATCH/bin"
+PATH=$SCRATCH/bin:$PATH
+cd "$SCRATCH/work"
+
+# fakecc TARGET... -oOUTPUT [-MFDEPFILE] - a compiler that writes its targets
+# and the files named by their 'include' lines to OUTPUT, lists them in
+# DEPFILE and then logs the run in 'runs'; a target holding 'error' fails
+cat >"$SCRATCH/bin/fakecc" <<'END'
+#!/bin/sh
+out= dep= srcs=
+for a; do
+    case $a in
+    -o*) out=${a#-o} ;;
+    -MF*) dep=${a#-MF} ;;
+    -*) ;;
+    *) srcs="$srcs $a" ;;
+    esac
+done
+if grep -q '^error' $srcs; then
+    echo "fakecc: error in$srcs" >&2
+    echo "$srcs" >>runs
+    exit 1
+fi
+deps=$srcs
+for s in $srcs; do
+    deps="$deps `sed -n 's/^include //p' $s`"
+done
+cat $deps >"$out"
+test -z "$dep" || echo "$out:$deps" >"$dep"
+echo "$srcs" >>runs
+END
+chmod +x "$SCRATCH/bin/fakecc"
+
+# rules - replace the targets file with the rules on standard input
+rules() {
+    cat >"$HOME/.compile/targets"
+}
+
+# fail - report a failed check and stop the test
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+# run - run compile in this process, never through a server
+run() {
+    "$COMPILE" --no-server "$@"
+}
@@ -0,0 +1,45 @@
+# tests/extensions.sh - resolution of targets given without an extension
+. "$srcdir/tests/common.sh"
+
+printf '#!/bin/sh\necho "$@" >used\n' >"$SCRATCH/bin/show"
+chmod +x "$SCRATCH/bin/show"
+rules <<'END'
+.q show
+.r show
+END
+
+# resolves TARGET EXPECTED - check that TARGET is compiled as EXPECTED
+resolves() {
+    run $1 || fail "target $1 failed"
+    test "`cat used`" = "$2" || fail "target $1 resolved to '`cat used`' instead of '$2'"
+}
+
+# a small directory is scanned
+mkdir small
+touch small/a.q small/b.r small/c.txt
+ln -s a.q small/link.q
+resolves small/a small/a.q
+resolves small/b small/b.r
+resolves small/link small/link.q
+
+# a large directory is probed for each extension
+mkdir large
+i=0
+while test $i -lt 2000; do
+    touch large/f$i.txt
+    i=`expr $i + 1`
+done
+touch large/a.q large/b.r
+ln -s a.q large/link.q
+resolves large/a large/a.q
+resolves large/b large/b.r
+resolves large/link large/link.q
+
+# a target matching no file or several files is an error
+touch small/two.q small/two.r
+if run small/none 2>err; then fail "a missing target succeeded"; fi
+grep -q "did not match" err || fail "a missing target was not reported"
+if run small/two 2>err; then fail "an ambiguous target succeeded"; fi
+grep -q "ambiguously" err || fail "an ambiguous target was not reported"
+if run large/none 2>err; then fail "a missing target succeeded"; fi
+grep -q "did not match" err || fail "a missing target was not reported"
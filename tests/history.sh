@@ -0,0 +1,55 @@
+# tests/history.sh - --history and the history file
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+END
+history=$HOME/.compile/history
+for t in a b c d; do
+    echo "echo start $t >>log; sleep 0.2" >$t.q
+done
+echo "echo start slow >>log; sleep 1" >slow.q
+echo "exit 1" >bad.q
+
+# each successful job is recorded under its program and full path
+run --jobs 2 a.q b.q slow.q || fail "first build failed"
+if run bad.q 2>/dev/null; then fail "a failed job succeeded"; fi
+run --history >out || fail "--history failed"
+grep -q "^targets: 3$" out || fail "wrong number of targets: `cat out`"
+grep -q "^runs: 3$" out || fail "wrong number of runs: `cat out`"
+grep -q " sh `pwd`/slow.q$" out || fail "the slow target was not listed"
+if grep -q "bad.q" out; then fail "a failed job was recorded"; fi
+
+# the slowest target is listed first, and --history=N lists N targets
+run --history=1 >out || fail "--history=1 failed"
+test `grep -c " sh /" out` = 1 || fail "--history=1 did not list one target"
+grep -q "slow.q$" out || fail "the slowest target was not listed first"
+if run --history=0 2>/dev/null; then fail "--history=0 was accepted"; fi
+
+# jobs that have not run before start first, then the slowest
+rm log
+run --jobs 2 a.q b.q c.q d.q slow.q || fail "second build failed"
+head -2 log | sort | tr "\n" " " | grep -q "^start c start d $" || fail "the new jobs did not start first: `cat log`"
+rm log
+run --jobs 2 a.q b.q c.q d.q slow.q || fail "third build failed"
+head -2 log | grep -q "start slow" || fail "the slowest job did not start first: `cat log`"
+
+# a history file beyond 1 MiB is compacted to the latest eight runs of the
+# most recently compiled targets; this builds one with 12 runs of each of
+# 3000 targets
+awk 'BEGIN { for (t = 0;t < 3000;++t) for (r = 0;r < 12;++r)
+                 printf "%016x %d %d 1000 sh /old/target%d.q\n", t+1, 1000000+t*100+r, 1000+r, t }' >"$history"
+run a.q || fail "build with a large history failed"
+size=`wc -c <"$history" | tr -d ' '`
+test $size -le 600000 || fail "the history file was not compacted: $size bytes"
+grep -q " sh `pwd`/a.q$" "$history" || fail "the latest run was not kept"
+grep -q " /old/target2999.q$" "$history" || fail "the most recent old target was not kept"
+if grep -q " /old/target0.q$" "$history"; then fail "the oldest target was kept"; fi
+test `grep -c " /old/target2999.q$" "$history"` = 8 || fail "not the latest eight runs were kept"
+grep " /old/target2999.q$" "$history" | grep -q " 1299911 " || fail "the latest run of a target was dropped"
+run --history >/dev/null || fail "--history failed after compacting"
+
+# the file may be deleted
+rm "$history"
+run --history >out || fail "--history without a history file failed"
+grep -q "^targets: 0$" out || fail "targets listed without a history file"
@@ -0,0 +1,61 @@
+# tests/incremental.sh - --incremental
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q fakecc -o$project -MF$depfile
+END
+echo "include inc.h" >a.q
+echo "header" >inc.h
+
+# count - the number of times the compiler has run
+count() {
+    wc -l <runs | tr -d ' '
+}
+
+run --incremental a.q || fail "first build failed"
+test -f a || fail "no output"
+test `count` = 1 || fail "compiler did not run once"
+
+run --incremental a.q >out || fail "second build failed"
+test `count` = 1 || fail "an up to date target was compiled again"
+grep -q "up to date" out || fail "up to date target not reported"
+
+# a newer dependency from the depfile causes a rebuild
+sleep 1
+touch inc.h
+run --incremental a.q || fail "build after touching the header failed"
+test `count` = 2 || fail "a changed dependency did not cause a rebuild"
+
+# so does a newer target or a missing output
+sleep 1
+touch a.q
+run --incremental a.q || fail "build after touching the target failed"
+test `count` = 3 || fail "a changed target did not cause a rebuild"
+rm a
+run --incremental a.q || fail "build after removing the output failed"
+test `count` = 4 || fail "a missing output did not cause a rebuild"
+
+# a failed build forgets the dependencies, so the next run compiles again
+# even though the old output is newer than everything
+sleep 1
+echo "error" >>a.q
+if run --incremental a.q 2>/dev/null; then fail "a failed compile succeeded"; fi
+sed '/^error/d' a.q >a.tmp && mv a.tmp a.q
+sleep 1
+touch a
+run --incremental a.q || fail "build after a failure failed"
+test `count` = 6 || fail "the job was not compiled after a failure"
+
+# without --incremental the compiler always runs
+run a.q || fail "plain build failed"
+test `count` = 7 || fail "the compiler did not run without --incremental"
+
+# the dependency directory is only needed by jobs that have a depfile
+rules <<'END'
+.q fakecc -o$project
+END
+rm -rf "$HOME/.compile/deps"
+touch "$HOME/.compile/deps"
+run a.q || fail "a job without a depfile needed the dependency directory"
+if run --incremental a.q 2>err; then fail "an incremental build had no dependency directory"; fi
+grep -q "cannot create dependency directory" err || fail "the missing dependency directory was not reported"
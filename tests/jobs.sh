@@ -0,0 +1,37 @@
+# tests/jobs.sh - --jobs and --keep-going
+. "$srcdir/tests/common.sh"
+
+# each target is a script that logs when it starts and ends; 'sh' is given
+# the targets, so it runs the first one
+rules <<'END'
+.q sh
+END
+for t in a b c d bad; do
+    cat >$t.q <<'END'
+echo "start $0" >>log
+sleep 1
+echo "end $0" >>log
+case $0 in bad*) exit 1 ;; esac
+END
+done
+
+# without --jobs the targets are passed to one compiler
+run a.q b.q || fail "single compiler failed"
+test `grep -c start log` = 1 || fail "targets were not passed to one compiler"
+
+# --jobs 2 runs every target as a job, two at a time
+rm -f log
+run --jobs 2 a.q b.q c.q d.q || fail "jobs failed"
+test `grep -c start log` = 4 || fail "not every target ran as a job"
+max=`awk '/^start/ {++n; if (n>m) m=n} /^end/ {--n} END {print m}' log`
+test "$max" = 2 || fail "$max jobs ran at once instead of 2"
+
+# a failed job fails the command and no new jobs are started after it
+rm -f log
+if run --jobs=1 bad.q a.q b.q; then fail "a failed job did not fail the command"; fi
+test `grep -c start log` = 1 || fail "jobs were started after a failure"
+
+# --keep-going starts the remaining jobs
+rm -f log
+if run --jobs=1 --keep-going bad.q a.q b.q; then fail "a failed job did not fail the command"; fi
+test `grep -c start log` = 3 || fail "--keep-going did not start every job"
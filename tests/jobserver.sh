@@ -0,0 +1,60 @@
+# tests/jobserver.sh - the jobserver named by MAKEFLAGS
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+END
+targets=
+for t in t1 t2 t3 t4 t5 t6; do
+    printf 'echo start >>log\nsleep 1\necho end >>log\n' >$t.q
+    targets="$targets $t.q"
+done
+
+# most - the largest number of compilers that ran at once; clears the log
+most() {
+    awk '/^start/ {++n; if (n>m) m=n} /^end/ {--n} END {print m}' log
+    rm log
+}
+
+# without a jobserver --jobs alone limits the compilers
+run --jobs 4 $targets || fail "--jobs failed"
+test `most` = 4 || fail "--jobs 4 did not run 4 compilers at once"
+
+# a jobserver that cannot be used is ignored
+MAKEFLAGS="-j2 --jobserver-auth=97,98" run --jobs 4 $targets || fail "an unusable jobserver pipe failed"
+test `most` = 4 || fail "an unusable jobserver pipe limited the compilers"
+MAKEFLAGS="-j2 --jobserver-auth=fifo:$SCRATCH/none" run --jobs 4 $targets || fail "a missing jobserver fifo failed"
+test `most` = 4 || fail "a missing jobserver fifo limited the compilers"
+
+# a jobserver fifo holding two tokens allows three compilers, counting the
+# one that runs on make's implicit token; the tokens are returned, so the
+# next command can take them again
+mkfifo fifo
+exec 5<>fifo
+printf '++' >&5
+for i in 1 2; do
+    MAKEFLAGS=" -j3 --jobserver-auth=fifo:$SCRATCH/work/fifo" run --jobs 8 $targets || fail "jobserver fifo failed"
+    test `most` = 3 || fail "a jobserver with two tokens did not run 3 compilers at once"
+done
+exec 5>&-
+
+# make's jobserver pipe is used by recipes that make runs as recursive
+cat >Makefile <<END
+all:
+	+"\$(COMPILE)" --no-server --jobs 8 $targets
+END
+make -s -j2 >/dev/null || fail "compile run by make -j2 failed"
+test `most` = 2 || fail "make -j2 did not limit the compilers to 2"
+
+# a server runs the command with the client's jobserver
+"$COMPILE" --server 2>/dev/null &
+DAEMONS="$DAEMONS $!"
+n=0
+while test ! -S "$HOME/.compile/server.sock"; do
+    n=`expr $n + 1`
+    test $n -lt 100 || fail "the server did not start"
+    sleep 0.1
+done
+sed 's/ --no-server//' Makefile >Makefile.server
+make -s -j2 -f Makefile.server >/dev/null || fail "compile run by make -j2 through a server failed"
+test `most` = 2 || fail "make -j2 did not limit the compilers of a server to 2"
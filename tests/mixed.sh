@@ -0,0 +1,27 @@
+# tests/mixed.sh - targets of several rules in one command
+. "$srcdir/tests/common.sh"
+
+# the compiler logs its arguments (the targets and then the project) and
+# when it starts and ends
+printf '#!/bin/sh\necho "$*" >>groups\necho start >>log\nsleep 1\necho end >>log\ncase "$*" in *bad*) exit 1 ;; esac\n' >"$SCRATCH/bin/group"
+chmod +x "$SCRATCH/bin/group"
+rules <<'END'
+.q group -p$project
+.r group -p$project
+END
+touch a.q b.q c.r d.r bad.r
+
+# each rule's targets go to their own compiler, in command-line order, with
+# a project of their own; a target without an extension has the extension
+# of the one before it
+run a.q c.r d b.q || fail "mixed targets failed"
+sort groups >got
+printf '%s\n' "a.q b.q -pa" "c.r d.r -pc" >expected
+cmp got expected || fail "wrong groups: `cat got`"
+
+# the groups run at the same time
+max=`awk '/^start/ {++n; if (n>m) m=n} /^end/ {--n} END {print m}' log`
+test "$max" = 2 || fail "the groups did not run at the same time"
+
+# the command fails if any group fails
+if run a.q bad.r 2>/dev/null; then fail "a failed group did not fail the command"; fi
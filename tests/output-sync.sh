@@ -0,0 +1,49 @@
+# tests/output-sync.sh - --output-sync
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+.r sh
+END
+# each .q target writes three lines with pauses between them; each .r
+# target writes a line in two pieces
+for t in a b c; do
+    printf 'for i in 1 2 3; do echo "$0 $i"; sleep 0.2; done\n' >$t.q
+    printf 'printf "$0 "; sleep 0.3; echo end\n' >$t.r
+done
+
+# blocks - check that the output in 'out' is one block per job
+blocks() {
+    test `grep -c '^==> ' out` = 3 || fail "$1: `grep -c '^==> ' out` headers instead of 3"
+    awk '/^==> / { job = $2; n = 0; next }
+         { if ($1 != job) bad = 1; ++n }
+         END { exit bad }' out || fail "$1: the output of jobs was interleaved"
+    test `wc -l <out | tr -d ' '` = 12 || fail "$1: output lines were lost"
+}
+
+# job mode writes each job's output as a block under a header
+run --output-sync --jobs 3 a.q b.q c.q >out 2>&1 || fail "--output-sync failed"
+blocks "--output-sync"
+run --output-sync=job --jobs 3 a.q b.q c.q >out 2>&1 || fail "--output-sync=job failed"
+blocks "--output-sync=job"
+
+# it is the default for more than one job at once
+run --jobs 3 a.q b.q c.q >out 2>&1 || fail "--jobs failed"
+blocks "--jobs 3"
+
+# line mode writes whole lines
+run --output-sync=line --jobs 3 a.r b.r c.r >out 2>&1 || fail "--output-sync=line failed"
+test `grep -c '^[abc]\.r end$' out` = 3 || fail "--output-sync=line split lines: `cat out`"
+
+# none lets the compilers write directly
+run --output-sync=none --jobs 3 a.q b.q c.q >out 2>&1 || fail "--output-sync=none failed"
+test `grep -c '^==> ' out` = 0 || fail "--output-sync=none wrote headers"
+test `wc -l <out | tr -d ' '` = 9 || fail "--output-sync=none lost output"
+
+# standard output and error stay apart, and the exit status is kept
+echo 'echo out; echo err >&2; exit 1' >bad.q
+if run --output-sync --jobs 2 a.q bad.q >out 2>err; then fail "a failed job succeeded"; fi
+grep -q "^out$" out || fail "standard output of a job was not written to standard output"
+grep -q "^err$" err || fail "standard error of a job was not written to standard error"
+if grep -q "^out$" err; then fail "standard output of a job was written to standard error"; fi
+if run --output-sync=bogus a.q 2>/dev/null; then fail "an unknown mode was accepted"; fi
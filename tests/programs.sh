@@ -0,0 +1,49 @@
+# tests/programs.sh - the cache of program paths in ~/.compile/programs
+. "$srcdir/tests/common.sh"
+
+# tool DIR - install a program 'tool' in DIR that names DIR when it runs
+tool() {
+    mkdir -p $SCRATCH/$1
+    printf '#!/bin/sh\necho %s >used\n' $1 >$SCRATCH/$1/tool
+    chmod +x $SCRATCH/$1/tool
+}
+
+# check PATH DIR - check that the program in DIR runs under PATH
+check() {
+    PATH=$1 run a.q || fail "run with PATH=$1 failed"
+    test "`cat used`" = $2 || fail "ran the program in `cat used` instead of $2"
+}
+
+rules <<'END'
+.q tool
+END
+touch a.q
+tool one
+tool two
+
+check $SCRATCH/one:$PATH one
+test -s $HOME/.compile/programs || fail "no program paths were kept"
+check $SCRATCH/one:$PATH one
+
+# a different PATH searches again
+check $SCRATCH/two:$SCRATCH/one:$PATH two
+
+# so does a program added to a directory that comes earlier in PATH
+mkdir -p $SCRATCH/zero
+check $SCRATCH/zero:$SCRATCH/one:$PATH one
+sleep 1
+tool zero
+check $SCRATCH/zero:$SCRATCH/one:$PATH zero
+
+# and a program that was removed
+sleep 1
+rm $SCRATCH/zero/tool
+check $SCRATCH/zero:$SCRATCH/one:$PATH one
+sleep 1
+rm $SCRATCH/one/tool
+if PATH=$SCRATCH/zero:$SCRATCH/one:$PATH run a.q 2>err; then fail "a removed program was run"; fi
+grep -q "'tool' not found" err || fail "a missing program was not reported"
+
+# the file may be deleted
+rm $HOME/.compile/programs
+check $SCRATCH/two:$PATH two
@@ -0,0 +1,38 @@
+# tests/resources.sh - resource classes of rules
+. "$srcdir/tests/common.sh"
+
+# each target writes a setting of the process that runs it
+echo 'ps -o nice= -p $$ | tr -d " " >got' >nice.q
+echo 'ulimit -n >got' >nofile.q
+echo 'ulimit -f >got' >fsize.q
+echo 'grep "^Cpus_allowed_list:" /proc/self/status | tr -d " \t" >got' >cpus.q
+echo 'ionice -p $$ >got' >ioclass.q
+
+# check RULE TARGET EXPECTED - check that TARGET writes EXPECTED under RULE
+check() {
+    echo "$1" | rules
+    run $2 || fail "'$1' failed"
+    test "`cat got`" = "$3" || fail "'$1' gave '`cat got`' instead of '$3'"
+}
+
+base=`ps -o nice= -p $$ | tr -d " "`
+check ".q sh @nice=5" nice.q `expr $base + 5`
+check ".q sh @rlimit_nofile=64" nofile.q 64
+check ".q sh @rlimit_fsize=unlimited" fsize.q unlimited
+if test -r /proc/self/status && grep -q "^Cpus_allowed_list:" /proc/self/status; then
+    check ".q sh @cpus=0" cpus.q "Cpus_allowed_list:0"
+fi
+if command -v ionice >/dev/null 2>&1 && ionice -c 3 true 2>/dev/null; then
+    check ".q sh @ioclass=idle" ioclass.q idle
+fi
+
+# other tokens that begin with '@' are passed to the compiler
+echo 'echo "$1" >got' >at.q
+check ".q sh @options.rsp" at.q @options.rsp
+
+# an invalid value in a resource token is an error
+for bad in "@nice=high" "@cpus=x" "@ioclass=fast" "@rlimit_nofile=-3"; do
+    echo ".q sh $bad" | rules
+    if run nice.q 2>err; then fail "'$bad' was accepted"; fi
+    grep -q "invalid value" err || fail "'$bad' was not reported"
+done
@@ -0,0 +1,38 @@
+# tests/rules.sh - lookup of rules in a large targets file
+. "$srcdir/tests/common.sh"
+
+# rule N prints its number; the targets file has many rules and repeats the
+# extension of the first and last of them
+printf '#!/bin/sh\necho "$2" >used\n' >"$SCRATCH/bin/rule"
+chmod +x "$SCRATCH/bin/rule"
+awk 'BEGIN { for (i = 0;i < 500;++i) printf ".e%d rule %d\n", i, i
+             print ".e0 rule dup0"
+             print ".e499 rule dup499" }' | rules
+
+for n in 0 1 250 498 499; do
+    touch a.e$n
+    run a.e$n 2>err || fail "rule .e$n failed"
+    test "`cat used`" = $n || fail "target a.e$n used rule `cat used`"
+done
+
+# the first rule for a repeated extension is used, with a warning
+grep -q "multiple times" err || fail "repeated extension not reported"
+
+# an unknown extension is an error
+touch a.zz
+if run a.zz 2>/dev/null; then fail "a target without a rule was compiled"; fi
+
+# only the rules that a command uses are parsed, so an error in another rule
+# does not stop it
+rules <<'END'
+.q rule ok
+.bad
+.r rule >
+END
+touch a.q a.bad a.r
+run a.q 2>err || fail "a good rule failed because of bad ones"
+test "`cat used`" = ok || fail "the good rule was not used"
+if run a.bad 2>err; then fail "a rule without a program was used"; fi
+grep -q "expected program name" err || fail "a rule without a program was not reported"
+if run a.r 2>err; then fail "a rule with a bad redirect was used"; fi
+grep -q "requires operand" err || fail "a rule with a bad redirect was not reported"
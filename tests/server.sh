@@ -0,0 +1,67 @@
+# tests/server.sh - --server and --no-server
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+END
+socket=$HOME/.compile/server.sock
+
+# each target writes the pid of the process that started it to 'parent'
+cat >a.q <<'END'
+echo $PPID >parent
+pwd >dir
+echo "$FOO" >foo
+echo "to stdout"
+echo "to stderr" >&2
+cat >input
+END
+echo "exit 3" >bad.q
+
+"$COMPILE" --server 2>server.log &
+server=$!
+DAEMONS="$DAEMONS $server"
+n=0
+while test ! -S "$socket"; do
+    n=`expr $n + 1`
+    test $n -lt 100 || fail "the server did not start"
+    sleep 0.1
+done
+
+# a command is run by the server with the client's directory, environment
+# and standard files
+echo "from stdin" | FOO=bar "$COMPILE" a.q >out 2>err &
+client=$!
+wait $client || fail "command run by the server failed"
+test "`cat parent`" != $client || fail "the command was not run by the server"
+test "`cat dir`" = "`pwd`" || fail "the command ran in `cat dir`"
+test "`cat foo`" = bar || fail "the client's environment was not used"
+test "`cat out`" = "to stdout" || fail "standard output was not the client's"
+grep -q "to stderr" err || fail "standard error was not the client's"
+test "`cat input`" = "from stdin" || fail "standard input was not the client's"
+
+# the client exits with the command's exit status
+set +e
+"$COMPILE" bad.q 2>/dev/null
+served=$?
+run bad.q 2>/dev/null
+local=$?
+set -e
+test $served != 0 || fail "a failed command run by the server succeeded"
+test $served = $local || fail "the client exited with $served instead of $local"
+
+# --no-server runs the command in the client
+echo "from stdin" | "$COMPILE" --no-server a.q >/dev/null 2>&1 &
+client=$!
+wait $client || fail "command run with --no-server failed"
+test "`cat parent`" = $client || fail "--no-server did not run the command in the client"
+
+# a changed targets file is loaded again
+sleep 1
+echo ".q sh -e" | rules
+echo "" | "$COMPILE" a.q >/dev/null 2>&1 || fail "command after changing the targets file failed"
+grep -q "reloaded" server.log || fail "the server did not reload the targets file"
+
+# the server removes its socket when it is stopped
+kill $server
+wait $server || fail "the server failed"
+test ! -e "$socket" || fail "the socket was left behind"
@@ -0,0 +1,76 @@
+# tests/snapshot.sh - the snapshot of the targets file in targets.cache
+. "$srcdir/tests/common.sh"
+
+# two programs whose names have the same length, so that a rule can be
+# changed without changing the size of the targets file
+for p in pa pb; do
+    printf '#!/bin/sh\necho %s >used\n' $p >"$SCRATCH/bin/$p"
+    chmod +x "$SCRATCH/bin/$p"
+done
+touch a.q
+snapshot=$HOME/.compile/targets.cache
+
+# used PROGRAM - check that the last run used PROGRAM
+used() {
+    test "`cat used`" = $1 || fail "$2: ran `cat used` instead of $1"
+}
+
+echo ".q pa" | rules
+run a.q || fail "first run failed"
+used pa "first run"
+test -s "$snapshot" || fail "no snapshot was written"
+run a.q || fail "run from the snapshot failed"
+used pa "run from the snapshot"
+
+# a targets file rewritten in place with the same size is read again
+sleep 1
+echo ".q pb" >"$HOME/.compile/targets"
+run a.q || fail "run after editing the targets file failed"
+used pb "run after an edit of the same size"
+
+# so is a targets file replaced by another with the same size and time
+echo ".q pa" >"$SCRATCH/targets"
+touch -r "$HOME/.compile/targets" "$SCRATCH/targets"
+mv "$SCRATCH/targets" "$HOME/.compile/targets"
+run a.q || fail "run after replacing the targets file failed"
+used pa "run after replacing the targets file"
+
+# a damaged snapshot is ignored and written again
+echo "not a snapshot" >"$SCRATCH/damaged"
+cp "$SCRATCH/damaged" "$snapshot"
+run a.q || fail "run with a damaged snapshot failed"
+used pa "run with a damaged snapshot"
+run a.q || fail "run after a damaged snapshot failed"
+used pa "run after a damaged snapshot"
+if cmp -s "$SCRATCH/damaged" "$snapshot"; then fail "a damaged snapshot was not replaced"; fi
+head -c 64 "$snapshot" >"$SCRATCH/short"
+mv "$SCRATCH/short" "$snapshot"
+run a.q || fail "run with a truncated snapshot failed"
+used pa "run with a truncated snapshot"
+
+# so is a snapshot whose extension index has no empty slot, which would
+# leave the lookup of an unknown extension probing forever; the index of a
+# snapshot of one rule has 32 slots after the 56 byte header and the 20 byte
+# rule record
+run a.q || fail "run to write the snapshot failed"
+dd if=/dev/zero of="$snapshot" bs=1 seek=76 count=128 conv=notrunc 2>/dev/null
+cp "$snapshot" "$SCRATCH/full"
+"$COMPILE" --no-server b.z >/dev/null 2>&1 &
+lookup=$!
+n=0
+while kill -0 $lookup 2>/dev/null; do
+    n=`expr $n + 1`
+    if test $n -ge 100; then
+        kill $lookup
+        fail "the lookup of an unknown extension did not end with a full index"
+    fi
+    sleep 0.1
+done
+run a.q || fail "run with a full index failed"
+used pa "run with a full index"
+if cmp -s "$SCRATCH/full" "$snapshot"; then fail "a snapshot with a full index was not replaced"; fi
+
+# the snapshot may be deleted
+rm -f "$snapshot"
+run a.q || fail "run without a snapshot failed"
+used pa "run without a snapshot"
@@ -0,0 +1,35 @@
+# tests/stats.sh - --stats and --stats=json
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh
+END
+echo "exit 0" >a.q
+echo "exit 0" >b.q
+# a target that keeps the CPU busy for a while
+echo 'i=0; while test $i -lt 200000; do i=$((i+1)); done' >busy.q
+
+# the report goes to standard error and counts the compiler processes
+run --stats --jobs 2 a.q b.q >out 2>err || fail "--stats failed"
+test ! -s out || fail "the report was written to standard output"
+for phase in "total" "settings load" "target resolution" "argument assembly" "spawn" "wait for compiler"; do
+    grep -q "stats: $phase  *[0-9.]* ms" err || fail "phase '$phase' not reported"
+done
+grep -q "stats: compiler processes  *2$" err || fail "the compiler processes were not counted"
+
+# the CPU time of the compilers is reported
+run --stats busy.q 2>err || fail "--stats failed"
+cpu=`sed -n 's/.*stats: compiler user CPU  *\([0-9.]*\) ms/\1/p' err`
+test -n "$cpu" || fail "user CPU time not reported"
+awk "BEGIN { exit !($cpu > 0) }" || fail "no user CPU time reported for a busy compiler"
+
+# the JSON report is a single object
+run --stats=json --jobs 2 a.q b.q 2>err || fail "--stats=json failed"
+test `wc -l <err | tr -d ' '` = 1 || fail "the JSON report is not a single line"
+grep -q '^{"phases":{"total":[0-9.]*,"settings":[0-9.]*,"resolve":[0-9.]*,"assemble":[0-9.]*,"spawn":[0-9.]*,"wait":[0-9.]*},"children":{"count":2,' err \
+    || fail "unexpected JSON report: `cat err`"
+grep -q '"max_rss_kib":[0-9]*,"voluntary_switches":[0-9]*,"involuntary_switches":[0-9]*}}$' err \
+    || fail "unexpected JSON report: `cat err`"
+
+# an unknown report format is an error
+if run --stats=xml a.q 2>/dev/null; then fail "--stats=xml was accepted"; fi
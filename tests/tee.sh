@@ -0,0 +1,38 @@
+# tests/tee.sh - redirect files and --tee
+. "$srcdir/tests/common.sh"
+
+rules <<'END'
+.q sh >$project.out
+END
+cat >a.q <<'END'
+i=0
+while test $i -lt 2000; do
+    echo "line $i"
+    i=`expr $i + 1`
+done
+END
+awk 'BEGIN { for (i = 0;i < 2000;++i) print "line " i }' >expected
+
+# the compiler's output goes to the redirect file
+run a.q >out || fail "redirected compile failed"
+cmp a.out expected || fail "the redirect file is wrong"
+test ! -s out || fail "redirected output was also written to standard output"
+
+# --tee also copies it to standard output
+rm a.out
+run --tee a.q >out || fail "--tee failed"
+cmp a.out expected || fail "the redirect file is wrong with --tee"
+cmp out expected || fail "standard output is wrong with --tee"
+
+# --tee copies to a file or a pipe
+run --tee a.q | cat >out || fail "--tee to a pipe failed"
+cmp out expected || fail "standard output is wrong with --tee to a pipe"
+
+# a failed compile leaves the previous redirect file in place
+echo "echo partial; exit 1" >a.q
+if run a.q 2>/dev/null; then fail "a failed compile succeeded"; fi
+cmp a.out expected || fail "a failed compile replaced the redirect file"
+if run --tee a.q >out 2>/dev/null; then fail "a failed compile succeeded"; fi
+cmp a.out expected || fail "a failed compile with --tee replaced the redirect file"
+test "`cat out`" = partial || fail "the output of a failed compile was not shown with --tee"
+test "`ls | grep -c '^a\.out.'`" = 0 || fail "a temporary file was left behind"
@@ -0,0 +1,46 @@
+# tests/templates.sh - the special tokens of rules
+. "$srcdir/tests/common.sh"
+
+# show writes each of its arguments on a line of its own
+printf '#!/bin/sh\nfor a; do echo "$a"; done >args\n' >"$SCRATCH/bin/show"
+chmod +x "$SCRATCH/bin/show"
+mkdir -p src/sub
+touch a.q src/b.q src/sub/c.q
+
+# expands RULE EXPECTED TARGET... - check the arguments given by RULE; the
+# arguments before the rule's options are the targets
+expands() {
+    echo ".q show $1" | rules
+    rule=$1
+    expected=$2
+    shift 2
+    run "$@" 2>err || fail "'$rule' failed"
+    test "`tr '\n' '|' <args`" = "$expected" || fail "'$rule' gave '`tr '\n' '|' <args`' instead of '$expected'"
+}
+
+expands '$target' "a.q|a.q|" a.q
+expands '$project' "src/b.q|src/b|" src/b.q
+
+# $targets makes an argument of each target when it is a whole option and
+# is joined with spaces inside of one
+expands '$targets' "a.q|src/b.q|a.q|src/b.q|" a.q src/b.q
+expands '-files=$targets' "a.q|src/b.q|-files=a.q src/b.q|" a.q src/b.q
+
+expands '$dir $stem' "src/sub/c.q|src/sub|c|" src/sub/c.q
+expands '-o$DIR/$Stem.o' "a.q|-o./a.o|" a.q
+expands '$jobs' "a.q|1|" a.q
+expands '-j$jobs' "a.q|-j3|" --jobs 3 a.q
+ncpu=`getconf _NPROCESSORS_ONLN 2>/dev/null || nproc`
+expands '$ncpu' "a.q|$ncpu|" a.q
+
+# a '$' that is not followed by a letter or digit is passed through, and an
+# unknown token is dropped with a warning
+expands '-x$ -y$-' 'a.q|-x$|-y$-|' a.q
+expands '-a$unknown' "a.q|-a|" a.q
+grep -q "unknown" err || fail "an unknown token was not reported"
+
+# the tokens work in redirect file names
+echo '.q sh >$dir/$stem.out' | rules
+echo "echo hello" >src/d.q
+run src/d.q || fail "redirect with tokens failed"
+test "`cat src/d.out`" = hello || fail "the redirect file name was not expanded"
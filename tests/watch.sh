@@ -0,0 +1,83 @@
+# tests/watch.sh - --watch
+. "$srcdir/tests/common.sh"
+
+test "`uname -s`" = Linux || exit 77
+
+rules <<'END'
+.q fakecc -o$project -MF$depfile
+.s sh
+.r sh >$project.out
+END
+echo "include inc.h" >a.q
+echo "header" >inc.h
+
+# lines PATTERN FILE - the number of lines of FILE that match PATTERN
+lines() {
+    cat $2 2>/dev/null | grep -c "$1" || true
+}
+
+# wait_for COUNT PATTERN FILE - wait up to 10 seconds for COUNT lines of FILE
+# to match PATTERN
+wait_for() {
+    n=0
+    while test `lines "$2" $3` != $1; do
+        n=`expr $n + 1`
+        test $n -lt 100 || fail "$3 has `lines "$2" $3` lines matching '$2' instead of $1"
+        sleep 0.1
+    done
+}
+
+# watch TARGET - start watching TARGET in the background; SIGINT is ignored
+# by background commands, so the watcher is stopped with SIGTERM
+watch() {
+    "$COMPILE" --no-server --watch $1 >watch.out 2>&1 &
+    watcher=$!
+    DAEMONS="$DAEMONS $watcher"
+}
+
+watch a.q
+wait_for 1 '' runs
+
+# a changed target and a changed dependency from the depfile each cause a build
+echo "# changed" >>a.q
+wait_for 2 '' runs
+echo "new header" >inc.h
+wait_for 3 '' runs
+grep -q "new header" a || fail "the output was not rebuilt from the new header"
+
+# the exit status is that of the last build
+echo "error" >>a.q
+wait_for 1 "build failed" watch.out
+kill $watcher
+if wait $watcher; then fail "the watcher succeeded after a failed build"; fi
+
+# a build still running when a change arrives is stopped and started over
+cat >slow.s <<'END'
+echo start >>log
+sleep 2
+echo end >>log
+END
+watch slow.s
+wait_for 1 '' log
+echo "# changed" >>slow.s
+wait_for 1 "build succeeded" watch.out
+test "`cat log | tr '\n' ' '`" = "start start end " || fail "the running build was not restarted"
+kill $watcher
+wait $watcher || fail "the watcher failed after a successful build"
+
+# a stopped build leaves no temporary redirect file behind, whether it was
+# restarted or the watch ended
+cat >slow.r <<'END'
+echo start >>rlog
+sleep 2
+END
+watch slow.r
+wait_for 1 '' rlog
+test -f slow.out.compile-tmp || fail "the redirect file was not written to a temporary file"
+echo "# changed" >>slow.r
+wait_for 1 "build cancelled" watch.out
+test ! -f slow.out.compile-tmp || fail "a cancelled build left its temporary redirect file"
+wait_for 2 '' rlog
+kill $watcher
+wait $watcher || true
+test ! -f slow.out.compile-tmp || fail "a stopped watch left its temporary redirect file"
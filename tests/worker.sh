@@ -0,0 +1,111 @@
+# tests/worker.sh - --worker and --remote
+. "$srcdir/tests/common.sh"
+
+# rcc runs fakecc and says where it ran on standard error; the worker finds
+# its own rcc first in PATH, and only the client has lonly
+mkdir -p "$SCRATCH/wbin" "$SCRATCH/cbin"
+printf '#!/bin/sh\necho "ran local" >&2\nexec fakecc "$@"\n' >"$SCRATCH/bin/rcc"
+printf '#!/bin/sh\necho "ran remote" >&2\nexec fakecc "$@"\n' >"$SCRATCH/wbin/rcc"
+printf '#!/bin/sh\necho "ran local" >&2\nexec fakecc "$@"\n' >"$SCRATCH/cbin/lonly"
+chmod +x "$SCRATCH/bin/rcc" "$SCRATCH/wbin/rcc" "$SCRATCH/cbin/lonly"
+rules <<'END'
+.q rcc -o$project -MF$depfile
+.r lonly -o$project -MF$depfile
+.s rcc -o$project
+END
+socket=$SCRATCH/w.sock
+echo "$socket" >"$HOME/.compile/workers"
+for t in a.q b.q a.r a.s; do
+    echo "include inc.h" >$t
+done
+echo "header" >inc.h
+
+# ran WHERE WHAT - check that the last command ran its compiler WHERE
+ran() {
+    grep -q "ran $1" err || fail "$2 did not run $1ly: `cat err`"
+    test `grep -c "^ran " err` = 1 || fail "$2 ran more than once: `cat err`"
+}
+
+# start_worker ADDRESS - start a worker with its own PATH
+start_worker() {
+    PATH=$SCRATCH/wbin:$PATH "$COMPILE" --worker=$1 --jobs 2 2>>worker.log &
+    DAEMONS="$DAEMONS $!"
+}
+
+start_worker $socket
+n=0
+while test ! -S "$socket"; do
+    n=`expr $n + 1`
+    test $n -lt 100 || fail "the worker did not start"
+    sleep 0.1
+done
+PATH=$SCRATCH/cbin:$PATH
+
+# a job runs locally until its dependencies are known, then on the worker
+# with its targets and dependencies; the output is written back
+run --remote a.q 2>err || fail "first remote build failed"
+ran local "the first build"
+rm a
+run --remote a.q 2>err || fail "remote build failed"
+ran remote "a build with known dependencies"
+cat a.q inc.h | cmp -s - a || fail "the output of a remote job is wrong"
+echo "new header" >inc.h
+run --remote a.q 2>err || fail "remote build after changing the header failed"
+ran remote "a build after changing the header"
+grep -q "new header" a || fail "a remote job did not get the new header"
+
+# several jobs go to the worker at once
+run --remote b.q 2>err || fail "first build of b.q failed"
+run --remote --jobs 2 a.q b.q 2>err || fail "remote jobs failed"
+test `grep -c "ran remote" err` = 2 || fail "both jobs did not run remotely: `cat err`"
+
+# a client that connects and sends nothing holds up no other client
+if command -v perl >/dev/null 2>&1; then
+    perl -MIO::Socket::UNIX -e '$s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or exit 1;
+        open(F,">",$ARGV[1]); close(F); sleep 30' "$socket" silent &
+    DAEMONS="$DAEMONS $!"
+    n=0
+    while test ! -f silent; do
+        n=`expr $n + 1`
+        test $n -lt 100 || fail "the silent client did not connect"
+        sleep 0.1
+    done
+    run --remote a.q 2>err || fail "remote build beside a silent client failed"
+    ran remote "a build beside a silent client"
+fi
+
+# a job that fails on the worker has failed; it is not run again locally
+echo "error" >>a.q
+if run --remote a.q 2>err; then fail "a failed remote job succeeded"; fi
+ran remote "a failing build"
+sed '/^error/d' a.q >a.tmp && mv a.tmp a.q
+
+# a job whose arguments name paths outside of its directory runs locally
+run --remote a.q -I/usr/include 2>err || fail "build with an absolute path failed"
+run --remote a.q -I/usr/include 2>err || fail "build with an absolute path failed"
+ran local "a build with an absolute path"
+run --remote a.q -I../include 2>err || fail "build with a parent path failed"
+run --remote a.q -I../include 2>err || fail "build with a parent path failed"
+ran local "a build with a parent path"
+
+# so does a job whose rule does not write a depfile
+run --remote a.s 2>err || fail "build without a depfile failed"
+run --remote a.s 2>err || fail "build without a depfile failed"
+ran local "a build without a depfile"
+
+# a job that the worker cannot run is run locally
+run --remote a.r 2>err || fail "first build of a.r failed"
+run --remote a.r 2>err || fail "build refused by the worker failed"
+ran local "a build refused by the worker"
+
+# and so is a job when no worker can be reached
+echo "$SCRATCH/none.sock" >"$HOME/.compile/workers"
+run --remote a.q 2>err || fail "build without a worker failed"
+ran local "a build without a worker"
+
+# a worker on TCP needs a secret
+if "$COMPILE" --worker=:0 2>err; then fail "a worker on TCP started without a secret"; fi
+grep -q "secret" err || fail "the missing secret was not reported"
+
+# --worker must be the first option
+if run --jobs 2 --worker 2>/dev/null; then fail "--worker was accepted after another option"; fi
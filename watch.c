@@ -0,0 +1,141 @@
+/* watch.c */
+#include "watch.h"
+#include "cache.h"
+#include "history.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define WATCH_DEBOUNCE 100 /* milliseconds to wait for changes to settle before building */
+
+/* events returned by wait_watch_event() */
+#define WATCH_EVENT_TIMEOUT 0
+#define WATCH_EVENT_CHANGE 1 /* a watched file changed */
+#define WATCH_EVENT_BUILD 2 /* the running build finished */
+#define WATCH_EVENT_STOP 3 /* the user asked to stop watching */
+
+extern const char* PROGRAM_NAME;
+
+/* functions internal to this unit */
+static void watch_files(session* psession);
+static int compare_names(const void* left,const void* right);
+static int init_watcher(); /* system-specific implementation - returns 0 on success */
+static void close_watcher(); /* system-specific implementation - also stops a running build */
+static void clear_watched_files(); /* system-specific implementation */
+static void add_watched_file(const char* fileName); /* system-specific implementation - calls with names in sorted order share directory lookups */
+static int start_build(session* psession); /* system-specific implementation - runs compile_session() in the background; returns 0 on success */
+static void cancel_build(); /* system-specific implementation */
+static int wait_watch_event(int timeout,int* pcode); /* system-specific implementation - returns WATCH_EVENT_*; timeout is in milliseconds or -1 */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#include "watch_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#include "watch_windows.c"
+#endif
+
+/* platform-independent code */
+
+int watch_session(session* psession)
+{
+    int ret;
+    int code;
+    int event;
+    int building; /* non-zero while a build is running */
+    int pending; /* non-zero if a build should start once changes settle */
+    int cancelled; /* non-zero if the running build was cancelled */
+    int timeout;
+    if (init_watcher() != 0)
+        return 1;
+    watch_files(psession);
+    ret = 0;
+    building = cancelled = 0;
+    pending = 1;
+    timeout = 0; /* the first build starts at once */
+    while (1) {
+        event = wait_watch_event(pending && !building ? timeout : -1,&code);
+        if (event == WATCH_EVENT_STOP)
+            break;
+        if (event == WATCH_EVENT_CHANGE) {
+            /* wait for the changes to settle; restart the debounce period
+               with each change */
+            pending = 1;
+            timeout = WATCH_DEBOUNCE;
+            if (building && !cancelled) {
+                cancel_build();
+                cancelled = 1;
+            }
+        }
+        else if (event == WATCH_EVENT_BUILD) {
+            building = 0;
+            if (cancelled) {
+                remove_partial_outputs(psession);
+                fprintf(stderr,"%s: watch: build cancelled because files changed\n",PROGRAM_NAME);
+            }
+            else {
+                ret = code;
+                if (code == 0)
+                    fprintf(stderr,"%s: watch: build succeeded; waiting for changes\n",PROGRAM_NAME);
+                else
+                    fprintf(stderr,"%s: watch: build failed; waiting for changes\n",PROGRAM_NAME);
+                /* the build may have recorded new dependencies */
+                watch_files(psession);
+            }
+        }
+        else if (event==WATCH_EVENT_TIMEOUT && pending && !building) {
+            if (start_build(psession) != 0) {
+                ret = 1;
+                break;
+            }
+            building = 1;
+            cancelled = pending = 0;
+        }
+    }
+    close_watcher();
+    if (building)
+        remove_partial_outputs(psession);
+    return ret;
+}
+
+/* definitions of internal functions */
+
+void watch_files(session* psession)
+{
+    /* watch the session's targets and the dependencies recorded for it;
+       the names are sorted so that duplicates are watched only once */
+    int i;
+    int count;
+    const char* iter;
+    const char** names;
+    stringbuf list;
+    init_stringbuf(&list);
+    for (i = 0;i < psession->targets_c;++i) {
+        concat_stringbuf(&list,psession->targets[i].buffer);
+        append_terminator_stringbuf(&list);
+    }
+    list_dependencies(psession,&list);
+    count = 0;
+    for (iter = list.buffer;iter < list.buffer+list.used;iter += strlen(iter)+1)
+        ++count;
+    names = heap_alloc(count*sizeof(const char*));
+    count = 0;
+    for (iter = list.buffer;iter < list.buffer+list.used;iter += strlen(iter)+1)
+        names[count++] = iter;
+    qsort(names,count,sizeof(const char*),&compare_names);
+    clear_watched_files();
+    for (i = 0;i < count;++i)
+        if (i == 0 || strcmp(names[i],names[i-1]) != 0)
+            add_watched_file(names[i]);
+    heap_free((void*)names);
+    destroy_stringbuf(&list);
+}
+
+int compare_names(const void* left,const void* right)
+{
+    return strcmp(*(const char* const*)left,*(const char* const*)right);
+}
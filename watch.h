@@ -0,0 +1,12 @@
+/* watch.h */
+#ifndef WATCH_H
+#define WATCH_H
+#include "compiler.h"
+
+/* watch_session - compile a loaded session and compile it again each time
+   one of its targets or recorded dependencies changes; a build that is still
+   running when another change arrives is cancelled and started over; returns
+   the exit code of the last finished build once the user stops the watch */
+int watch_session(session*);
+
+#endif
@@ -0,0 +1,239 @@
+/* watch_posix.c */
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+/* changes that cause a rebuild; editors that save by renaming a new file
+   over the old one are seen through the watched directory */
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_ONLYDIR)
+
+/* watched_file - a file name watched through its directory */
+typedef struct {
+    int wd; /* watch descriptor of the directory */
+    const char* name; /* name within the directory */
+} watched_file;
+
+/* data internal to this file */
+static int notify_fd = -1;
+static int signal_fd = -1;
+static sigset_t saved_mask; /* signal mask to restore in build processes */
+static pid_t build_pid = -1;
+static watched_file* files;
+static int files_c;
+static int files_alloc;
+static arena files_pool;
+static stringbuf last_dir; /* directory of the last file added and its watch */
+static int last_wd = -1;
+static int last_valid = 0; /* non-zero if last_dir and last_wd are set */
+
+int init_watcher()
+{
+    sigset_t mask;
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd == -1) {
+        fprintf(stderr,"%s: error: cannot watch files: %s\n",PROGRAM_NAME,strerror(errno));
+        return -1;
+    }
+    /* build completion and requests to stop are read as events so that
+       a build can be cancelled before the watch exits */
+    sigemptyset(&mask);
+    sigaddset(&mask,SIGCHLD);
+    sigaddset(&mask,SIGINT);
+    sigaddset(&mask,SIGTERM);
+    sigaddset(&mask,SIGHUP);
+    sigprocmask(SIG_BLOCK,&mask,&saved_mask);
+    signal_fd = signalfd(-1,&mask,SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        fprintf(stderr,"%s: error: cannot watch files: %s\n",PROGRAM_NAME,strerror(errno));
+        close(notify_fd);
+        sigprocmask(SIG_SETMASK,&saved_mask,NULL);
+        return -1;
+    }
+    init_arena(&files_pool);
+    init_stringbuf(&last_dir);
+    files = NULL;
+    files_c = files_alloc = 0;
+    return 0;
+}
+
+void close_watcher()
+{
+    int status;
+    if (build_pid != -1) {
+        kill(-build_pid,SIGTERM);
+        waitpid(build_pid,&status,0);
+        build_pid = -1;
+    }
+    close(signal_fd);
+    close(notify_fd);
+    sigprocmask(SIG_SETMASK,&saved_mask,NULL);
+    heap_free(files);
+    destroy_arena(&files_pool);
+    destroy_stringbuf(&last_dir);
+}
+
+void clear_watched_files()
+{
+    /* directory watches stay in place; events for names that are no
+       longer watched are ignored */
+    files_c = 0;
+    destroy_arena(&files_pool);
+    init_arena(&files_pool);
+    last_valid = 0;
+}
+
+void add_watched_file(const char* fileName)
+{
+    int n;
+    const char* base;
+    watched_file* entry;
+    base = strrchr(fileName,'/');
+    base = base == NULL ? fileName : base+1;
+    n = (int)(base-fileName);
+    if (!last_valid || last_dir.used != n || strncmp(last_dir.buffer,fileName,n) != 0) {
+        assign_stringbuf_ex(&last_dir,fileName,n);
+        last_wd = inotify_add_watch(notify_fd,n == 0 ? "." : last_dir.buffer,WATCH_MASK);
+        last_valid = 1;
+    }
+    if (last_wd == -1)
+        /* the directory is missing or unreadable; there is nothing to see */
+        return;
+    if (files_c >= files_alloc) {
+        files_alloc = files_alloc == 0 ? 64 : files_alloc*2;
+        files = heap_realloc(files,files_alloc*sizeof(watched_file));
+    }
+    entry = files+files_c++;
+    entry->wd = last_wd;
+    entry->name = strcpy(arena_alloc(&files_pool,strlen(base)+1),base);
+}
+
+int start_build(session* psession)
+{
+    int code;
+    fflush(stdout);
+    fflush(stderr);
+    build_pid = fork();
+    if (build_pid == -1) {
+        fprintf(stderr,"%s: error: cannot start build: %s\n",PROGRAM_NAME,strerror(errno));
+        return -1;
+    }
+    if (build_pid == 0) {
+        /* the build and its compilers form their own process group so that
+           they can be cancelled together */
+        setpgid(0,0);
+        sigprocmask(SIG_SETMASK,&saved_mask,NULL);
+        code = compile_session(psession);
+        close_cache();
+        close_history();
+        fflush(stdout);
+        _exit(code);
+    }
+    setpgid(build_pid,build_pid);
+    return 0;
+}
+
+void cancel_build()
+{
+    /* the build is reaped (and reported) by wait_watch_event() */
+    if (build_pid != -1)
+        kill(-build_pid,SIGTERM);
+}
+
+int wait_watch_event(int timeout,int* pcode)
+{
+    int i;
+    int status;
+    ssize_t n;
+    struct pollfd fds[2];
+    struct signalfd_siginfo info;
+    char ibuf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    fds[0].fd = signal_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = notify_fd;
+    fds[1].events = POLLIN;
+    while (1) {
+        if (poll(fds,2,timeout) == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr,"%s: error: cannot wait for changes: %s\n",PROGRAM_NAME,strerror(errno));
+            return WATCH_EVENT_STOP;
+        }
+        if (fds[0].revents & POLLIN) {
+            while (read(signal_fd,&info,sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo != SIGCHLD) {
+                    if (build_pid != -1) {
+                        kill(-build_pid,SIGTERM);
+                        waitpid(build_pid,&status,0);
+                        build_pid = -1;
+                    }
+                    return WATCH_EVENT_STOP;
+                }
+            }
+            if (build_pid != -1 && waitpid(build_pid,&status,WNOHANG) == build_pid) {
+                build_pid = -1;
+                *pcode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+                return WATCH_EVENT_BUILD;
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            int changed = 0;
+            while ((n = read(notify_fd,ibuf,sizeof(ibuf))) > 0) {
+                const char* iter;
+                for (iter = ibuf;iter < ibuf+n;iter += sizeof(struct inotify_event)+((struct inotify_event*)iter)->len) {
+                    const struct inotify_event* event = (const struct inotify_event*)iter;
+                    if (event->len == 0)
+                        continue;
+                    for (i = 0;i < files_c;++i) {
+                        if (files[i].wd==event->wd && strcmp(files[i].name,event->name)==0) {
+                            changed = 1;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (changed)
+                return WATCH_EVENT_CHANGE;
+        }
+        if (timeout >= 0 && !(fds[0].revents & POLLIN) && !(fds[1].revents & POLLIN))
+            return WATCH_EVENT_TIMEOUT;
+    }
+}
+#else
+int init_watcher()
+{
+    fprintf(stderr,"%s: error: --watch is not supported on this system\n",PROGRAM_NAME);
+    return -1;
+}
+
+void close_watcher()
+{
+}
+
+void clear_watched_files()
+{
+}
+
+void add_watched_file(const char* fileName)
+{
+}
+
+int start_build(session* psession)
+{
+    return -1;
+}
+
+void cancel_build()
+{
+}
+
+int wait_watch_event(int timeout,int* pcode)
+{
+    return WATCH_EVENT_STOP;
+}
+#endif
@@ -0,0 +1,33 @@
+/* watch_windows.c */
+
+int init_watcher()
+{
+	fprintf(stderr,"%s: error: --watch is not supported on this system\n",PROGRAM_NAME);
+	return -1;
+}
+
+void close_watcher()
+{
+}
+
+void clear_watched_files()
+{
+}
+
+void add_watched_file(const char* fileName)
+{
+}
+
+int start_build(session* psession)
+{
+	return -1;
+}
+
+void cancel_build()
+{
+}
+
+int wait_watch_event(int timeout,int* pcode)
+{
+	return WATCH_EVENT_STOP;
+}
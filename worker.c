@@ -0,0 +1,457 @@
+/* worker.c */
+#include "worker.h"
+#include "settings.h"
+#include "cache.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define MESSAGE_MAGIC 0x57504d43 /* "CMPW" */
+#define MESSAGE_VERSION 2
+#define MAX_MESSAGE_SIZE (256*1024*1024)
+#define MAX_WORKERS 256 /* addresses read from the workers file */
+#define SECRET_SIZE 64 /* bytes of the shared secret that are sent, including a terminator */
+#define REQUEST_STATUS 1 /* report the worker's load */
+#define REQUEST_COMPILE 2 /* run a job */
+#define RESPONSE_BUSY -2 /* a compile request found every slot of the worker in use */
+#define RESPONSE_REFUSED -3 /* the worker cannot run the job, e.g. it has no rule for it */
+#define DEPFILE_NAME ".compile-depfile" /* the job's $depfile in its directory on a worker */
+
+extern const char* PROGRAM_NAME;
+
+/* message_header - the fixed part of a message in either direction; a
+   compile request is followed by 'size' bytes holding 'argc' null terminated
+   strings, which are the extension of the rule and the arguments that follow
+   the rule's program, and then 'files' file records; a compile response
+   holds 'out' bytes of standard output, 'err' bytes of standard error and
+   then the records of the files that the compiler created; a status request
+   has no payload and is answered with a worker_status */
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int kind; /* REQUEST_* kind of a request; the compiler's exit code or a RESPONSE_* code in a response */
+    int argc;
+    int files;
+    int out;
+    int err;
+    int size;
+    char secret[SECRET_SIZE]; /* the shared secret of the workers file in a request, padded with null characters */
+} message_header;
+
+/* worker_status - a worker's answer to a status request */
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int running; /* compile requests being served */
+    int slots; /* compile requests the worker wants to serve at once */
+    int load; /* one minute load average times 100 */
+} worker_status;
+
+/* file_record - precedes a file's null terminated name and its contents in
+   a message */
+typedef struct {
+    int name; /* bytes of the name including its terminator */
+    int mode; /* permission bits */
+    int size; /* bytes of contents */
+} file_record;
+
+/* functions internal to this unit */
+static int read_workers(stringbuf* dest,char* secret); /* returns the number of addresses; they are separated by null characters; 'secret' receives SECRET_SIZE bytes */
+static int choose_worker(const char** addresses,int count,const char* secret,const char* arguments,const char* tried); /* returns the index of the chosen worker or -1 if every worker not yet tried is busy or unreachable */
+static char** decode_arguments(const message_header* header,char* payload,const char** pnext); /* returns NULL if the request is malformed */
+static void append_argument(stringbuf* dest,const char* arg,const char* depfile);
+static void append_file(stringbuf* dest,const char* name,int mode,const char* data,int size);
+static const char* next_file(const char* iter,const char* end,file_record* prec,const char** pname); /* returns the file's contents or NULL if the record is malformed */
+static const char* rule_program(const char* rule); /* returns the program of the rule for extension 'rule' or NULL if there is none */
+static int is_worker_argument(const char* arg);
+static int same_secret(const char* left,const char* right);
+static int query_worker(const char* address,const char* secret,worker_status* pstatus); /* system-specific implementation - returns 0 on success */
+static int exchange_message(const char* address,const message_header* request,const stringbuf* payload,
+    message_header* presponse,stringbuf* response); /* system-specific implementation - returns 0 on success */
+static int load_file(const char* fileName,stringbuf* dest,int* pmode); /* system-specific implementation - appends the contents; returns 0 on success */
+static int store_file(const char* fileName,int mode,const char* data,int size); /* system-specific implementation - returns 0 on success */
+static void write_output(int error,const char* data,int size); /* system-specific implementation - write to standard output or, if 'error', standard error */
+static int run_local(const char* path,const char* argv[]); /* system-specific implementation - replace this process with the program at 'path'; returns an exit code if that fails */
+
+/* platform-dependent code */
+
+#if defined(BUILD_COMPILE_POSIX)
+#define PATH_SEPARATOR "/"
+#include "worker_posix.c"
+#elif defined(BUILD_COMPILE_WINDOWS)
+#define PATH_SEPARATOR "\\"
+#include "worker_windows.c"
+#endif
+
+/* platform-independent code */
+
+int remote_compile(const remote_job* remote,const char* arguments)
+{
+    /* a worker that turns the job down because it filled up since it was
+       asked for its load, or because it cannot run it, is passed over for
+       the next; nothing is written until the whole response has been
+       checked; a job that fails on a worker has failed, so only a job that
+       no worker could run falls back to a local run */
+    int i;
+    int n;
+    int count;
+    int result;
+    int mode;
+    const char* iter;
+    const char* end;
+    const char* name;
+    const char* data;
+    const char* addresses[MAX_WORKERS];
+    char tried[MAX_WORKERS];
+    char secret[SECRET_SIZE];
+    message_header header;
+    message_header response;
+    file_record record;
+    stringbuf list;
+    stringbuf contents;
+    stringbuf payload;
+    stringbuf reply;
+    init_stringbuf(&list);
+    count = read_workers(&list,secret);
+    for (i = 0, n = 0;i < count;++i) {
+        addresses[i] = list.buffer+n;
+        n += strlen(list.buffer+n)+1;
+    }
+    if (count == 0) {
+        destroy_stringbuf(&list);
+        return -1;
+    }
+    /* the request holds the rule, the arguments that follow the program and
+       then the files */
+    init_stringbuf(&contents);
+    init_stringbuf(&payload);
+    init_stringbuf(&reply);
+    memset(&header,0,sizeof(header));
+    header.magic = MESSAGE_MAGIC;
+    header.version = MESSAGE_VERSION;
+    header.kind = REQUEST_COMPILE;
+    memcpy(header.secret,secret,SECRET_SIZE);
+    header.argc = 1;
+    append_stringbuf(&payload,remote->rule,strlen(remote->rule)+1);
+    result = 0;
+    for (iter = arguments+strlen(arguments)+1;*iter && result==0;iter += strlen(iter)+1) {
+        n = payload.used;
+        append_argument(&payload,iter,remote->depfile);
+        if ( !is_worker_argument(payload.buffer+n) )
+            result = -1;
+        ++header.argc;
+    }
+    for (n = 0;remote->files[n]!=NULL && result==0;++n) {
+        reset_stringbuf(&contents);
+        result = load_file(remote->files[n],&contents,&mode);
+        if (result == 0)
+            append_file(&payload,remote->files[n],mode,contents.buffer,contents.used);
+        if (payload.used > MAX_MESSAGE_SIZE)
+            result = -1;
+    }
+    header.files = n;
+    header.size = payload.used;
+    memset(tried,0,sizeof(tried));
+    i = -1;
+    while (result==0 && (i = choose_worker(addresses,count,secret,arguments,tried))!=-1) {
+        reset_stringbuf(&reply);
+        if (exchange_message(addresses[i],&header,&payload,&response,&reply)==0
+            && response.kind!=RESPONSE_BUSY && response.kind!=RESPONSE_REFUSED)
+            break;
+        tried[i] = 1;
+    }
+    if (i == -1)
+        result = -1;
+    if (result==0 && (response.kind<0 || response.files<0 || (response.kind!=0 && response.files!=0)
+            || response.out<0 || response.err<0 || response.out > reply.used-response.err))
+        result = -1;
+    if (result == 0) {
+        iter = reply.buffer+response.out+response.err;
+        end = reply.buffer+reply.used;
+        for (n = 0;n<response.files && result==0;++n) {
+            data = next_file(iter,end,&record,&name);
+            if (data==NULL || !is_worker_path(name))
+                result = -1;
+            else
+                iter = data+record.size;
+        }
+        if (iter != end)
+            result = -1;
+    }
+    if (result == 0) {
+        /* a local run after a failed store overwrites what was stored */
+        iter = reply.buffer+response.out+response.err;
+        for (n = 0;n<response.files && result==0;++n) {
+            data = next_file(iter,end,&record,&name);
+            if (strcmp(name,DEPFILE_NAME) == 0)
+                name = remote->depfile;
+            result = store_file(name,record.mode,data,record.size);
+            iter = data+record.size;
+        }
+    }
+    if (result == 0) {
+        write_output(0,reply.buffer,response.out);
+        write_output(1,reply.buffer+response.out,response.err);
+        result = response.kind;
+    }
+    destroy_stringbuf(&reply);
+    destroy_stringbuf(&payload);
+    destroy_stringbuf(&contents);
+    destroy_stringbuf(&list);
+    return result;
+}
+
+int run_remote_job(int argc,const char* argv[])
+{
+    /* the exchange with the workers runs in a process of its own since the
+       process that starts a job may have threads, and only async-signal-safe
+       calls may follow fork() in such a process */
+    int i;
+    int n;
+    int code;
+    const char** files;
+    remote_job remote;
+    stringbuf arguments;
+    n = argc>5 ? atoi(argv[5]) : -1;
+    if (n<0 || 6+n>=argc) {
+        fprintf(stderr,"%s: error: bad arguments for %s\n",PROGRAM_NAME,REMOTE_JOB_OPTION);
+        return 127;
+    }
+    files = heap_alloc((n+1)*sizeof(const char*));
+    for (i = 0;i < n;++i)
+        files[i] = argv[6+i];
+    files[n] = NULL;
+    remote.rule = argv[2];
+    remote.depfile = argv[3];
+    remote.files = files;
+    /* the arguments are null separated with an extra null at the end */
+    init_stringbuf(&arguments);
+    for (i = 6+n;i < argc;++i)
+        append_stringbuf(&arguments,argv[i],strlen(argv[i])+1);
+    code = remote_compile(&remote,arguments.buffer);
+    destroy_stringbuf(&arguments);
+    heap_free((void*)files);
+    if (code >= 0)
+        return code;
+    return run_local(argv[4],argv+6+n);
+}
+
+int is_worker_path(const char* name)
+{
+    /* no absolute paths, drive letters or '..' components */
+    size_t n;
+    if (name[0]==0 || name[0]=='/' || name[0]=='\\' || strchr(name,':')!=NULL)
+        return 0;
+    while (1) {
+        n = strcspn(name,"/\\");
+        if ((n==2 && name[0]=='.' && name[1]=='.') || (n==0 && name[n]==0))
+            return 0;
+        if (name[n] == 0)
+            return 1;
+        name += n+1;
+    }
+}
+
+/* definitions of internal functions */
+
+int read_workers(stringbuf* dest,char* secret)
+{
+    /* one address per line; blank lines and lines starting with '#' are
+       skipped, as is anything after the address; a line 'secret TOKEN'
+       gives the shared secret instead */
+    int count;
+    size_t n;
+    char* p;
+    FILE* fp;
+    char line[1024];
+    stringbuf fileName;
+    init_stringbuf(&fileName);
+    assign_stringbuf(&fileName,get_settings_directory());
+    concat_stringbuf(&fileName,PATH_SEPARATOR "workers");
+    fp = fopen(fileName.buffer,"r");
+    destroy_stringbuf(&fileName);
+    memset(secret,0,SECRET_SIZE);
+    if (fp == NULL)
+        return 0;
+    count = 0;
+    while (count<MAX_WORKERS && fgets(line,sizeof(line),fp)!=NULL) {
+        p = line;
+        while ( isspace((unsigned char)*p) )
+            ++p;
+        n = strcspn(p," \t\r\n");
+        if (n==0 || *p=='#')
+            continue;
+        if (n==6 && strncmp(p,"secret",6)==0) {
+            p += n;
+            while ( isspace((unsigned char)*p) )
+                ++p;
+            n = strcspn(p," \t\r\n");
+            if (n >= SECRET_SIZE)
+                n = SECRET_SIZE-1;
+            memset(secret,0,SECRET_SIZE);
+            memcpy(secret,p,n);
+            continue;
+        }
+        append_stringbuf(dest,p,(int)n);
+        append_terminator_stringbuf(dest);
+        ++count;
+    }
+    fclose(fp);
+    return count;
+}
+
+int choose_worker(const char** addresses,int count,const char* secret,const char* arguments,const char* tried)
+{
+    /* the worker with the smallest share of its slots in use wins and then
+       the one with the lowest load average; the search starts at a worker
+       picked by a hash of the job so that jobs started at the same moment
+       do not all choose the same idle worker */
+    int i, j;
+    int n;
+    int best;
+    long long left, right;
+    cache_key key;
+    worker_status status;
+    worker_status chosen;
+    for (n = 0;arguments[n];n += strlen(arguments+n)+1)
+        ;
+    init_cache_key(&key);
+    hash_cache_key(&key,arguments,n);
+    memset(&chosen,0,sizeof(chosen));
+    best = -1;
+    for (j = 0;j < count;++j) {
+        i = (int)((key.hash[0]+j) % count);
+        if (tried[i] || query_worker(addresses[i],secret,&status)!=0 || status.slots<=0 || status.running>=status.slots)
+            continue;
+        if (best != -1) {
+            left = (long long)status.running * chosen.slots;
+            right = (long long)chosen.running * status.slots;
+            if (left>right || (left==right && status.load>=chosen.load))
+                continue;
+        }
+        best = i;
+        chosen = status;
+    }
+    return best;
+}
+
+char** decode_arguments(const message_header* header,char* payload,const char** pnext)
+{
+    /* the returned argument vector is null terminated like main()'s */
+    int i;
+    char* iter;
+    char* end;
+    char** argv;
+    if (header->argc<1 || header->files<0 || header->size<=0 || header->size>MAX_MESSAGE_SIZE)
+        return NULL;
+    argv = heap_alloc((header->argc+1)*sizeof(char*));
+    iter = payload;
+    end = payload+header->size;
+    for (i = 0;i < header->argc;++i) {
+        if (iter>=end || memchr(iter,0,end-iter)==NULL) {
+            heap_free(argv);
+            return NULL;
+        }
+        argv[i] = iter;
+        iter += strlen(iter)+1;
+    }
+    argv[i] = NULL;
+    *pnext = iter;
+    return argv;
+}
+
+void append_argument(stringbuf* dest,const char* arg,const char* depfile)
+{
+    /* the job's $depfile becomes a file in the job's directory on the
+       worker, which sends it back with the files that the compiler creates */
+    size_t n;
+    const char* p;
+    n = strlen(depfile);
+    while (n>0 && (p = strstr(arg,depfile))!=NULL) {
+        append_stringbuf(dest,arg,(int)(p-arg));
+        concat_stringbuf(dest,DEPFILE_NAME);
+        arg = p+n;
+    }
+    concat_stringbuf(dest,arg);
+    append_terminator_stringbuf(dest);
+}
+
+void append_file(stringbuf* dest,const char* name,int mode,const char* data,int size)
+{
+    file_record record;
+    record.name = strlen(name)+1;
+    record.mode = mode;
+    record.size = size;
+    append_stringbuf(dest,(const char*)&record,sizeof(record));
+    append_stringbuf(dest,name,record.name);
+    append_stringbuf(dest,data,size);
+}
+
+const char* next_file(const char* iter,const char* end,file_record* prec,const char** pname)
+{
+    /* records are copied out since they need not be aligned in a payload */
+    if (end-iter < (long)sizeof(file_record))
+        return NULL;
+    memcpy(prec,iter,sizeof(file_record));
+    iter += sizeof(file_record);
+    if (prec->name<=1 || prec->size<0 || prec->name>end-iter || prec->size>end-iter-prec->name
+        || memchr(iter,0,prec->name)!=iter+prec->name-1)
+        return NULL;
+    *pname = iter;
+    return iter+prec->name;
+}
+
+const char* rule_program(const char* rule)
+{
+    /* a worker only runs the programs of its own rules */
+    compiler* info;
+    info = rule[0]=='.' ? lookup_compiler(rule) : NULL;
+    return info == NULL ? NULL : info->program.buffer;
+}
+
+int is_worker_argument(const char* arg)
+{
+    /* an argument may not name an absolute path or a path that leaves the
+       working directory, whether on its own or inside an option such as
+       -I/usr/include, --sysroot=/opt or -Wl,-rpath,../lib */
+    size_t m, n;
+    const char* p;
+    if (*arg == '-') {
+        while (*arg == '-')
+            ++arg;
+        while ( isalpha((unsigned char)*arg) )
+            ++arg;
+    }
+    while (1) {
+        /* each piece after a ',', ':' or '=' may be a path of its own */
+        n = strcspn(arg,",:=");
+        if (n>0 && (arg[0]=='/' || arg[0]=='\\'))
+            return 0;
+        for (p = arg;p < arg+n;p += m+1) {
+            m = strcspn(p,"/\\,:=");
+            if (m==2 && p[0]=='.' && p[1]=='.')
+                return 0;
+        }
+        if (arg[n] == 0)
+            return 1;
+        arg += n+1;
+    }
+}
+
+int same_secret(const char* left,const char* right)
+{
+    /* every byte is compared so that the time taken does not tell how much
+       of a guess was right */
+    int i;
+    unsigned char diff;
+    diff = 0;
+    for (i = 0;i < SECRET_SIZE;++i)
+        diff |= (unsigned char)(left[i] ^ right[i]);
+    return diff == 0;
+}
@@ -0,0 +1,41 @@
+/* worker.h */
+#ifndef WORKER_H
+#define WORKER_H
+
+#define REMOTE_JOB_OPTION "--remote-job" /* runs a job on a worker in a process of its own; see run_remote_job() */
+
+/* remote_job - what is sent to a worker with a job's arguments */
+typedef struct {
+    const char* rule; /* extension of the job's rule; the worker runs the program of its own rule */
+    const char* depfile; /* the job's $depfile, which the worker writes in the job's directory and sends back */
+    const char* const* files; /* null terminated list of files to send along */
+} remote_job;
+
+/* run_worker - serve compile requests from clients on 'address' (a socket
+   path, or host:port for TCP) until the worker is stopped; each request runs
+   a rule's program in its own temporary directory holding the files sent
+   with it, and the files the program creates are sent back; 'slots' is the
+   number of requests the worker asks clients to run on it at once */
+int run_worker(const char* address,int slots);
+
+/* remote_compile - run a job on the least loaded worker listed in the
+   workers file of the settings directory; 'arguments' are null separated
+   like a job's (the first is the rule's program, which is not sent); the
+   compiler's output is written to our standard output and error and, if it
+   succeeds, the files that it creates to the working directory and its
+   $depfile to the job's; returns the compiler's exit code on the worker or
+   -1 if no worker could run the job, which should then run locally */
+int remote_compile(const remote_job* remote,const char* arguments);
+
+/* run_remote_job - the helper process that runs a job offered to workers,
+   started as 'compile --remote-job RULE DEPFILE PATH N FILE... PROGRAM
+   ARG...' with the job's standard files, resources and working directory;
+   it runs the job on a worker or, if no worker can take it, replaces itself
+   with the compiler at PATH; returns the exit code of the process */
+int run_remote_job(int argc,const char* argv[]);
+
+/* is_worker_path - returns non-zero if 'name' can be sent to a worker: a
+   relative path that does not leave the working directory */
+int is_worker_path(const char* name);
+
+#endif
@@ -0,0 +1,887 @@
+/* worker_posix.c */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pwd.h>
+
+#define WORKER_SOCKET_NAME "/.compile/worker.sock" /* default address; relative to home directory */
+#define STATUS_TIMEOUT 5 /* seconds to wait for a status request or response */
+#define PENDING_MAX 64 /* accepted clients whose request header has not all arrived */
+
+#if defined(SO_PEERCRED) && defined(__linux__)
+/* peer_credentials - layout of Linux's struct ucred, which is only declared
+   with _GNU_SOURCE */
+typedef struct {
+    pid_t pid;
+    uid_t uid;
+    gid_t gid;
+} peer_credentials;
+#endif
+
+/* pending_request - an accepted client whose request header is being read */
+typedef struct {
+    int conn;
+    int got; /* bytes of 'header' received */
+    long long deadline; /* monotonic time after which the client is dropped */
+    message_header header;
+} pending_request;
+
+/* data internal to this file */
+static volatile sig_atomic_t worker_stopping = 0;
+static volatile sig_atomic_t children_reaped = 0; /* request processes reaped by child_exited() */
+
+/* functions internal to this file */
+static int open_socket(const char* address,int listening); /* returns a socket or -1 with errno set */
+static int bind_unix_socket(int fd,const struct sockaddr_un* paddr); /* returns 0 on success */
+static int connect_socket(int fd,const struct sockaddr* paddr,socklen_t len); /* returns 0 on success or -1 with errno set */
+static int same_user(int conn); /* returns non-zero if the peer of a socket path runs as our user */
+static void stop_worker(int signum);
+static void child_exited(int signum);
+static int serve_compile(int conn,const message_header* header); /* returns the compiler's exit code */
+static int run_program(const char* dirName,char* const argv[],int outfd,int errfd); /* returns the exit code or -1 if the program could not be run */
+static int write_files(stringbuf* path,const char* iter,const char* end,int count,const char** names); /* returns 0 on success */
+static int collect_files(stringbuf* path,int rootlen,const char** sent,int sent_c,stringbuf* dest,int* pcount); /* returns 0 on success */
+static void remove_tree(stringbuf* path);
+static int open_temp_file(const char* tmpdir); /* returns an unlinked file or -1 */
+static int read_payload(int fd,stringbuf* dest,int size); /* returns 0 if all bytes were read */
+static void read_output(int fd,stringbuf* dest); /* append a temporary file's contents */
+static int read_fully(int fd,void* buffer,size_t size); /* returns 0 if all bytes were read */
+static int send_fully(int fd,const void* buffer,size_t size); /* returns 0 if all bytes were sent */
+static int write_fully(int fd,const void* buffer,size_t size); /* returns 0 if all bytes were written */
+
+int run_worker(const char* address,int slots)
+{
+    int i, n;
+    int fd;
+    int conn;
+    int local; /* non-zero if 'address' is a socket path */
+    int started; /* request processes started */
+    int pending_c;
+    int first; /* index in 'fds' of the first pending client */
+    int timeout, wait;
+    int complete;
+    ssize_t got;
+    long long now;
+    pid_t pid;
+    double load;
+    char secret[SECRET_SIZE];
+    struct sigaction sa;
+    const char* home;
+    struct passwd* pwd;
+    message_header header;
+    worker_status status;
+    stringbuf list;
+    static pending_request pending[PENDING_MAX];
+    static struct pollfd fds[PENDING_MAX+1];
+    static char defaultAddress[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    if (address == NULL) {
+        /* the default socket is under HOME like the settings directory */
+        home = getenv("HOME");
+        if (home==NULL || *home==0) {
+            pwd = getpwuid(getuid());
+            home = pwd != NULL ? pwd->pw_dir : NULL;
+        }
+        if (home==NULL || strlen(home)+strlen(WORKER_SOCKET_NAME) >= sizeof(defaultAddress)) {
+            fprintf(stderr,"%s: error: cannot determine worker socket name\n",PROGRAM_NAME);
+            return 1;
+        }
+        strcpy(defaultAddress,home);
+        strcat(defaultAddress,WORKER_SOCKET_NAME);
+        address = defaultAddress;
+    }
+    if (slots == 0) {
+        slots = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (slots < 1)
+            slots = 1;
+    }
+    /* a socket path only serves our own user; over TCP a client must know
+       the secret of the workers file */
+    local = strchr(address,'/') != NULL;
+    init_stringbuf(&list);
+    read_workers(&list,secret);
+    destroy_stringbuf(&list);
+    if (!local && secret[0]==0) {
+        fprintf(stderr,"%s: error: a worker on '%s' needs a 'secret' line in '%s" PATH_SEPARATOR "workers'\n",
+            PROGRAM_NAME,address,get_settings_directory());
+        return 1;
+    }
+    fd = open_socket(address,1);
+    if (fd == -1) {
+        if (errno == EADDRINUSE)
+            fprintf(stderr,"%s: error: a worker is already running on '%s'\n",PROGRAM_NAME,address);
+        else
+            fprintf(stderr,"%s: error: cannot bind worker socket '%s': %s\n",PROGRAM_NAME,address,strerror(errno));
+        return 1;
+    }
+    if (listen(fd,SOMAXCONN) == -1) {
+        fprintf(stderr,"%s: error: cannot listen on worker socket: %s\n",PROGRAM_NAME,strerror(errno));
+        close(fd);
+        if (local)
+            unlink(address);
+        return 1;
+    }
+    /* request processes are reaped as they exit so that none is left a
+       zombie and the count reported to clients is current; a stop request
+       interrupts poll() so that the socket can be removed */
+    fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+    memset(&sa,0,sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE,&sa,NULL);
+    sa.sa_handler = &child_exited;
+    sigaction(SIGCHLD,&sa,NULL);
+    sa.sa_handler = &stop_worker;
+    sigaction(SIGINT,&sa,NULL);
+    sigaction(SIGTERM,&sa,NULL);
+    sigaction(SIGHUP,&sa,NULL);
+    fprintf(stderr,"%s: worker serving on '%s' with %d slots\n",PROGRAM_NAME,address,slots);
+    started = 0;
+    pending_c = 0;
+    while (!worker_stopping) {
+        /* the headers of all clients are read as they arrive so that one
+           client that is slow to send its header holds up no other; a
+           client that does not send it in time is dropped; no client is
+           accepted while the pending table is full */
+        n = 0;
+        if (pending_c < PENDING_MAX) {
+            fds[n].fd = fd;
+            fds[n].events = POLLIN;
+            ++n;
+        }
+        first = n;
+        now = get_monotonic_time();
+        timeout = -1;
+        for (i = 0;i < pending_c;++i) {
+            fds[n].fd = pending[i].conn;
+            fds[n].events = POLLIN;
+            ++n;
+            wait = pending[i].deadline>now ? (int)((pending[i].deadline-now)/1000000)+1 : 0;
+            if (timeout==-1 || wait<timeout)
+                timeout = wait;
+        }
+        if (poll(fds,n,timeout) == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr,"%s: error: cannot wait for requests: %s\n",PROGRAM_NAME,strerror(errno));
+            break;
+        }
+        now = get_monotonic_time();
+        /* the last entry replaces a finished one, so go backwards */
+        for (i = pending_c-1;i >= 0;--i) {
+            pending_request* req = pending+i;
+            if (fds[first+i].revents != 0) {
+                got = recv(req->conn,(char*)&req->header+req->got,sizeof(message_header)-req->got,0);
+                if (got > 0)
+                    req->got += got;
+                else if (got==0 || (errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR))
+                    req->deadline = 0;
+            }
+            if (req->got<(int)sizeof(message_header) && req->deadline>now)
+                continue;
+            conn = req->conn;
+            header = req->header;
+            complete = req->got == (int)sizeof(message_header);
+            *req = pending[--pending_c];
+            if (!complete || header.magic!=MESSAGE_MAGIC || header.version!=MESSAGE_VERSION) {
+                close(conn);
+                continue;
+            }
+            fcntl(conn,F_SETFL,fcntl(conn,F_GETFL) & ~O_NONBLOCK);
+            if (local ? !same_user(conn) : !same_secret(header.secret,secret)) {
+                fprintf(stderr,"%s: warning: refused a request from an unauthorized client\n",PROGRAM_NAME);
+                close(conn);
+                continue;
+            }
+            if (header.kind == REQUEST_STATUS) {
+                status.magic = MESSAGE_MAGIC;
+                status.version = MESSAGE_VERSION;
+                status.running = started-children_reaped;
+                status.slots = slots;
+                status.load = getloadavg(&load,1) == 1 ? (int)(load*100) : 0;
+                send_fully(conn,&status,sizeof(status));
+            }
+            else if (header.kind==REQUEST_COMPILE && started-children_reaped>=slots) {
+                /* the client tries another worker or runs the job itself */
+                memset(&header,0,sizeof(header));
+                header.magic = MESSAGE_MAGIC;
+                header.version = MESSAGE_VERSION;
+                header.kind = RESPONSE_BUSY;
+                send_fully(conn,&header,sizeof(header));
+            }
+            else if (header.kind == REQUEST_COMPILE) {
+                if ( settings_changed() ) {
+                    unload_settings();
+                    load_settings_from_file();
+                    fprintf(stderr,"%s: reloaded targets file\n",PROGRAM_NAME);
+                }
+                fflush(stdout);
+                pid = fork();
+                if (pid == 0) {
+                    close(fd);
+                    for (i = 0;i < pending_c;++i)
+                        close(pending[i].conn);
+                    sa.sa_handler = SIG_DFL;
+                    sigaction(SIGCHLD,&sa,NULL);
+                    sigaction(SIGINT,&sa,NULL);
+                    sigaction(SIGTERM,&sa,NULL);
+                    sigaction(SIGHUP,&sa,NULL);
+                    _exit(serve_compile(conn,&header));
+                }
+                else if (pid == -1)
+                    fprintf(stderr,"%s: error: cannot start request process: %s\n",PROGRAM_NAME,strerror(errno));
+                else
+                    ++started;
+            }
+            close(conn);
+        }
+        if (first>0 && fds[0].revents!=0) {
+            conn = accept(fd,NULL,NULL);
+            if (conn == -1) {
+                if (errno==EINTR || errno==ECONNABORTED || errno==EAGAIN || errno==EWOULDBLOCK)
+                    continue;
+                fprintf(stderr,"%s: error: cannot accept request: %s\n",PROGRAM_NAME,strerror(errno));
+                break;
+            }
+            fcntl(conn,F_SETFD,FD_CLOEXEC);
+            fcntl(conn,F_SETFL,fcntl(conn,F_GETFL) | O_NONBLOCK);
+            pending[pending_c].conn = conn;
+            pending[pending_c].got = 0;
+            pending[pending_c].deadline = now + STATUS_TIMEOUT*1000000000LL;
+            ++pending_c;
+        }
+    }
+    for (i = 0;i < pending_c;++i)
+        close(pending[i].conn);
+    close(fd);
+    if (local)
+        unlink(address);
+    return 0;
+}
+
+int query_worker(const char* address,const char* secret,worker_status* pstatus)
+{
+    int fd;
+    int result;
+    struct timeval tv;
+    message_header header;
+    fd = open_socket(address,0);
+    if (fd == -1)
+        return -1;
+    tv.tv_sec = STATUS_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+    memset(&header,0,sizeof(header));
+    header.magic = MESSAGE_MAGIC;
+    header.version = MESSAGE_VERSION;
+    header.kind = REQUEST_STATUS;
+    memcpy(header.secret,secret,SECRET_SIZE);
+    result = -1;
+    if (send_fully(fd,&header,sizeof(header))==0 && read_fully(fd,pstatus,sizeof(worker_status))==0
+        && pstatus->magic==MESSAGE_MAGIC && pstatus->version==MESSAGE_VERSION)
+        result = 0;
+    close(fd);
+    return result;
+}
+
+int exchange_message(const char* address,const message_header* request,const stringbuf* payload,
+    message_header* presponse,stringbuf* response)
+{
+    int fd;
+    int result;
+    fd = open_socket(address,0);
+    if (fd == -1)
+        return -1;
+    result = -1;
+    if (send_fully(fd,request,sizeof(message_header))==0 && send_fully(fd,payload->buffer,payload->used)==0
+        && read_fully(fd,presponse,sizeof(message_header))==0 && presponse->magic==MESSAGE_MAGIC
+        && presponse->version==MESSAGE_VERSION && presponse->size>=0 && presponse->size<=MAX_MESSAGE_SIZE)
+        result = read_payload(fd,response,presponse->size);
+    close(fd);
+    return result;
+}
+
+int load_file(const char* fileName,stringbuf* dest,int* pmode)
+{
+    int fd;
+    ssize_t n;
+    struct stat st;
+    char ibuf[65536];
+    fd = open(fileName,O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd,&st)==-1 || !S_ISREG(st.st_mode) || st.st_size>MAX_MESSAGE_SIZE) {
+        close(fd);
+        return -1;
+    }
+    while ((n = read(fd,ibuf,sizeof(ibuf))) > 0)
+        append_stringbuf(dest,ibuf,(int)n);
+    close(fd);
+    *pmode = st.st_mode & 0777;
+    return n == 0 ? 0 : -1;
+}
+
+int store_file(const char* fileName,int mode,const char* data,int size)
+{
+    /* write a temporary file next to the output and rename it into place so
+       that a failed transfer never leaves a partial output behind */
+    int fd;
+    int result;
+    stringbuf temp;
+    init_stringbuf(&temp);
+    assign_stringbuf(&temp,fileName);
+    concat_stringbuf(&temp,".compile-tmp");
+    result = -1;
+    fd = open(temp.buffer,O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,(mode & 0777) | S_IRUSR | S_IWUSR);
+    if (fd != -1) {
+        /* an existing temporary file keeps its mode, so set it explicitly */
+        result = fchmod(fd,mode & 0777)==0 && write_fully(fd,data,size)==0 ? 0 : -1;
+        if (close(fd)==-1 || (result==0 && rename(temp.buffer,fileName)==-1))
+            result = -1;
+        if (result == -1)
+            unlink(temp.buffer);
+    }
+    destroy_stringbuf(&temp);
+    return result;
+}
+
+void write_output(int error,const char* data,int size)
+{
+    write_fully(error ? STDERR_FILENO : STDOUT_FILENO,data,size);
+}
+
+int run_local(const char* path,const char* argv[])
+{
+    execv(path,(char* const*)argv);
+    fprintf(stderr,"%s: error: cannot start '%s': %s\n",PROGRAM_NAME,path,strerror(errno));
+    return 127;
+}
+
+/* definitions of internal functions */
+
+int open_socket(const char* address,int listening)
+{
+    /* an address with a '/' is a socket path; any other is host:port where
+       the host may be in brackets and is 127.0.0.1 if empty */
+    int fd;
+    int err;
+    int on;
+    size_t n;
+    const char* colon;
+    char host[256];
+    struct sockaddr_un addr;
+    struct addrinfo hints;
+    struct addrinfo* list;
+    struct addrinfo* ai;
+    if (strchr(address,'/') != NULL) {
+        if (strlen(address) >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path,address);
+        fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+        if (fd == -1)
+            return -1;
+        if ((listening ? bind_unix_socket(fd,&addr) : connect(fd,(struct sockaddr*)&addr,sizeof(addr))) == -1) {
+            err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+    colon = strrchr(address,':');
+    n = colon == NULL ? 0 : (size_t)(colon-address);
+    if (colon==NULL || colon[1]==0 || n>=sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n>=2 && address[0]=='[' && address[n-1]==']') {
+        memcpy(host,address+1,n-2);
+        host[n-2] = 0;
+    }
+    else {
+        memcpy(host,address,n);
+        host[n] = 0;
+    }
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (host[0] == 0)
+        strcpy(host,"127.0.0.1");
+    if (getaddrinfo(host,colon+1,&hints,&list) != 0) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    fd = -1;
+    err = EADDRNOTAVAIL;
+    for (ai = list;ai != NULL;ai = ai->ai_next) {
+        fd = socket(ai->ai_family,ai->ai_socktype | SOCK_CLOEXEC,ai->ai_protocol);
+        if (fd == -1) {
+            err = errno;
+            continue;
+        }
+        on = 1;
+        if (listening) {
+            setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+            if (bind(fd,ai->ai_addr,ai->ai_addrlen) == 0)
+                break;
+        }
+        else if (connect_socket(fd,ai->ai_addr,ai->ai_addrlen) == 0) {
+            /* requests and responses are written in pieces */
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+            break;
+        }
+        err = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(list);
+    if (fd == -1)
+        errno = err;
+    return fd;
+}
+
+int connect_socket(int fd,const struct sockaddr* paddr,socklen_t len)
+{
+    /* a host that does not answer is given up on after STATUS_TIMEOUT
+       rather than the system's much longer connect timeout */
+    int n;
+    int err;
+    int flags;
+    socklen_t errlen;
+    struct pollfd pfd;
+    flags = fcntl(fd,F_GETFL);
+    fcntl(fd,F_SETFL,flags | O_NONBLOCK);
+    if (connect(fd,paddr,len) == -1) {
+        if (errno != EINPROGRESS)
+            return -1;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        while ((n = poll(&pfd,1,STATUS_TIMEOUT*1000))==-1 && errno==EINTR)
+            ;
+        if (n == 0)
+            errno = ETIMEDOUT;
+        if (n <= 0)
+            return -1;
+        errlen = sizeof(err);
+        if (getsockopt(fd,SOL_SOCKET,SO_ERROR,&err,&errlen) == -1)
+            return -1;
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+    }
+    fcntl(fd,F_SETFL,flags);
+    return 0;
+}
+
+int bind_unix_socket(int fd,const struct sockaddr_un* paddr)
+{
+    /* replace the socket left behind by a worker that is no longer running */
+    int probe;
+    int stale;
+    if (bind(fd,(const struct sockaddr*)paddr,sizeof(struct sockaddr_un)) == 0)
+        return 0;
+    if (errno != EADDRINUSE)
+        return -1;
+    probe = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if (probe == -1)
+        return -1;
+    stale = connect(probe,(const struct sockaddr*)paddr,sizeof(struct sockaddr_un))==-1 && errno==ECONNREFUSED;
+    close(probe);
+    if (!stale) {
+        errno = EADDRINUSE;
+        return -1;
+    }
+    unlink(paddr->sun_path);
+    return bind(fd,(const struct sockaddr*)paddr,sizeof(struct sockaddr_un));
+}
+
+int same_user(int conn)
+{
+#if defined(SO_PEERCRED) && defined(__linux__)
+    peer_credentials cred;
+    socklen_t len;
+    len = sizeof(cred);
+    return getsockopt(conn,SOL_SOCKET,SO_PEERCRED,&cred,&len)==0 && cred.uid==getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(conn,&uid,&gid)==0 && uid==getuid();
+#endif
+}
+
+void stop_worker(int signum)
+{
+    (void)signum;
+    worker_stopping = 1;
+}
+
+void child_exited(int signum)
+{
+    int err;
+    (void)signum;
+    err = errno;
+    while (waitpid(-1,NULL,WNOHANG) > 0)
+        ++children_reaped;
+    errno = err;
+}
+
+int serve_compile(int conn,const message_header* header)
+{
+    /* the files are written to a new temporary directory where the program
+       runs with its output going to unlinked temporary files outside of it;
+       every file in the directory afterwards that was not sent is sent back */
+    int code;
+    int count;
+    int outfd, errfd;
+    char* payload;
+    char** argv;
+    const char* iter;
+    const char* tmpdir;
+    const char* program;
+    const char** sent;
+    message_header response;
+    stringbuf path;
+    stringbuf reply;
+    if (header->size<=0 || header->size>MAX_MESSAGE_SIZE || header->files<0 || header->files>header->size)
+        return 1;
+    payload = heap_alloc(header->size);
+    if (read_fully(conn,payload,header->size) != 0)
+        return 1;
+    argv = decode_arguments(header,payload,&iter);
+    if (argv == NULL)
+        return 1;
+    memset(&response,0,sizeof(response));
+    response.magic = MESSAGE_MAGIC;
+    response.version = MESSAGE_VERSION;
+    init_stringbuf(&path);
+    init_stringbuf(&reply);
+    sent = heap_alloc((header->files+1)*sizeof(const char*));
+    tmpdir = getenv("TMPDIR");
+    if (tmpdir==NULL || *tmpdir==0)
+        tmpdir = "/tmp";
+    assign_stringbuf(&path,tmpdir);
+    concat_stringbuf(&path,"/compile-worker-XXXXXX");
+    outfd = errfd = -1;
+    code = RESPONSE_REFUSED;
+    program = rule_program(argv[0]);
+    for (count = 1;argv[count]!=NULL && is_worker_argument(argv[count]);++count)
+        ;
+    if (program == NULL)
+        fprintf(stderr,"%s: refused a job for '%s': no rule for that extension\n",PROGRAM_NAME,argv[0]);
+    else if (argv[count] != NULL)
+        fprintf(stderr,"%s: refused a job with argument '%s': it names a path outside of the job\n",PROGRAM_NAME,argv[count]);
+    else if (mkdtemp(path.buffer) == NULL)
+        fprintf(stderr,"%s: error: cannot create directory in '%s': %s\n",PROGRAM_NAME,tmpdir,strerror(errno));
+    else {
+        argv[0] = (char*)program;
+        outfd = open_temp_file(tmpdir);
+        errfd = open_temp_file(tmpdir);
+        if (outfd!=-1 && errfd!=-1
+            && write_files(&path,iter,payload+header->size,header->files,sent)==0)
+            code = run_program(path.buffer,argv,outfd,errfd);
+        if (code == -1)
+            code = RESPONSE_REFUSED;
+        if (outfd!=-1 && errfd!=-1) {
+            /* the output comes first in the reply and then the created files */
+            read_output(outfd,&reply);
+            response.out = reply.used;
+            read_output(errfd,&reply);
+            response.err = reply.used-response.out;
+        }
+        count = 0;
+        if (code==0 && collect_files(&path,path.used,sent,header->files,&reply,&count)!=0) {
+            fprintf(stderr,"%s: error: cannot send the output of '%s'\n",PROGRAM_NAME,argv[0]);
+            truncate_stringbuf(&reply,response.out+response.err);
+            count = 0;
+            code = RESPONSE_REFUSED;
+        }
+        response.files = count;
+        remove_tree(&path);
+    }
+    if (outfd != -1)
+        close(outfd);
+    if (errfd != -1)
+        close(errfd);
+    response.kind = code;
+    response.size = reply.used;
+    if (send_fully(conn,&response,sizeof(response)) == 0)
+        send_fully(conn,reply.buffer,reply.used);
+    destroy_stringbuf(&reply);
+    destroy_stringbuf(&path);
+    heap_free((void*)sent);
+    heap_free(argv);
+    heap_free(payload);
+    return code;
+}
+
+int run_program(const char* dirName,char* const argv[],int outfd,int errfd)
+{
+    /* the program is found in the worker's own PATH; a program that cannot
+       be started is reported through a close-on-exec pipe so that the
+       client runs the job elsewhere; a program killed by a signal exits
+       with 128 plus the signal's number like it would in a shell */
+    int err;
+    int status;
+    int nullfd;
+    int fds[2];
+    ssize_t n;
+    pid_t pid;
+    if (pipe(fds) == -1)
+        return -1;
+    fcntl(fds[0],F_SETFD,FD_CLOEXEC);
+    fcntl(fds[1],F_SETFD,FD_CLOEXEC);
+    pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        nullfd = open("/dev/null",O_RDONLY);
+        if (chdir(dirName)==-1 || nullfd==-1 || dup2(nullfd,STDIN_FILENO)==-1
+            || dup2(outfd,STDOUT_FILENO)==-1 || dup2(errfd,STDERR_FILENO)==-1)
+            err = errno;
+        else {
+            execvp(argv[0],argv);
+            err = errno;
+        }
+        n = write(fds[1],&err,sizeof(err));
+        _exit(127);
+    }
+    close(fds[1]);
+    do
+        n = read(fds[0],&err,sizeof(err));
+    while (n==-1 && errno==EINTR);
+    close(fds[0]);
+    while (waitpid(pid,&status,0) == -1)
+        if (errno != EINTR)
+            return -1;
+    if (n == sizeof(err)) {
+        fprintf(stderr,"%s: error: cannot start '%s': %s\n",PROGRAM_NAME,argv[0],strerror(err));
+        return -1;
+    }
+    if ( WIFSIGNALED(status) )
+        return 128+WTERMSIG(status);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int write_files(stringbuf* path,const char* iter,const char* end,int count,const char** names)
+{
+    /* write the files of a request into the directory 'path' (and any
+       subdirectories they name); their names are stored in 'names' */
+    int i;
+    int fd;
+    int used;
+    int result;
+    char* p;
+    const char* name;
+    const char* data;
+    file_record record;
+    used = path->used;
+    result = 0;
+    for (i = 0;i<count && result==0;++i) {
+        data = next_file(iter,end,&record,&name);
+        if (data==NULL || !is_worker_path(name)) {
+            result = -1;
+            break;
+        }
+        iter = data+record.size;
+        names[i] = name;
+        truncate_stringbuf(path,used);
+        concat_stringbuf(path,"/");
+        concat_stringbuf(path,name);
+        for (p = path->buffer+used+1;(p = strchr(p,'/')) != NULL;++p) {
+            *p = 0;
+            if (mkdir(path->buffer,S_IRWXU)==-1 && errno!=EEXIST)
+                result = -1;
+            *p = '/';
+        }
+        fd = open(path->buffer,O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,(record.mode & 0777) | S_IRUSR | S_IWUSR);
+        if (fd==-1 || write_fully(fd,data,record.size)!=0)
+            result = -1;
+        if (fd != -1)
+            close(fd);
+    }
+    names[i] = NULL;
+    truncate_stringbuf(path,used);
+    return result==0 && iter==end ? 0 : -1;
+}
+
+int collect_files(stringbuf* path,int rootlen,const char** sent,int sent_c,stringbuf* dest,int* pcount)
+{
+    /* 'path' names a directory in the sandbox; the names sent back are
+       relative to its first 'rootlen' characters; links and other special
+       files are not sent */
+    int i;
+    int mode;
+    int used;
+    int result;
+    DIR* pdir;
+    struct stat st;
+    struct dirent* ent;
+    stringbuf contents;
+    pdir = opendir(path->buffer);
+    if (pdir == NULL)
+        return -1;
+    init_stringbuf(&contents);
+    used = path->used;
+    result = 0;
+    while (result==0 && (ent = readdir(pdir))!=NULL) {
+        if (strcmp(ent->d_name,".")==0 || strcmp(ent->d_name,"..")==0)
+            continue;
+        truncate_stringbuf(path,used);
+        concat_stringbuf(path,"/");
+        concat_stringbuf(path,ent->d_name);
+        if (lstat(path->buffer,&st) == -1)
+            result = -1;
+        else if ( S_ISDIR(st.st_mode) )
+            result = collect_files(path,rootlen,sent,sent_c,dest,pcount);
+        else if ( S_ISREG(st.st_mode) ) {
+            for (i = 0;i<sent_c && strcmp(sent[i],path->buffer+rootlen+1)!=0;++i)
+                ;
+            if (i < sent_c)
+                continue;
+            reset_stringbuf(&contents);
+            result = load_file(path->buffer,&contents,&mode);
+            if (result == 0) {
+                append_file(dest,path->buffer+rootlen+1,mode,contents.buffer,contents.used);
+                ++*pcount;
+                if (dest->used > MAX_MESSAGE_SIZE)
+                    result = -1;
+            }
+        }
+    }
+    closedir(pdir);
+    truncate_stringbuf(path,used);
+    destroy_stringbuf(&contents);
+    return result;
+}
+
+void remove_tree(stringbuf* path)
+{
+    int used;
+    DIR* pdir;
+    struct stat st;
+    struct dirent* ent;
+    pdir = opendir(path->buffer);
+    if (pdir != NULL) {
+        used = path->used;
+        while ((ent = readdir(pdir)) != NULL) {
+            if (strcmp(ent->d_name,".")==0 || strcmp(ent->d_name,"..")==0)
+                continue;
+            truncate_stringbuf(path,used);
+            concat_stringbuf(path,"/");
+            concat_stringbuf(path,ent->d_name);
+            if (lstat(path->buffer,&st)==0 && S_ISDIR(st.st_mode))
+                remove_tree(path);
+            else
+                unlink(path->buffer);
+        }
+        closedir(pdir);
+        truncate_stringbuf(path,used);
+    }
+    rmdir(path->buffer);
+}
+
+int open_temp_file(const char* tmpdir)
+{
+    int fd;
+    stringbuf name;
+    init_stringbuf(&name);
+    assign_stringbuf(&name,tmpdir);
+    concat_stringbuf(&name,"/compile-worker-XXXXXX");
+    fd = mkstemp(name.buffer);
+    if (fd != -1) {
+        unlink(name.buffer);
+        fcntl(fd,F_SETFD,FD_CLOEXEC);
+    }
+    destroy_stringbuf(&name);
+    return fd;
+}
+
+int read_payload(int fd,stringbuf* dest,int size)
+{
+    ssize_t n;
+    char ibuf[65536];
+    while (size > 0) {
+        n = read(fd,ibuf,size < (int)sizeof(ibuf) ? (size_t)size : sizeof(ibuf));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        append_stringbuf(dest,ibuf,(int)n);
+        size -= n;
+    }
+    return 0;
+}
+
+void read_output(int fd,stringbuf* dest)
+{
+    ssize_t n;
+    char ibuf[65536];
+    lseek(fd,0,SEEK_SET);
+    while ((n = read(fd,ibuf,sizeof(ibuf))) > 0)
+        append_stringbuf(dest,ibuf,(int)n);
+}
+
+int read_fully(int fd,void* buffer,size_t size)
+{
+    ssize_t n;
+    while (size > 0) {
+        n = read(fd,buffer,size);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buffer = (char*)buffer + n;
+        size -= n;
+    }
+    return 0;
+}
+
+int send_fully(int fd,const void* buffer,size_t size)
+{
+    /* a peer that went away is an error rather than a SIGPIPE */
+    ssize_t n;
+    while (size > 0) {
+        n = send(fd,buffer,size,MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buffer = (const char*)buffer + n;
+        size -= n;
+    }
+    return 0;
+}
+
+int write_fully(int fd,const void* buffer,size_t size)
+{
+    ssize_t n;
+    while (size > 0) {
+        n = write(fd,buffer,size);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buffer = (const char*)buffer + n;
+        size -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+/* worker_windows.c */
+
+int run_worker(const char* address,int slots)
+{
+	fprintf(stderr,"%s: error: --worker is not supported on this system\n",PROGRAM_NAME);
+	return 1;
+}
+
+int query_worker(const char* address,const char* secret,worker_status* pstatus)
+{
+	return -1;
+}
+
+int exchange_message(const char* address,const message_header* request,const stringbuf* payload,
+	message_header* presponse,stringbuf* response)
+{
+	return -1;
+}
+
+int load_file(const char* fileName,stringbuf* dest,int* pmode)
+{
+	return -1;
+}
+
+int store_file(const char* fileName,int mode,const char* data,int size)
+{
+	return -1;
+}
+
+void write_output(int error,const char* data,int size)
+{
+	fwrite(data,1,size,error ? stderr : stdout);
+}
+
+int run_local(const char* path,const char* argv[])
+{
+	fprintf(stderr,"%s: error: cannot start '%s'\n",PROGRAM_NAME,path);
+	return 127;
+}